@@ -6,8 +6,13 @@
 #include "dxt.h"
 #include "util.h"
 
-
-//#define DXT_INTR 1
+#if defined(DXT_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
 
 void ExtractBlock( const byte *inPtr, int width, byte *colorBlock );
 void ExtractBlock_Intrinsics( const byte *inPtr, int width, byte *colorBlock );
@@ -29,6 +34,8 @@ void EmitDoubleWord( dword i, byte*& );
 
 void EmitColorIndices( const byte *colorBlock, const byte *minColor, const byte *maxColor, byte *&outData );
 void EmitColorIndicesFast( const byte *colorBlock, const byte *minColor, const byte *maxColor, byte *&outData );
+void EmitColorBlockNormal( const byte *colorBlock, byte *&outData );
+void EmitColorBlockHQ( const byte *colorBlock, byte *&outData );
 void EmitColorIndices_Intrinsics( const byte *colorBlock, const byte *minColor, const byte *maxColor, byte *&outData);
 
 // Emit indices for DXT5
@@ -36,39 +43,115 @@ void EmitAlphaIndices( const byte *colorBlock, const byte minAlpha, const byte m
 void EmitAlphaIndicesFast( const byte *colorBlock, const byte minAlpha, const byte maxAlpha, byte *&outData);
 void EmitAlphaIndices_Intrinsics( const byte *colorBlock, const byte minAlpha, const byte maxAlpha, byte *&outData);
 
+// Whole-image DXT1 compressors of the SIMD paths
+void CompressImageDXT1_SSE2( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes );
+void CompressImageDXT1_AVX2( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes );
 
-void CompressImageDXT1( const byte *inBuf, byte *outBuf,
-			int width, int height, int &outputBytes )
-{
-  ALIGN16( byte *outData );
-  ALIGN16( byte block[64] );
-  ALIGN16( byte minColor[4] );
-  ALIGN16( byte maxColor[4] );
 
-  outData = outBuf;
-  for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
-    for ( int i = 0; i < width; i += 4 ) {
+static int DetectDXTPath()
+{
+#if defined(DXT_X86)
+  unsigned int r[4];
+#if defined(_MSC_VER)
+  __cpuid( (int*)r, 0 );
+#else
+  __cpuid( 0, r[0], r[1], r[2], r[3] );
+#endif
+  unsigned int nid = r[0];
+  if ( nid < 1 )
+    return DXT_PATH_SCALAR;
 
-#if defined(DXT_INTR)
-	ExtractBlock_Intrinsics( inBuf + i * 4, width, block );
+#if defined(_MSC_VER)
+  __cpuid( (int*)r, 1 );
+#else
+  __cpuid( 1, r[0], r[1], r[2], r[3] );
+#endif
+  if ( !(r[3] & (1 << 26)) )  // SSE2
+    return DXT_PATH_SCALAR;
+
+  // AVX2 also needs the OS to save the YMM registers (OSXSAVE, XCR0 bits 1-2)
+  if ( nid < 7 || !(r[2] & (1 << 27)) || !(r[2] & (1 << 28)) )
+    return DXT_PATH_SSE2;
+#if defined(_MSC_VER)
+  unsigned long long xcr0 = _xgetbv( 0 );
 #else
-	ExtractBlock( inBuf + i * 4, width, block );
+  unsigned int xlo, xhi;
+  __asm__ __volatile__ ( "xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0) );
+  unsigned long long xcr0 = ((unsigned long long)xhi << 32) | xlo;
 #endif
+  if ( (xcr0 & 6) != 6 )
+    return DXT_PATH_SSE2;
 
-#if defined(DXT_INTR)
-      GetMinMaxColors_Intrinsics( block, minColor, maxColor );
+#if defined(_MSC_VER)
+  __cpuidex( (int*)r, 7, 0 );
+#else
+  __cpuid_count( 7, 0, r[0], r[1], r[2], r[3] );
+#endif
+  return (r[1] & (1 << 5)) ? DXT_PATH_AVX2 : DXT_PATH_SSE2;
 #else
-      GetMinMaxColorsByBBox( block, minColor, maxColor );
+  return DXT_PATH_SCALAR;
 #endif
+}
 
-      EmitWord( ColorTo565( maxColor ), outData );
-      EmitWord( ColorTo565( minColor ), outData );
+static int dxtPath = DXT_PATH_AUTO;
 
-#if defined(DXT_INTR)
-      EmitColorIndices_Intrinsics( block, minColor, maxColor, outData );
-#else
-      EmitColorIndicesFast( block, minColor, maxColor, outData );
+int GetDXTPathSupported()
+{
+  static const int supported = DetectDXTPath();
+  return supported;
+}
+
+int GetDXTPath()
+{
+  int supported = GetDXTPathSupported();
+  return (dxtPath == DXT_PATH_AUTO || dxtPath > supported) ? supported : dxtPath;
+}
+
+void SetDXTPath( int path )
+{
+  dxtPath = path;
+}
+
+
+void CompressImageDXT1( const byte *inBuf, byte *outBuf,
+			int width, int height, int &outputBytes, int quality )
+{
+  ALIGN16( byte *outData );
+  ALIGN16( byte block[64] );
+  ALIGN16( byte minColor[4] );
+  ALIGN16( byte maxColor[4] );
+
+#if defined(DXT_X86)
+  if ( quality == DXT_QUALITY_FAST ) {
+    switch ( GetDXTPath() ) {
+    case DXT_PATH_AVX2:
+      CompressImageDXT1_AVX2( inBuf, outBuf, width, height, outputBytes );
+      return;
+    case DXT_PATH_SSE2:
+      CompressImageDXT1_SSE2( inBuf, outBuf, width, height, outputBytes );
+      return;
+    }
+  }
 #endif
+
+  outData = outBuf;
+  for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
+    for ( int i = 0; i < width; i += 4 ) {
+      ExtractBlock( inBuf + i * 4, width, block );
+      switch ( quality ) {
+      case DXT_QUALITY_HIGH:
+	EmitColorBlockHQ( block, outData );
+	break;
+      case DXT_QUALITY_NORMAL:
+	EmitColorBlockNormal( block, outData );
+	break;
+      default:
+	GetMinMaxColorsByBBox( block, minColor, maxColor );
+	EmitWord( ColorTo565( maxColor ), outData );
+	EmitWord( ColorTo565( minColor ), outData );
+	EmitColorIndicesFast( block, minColor, maxColor, outData );
+	break;
+      }
     }
   }
   outputBytes = (int) ( outData - outBuf );
@@ -129,42 +212,40 @@ void CompressImageDXT5( const byte *inBuf, byte *outBuf, int width, int height,
   ALIGN16( byte minColor[4] );
   ALIGN16( byte maxColor[4] );
   
+#if defined(DXT_X86)
+  bool simd = (GetDXTPath() != DXT_PATH_SCALAR);
+#endif
+
   outData = outBuf;
   for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
     for ( int i = 0; i < width; i += 4 ) {
       
-#if defined(DXT_INTR)
-      ExtractBlock_Intrinsics( inBuf + i * 4, width, block );
-#else
-      ExtractBlock( inBuf + i * 4, width, block );
-#endif
-      
-#if defined(DXT_INTR)
-      GetMinMaxColors_Intrinsics( block, minColor, maxColor );
-#else
-      GetMinMaxColorsAlpha( block, minColor, maxColor );
+#if defined(DXT_X86)
+      if ( simd ) {
+        ExtractBlock_Intrinsics( inBuf + i * 4, width, block );
+        GetMinMaxColors_Intrinsics( block, minColor, maxColor );
+      } else
 #endif
+      {
+        ExtractBlock( inBuf + i * 4, width, block );
+        GetMinMaxColorsAlpha( block, minColor, maxColor );
+      }
       
       EmitByte( maxColor[3], outData);
       EmitByte( minColor[3], outData);
       
-#if defined(DXT_INTR)
-	  // Not Yet Implemented
-      //EmitAlphaIndices_Intrinsics( block, minColor[3], maxColor[3], outData );
-
+      // EmitAlphaIndices_Intrinsics is not implemented
       EmitAlphaIndicesFast( block, minColor[3], maxColor[3], outData );
-#else
-      EmitAlphaIndicesFast( block, minColor[3], maxColor[3], outData );
-#endif
       
       EmitWord( ColorTo565( maxColor ), outData);
       EmitWord( ColorTo565( minColor ), outData);
       
-#if defined(DXT_INTR)
-      EmitColorIndices_Intrinsics( block, minColor, maxColor, outData );
-#else
-      EmitColorIndicesFast( block, minColor, maxColor, outData );
+#if defined(DXT_X86)
+      if ( simd )
+        EmitColorIndices_Intrinsics( block, minColor, maxColor, outData );
+      else
 #endif
+        EmitColorIndicesFast( block, minColor, maxColor, outData );
     }
   }
   outputBytes = int( outData - outBuf );
@@ -429,6 +510,195 @@ void EmitColorIndicesFast( const byte *colorBlock, const byte *minColor, const b
 }
 
 
+//
+// High quality DXT1 block: the end points start at the extremes of the
+// block along its principal colour axis and are refined by least squares
+// fits to the chosen indices, keeping the result with the lowest error
+//
+static void Palette565( word c0, word c1, int colors[4][3] )
+{
+  colors[0][0] = ( ( c0 >> 8 ) & C565_5_MASK ) | ( c0 >> 13 );
+  colors[0][1] = ( ( c0 >> 3 ) & C565_6_MASK ) | ( ( c0 >> 9 ) & 3 );
+  colors[0][2] = ( ( c0 << 3 ) & C565_5_MASK ) | ( ( c0 >> 2 ) & 7 );
+  colors[1][0] = ( ( c1 >> 8 ) & C565_5_MASK ) | ( c1 >> 13 );
+  colors[1][1] = ( ( c1 >> 3 ) & C565_6_MASK ) | ( ( c1 >> 9 ) & 3 );
+  colors[1][2] = ( ( c1 << 3 ) & C565_5_MASK ) | ( ( c1 >> 2 ) & 7 );
+  for ( int k = 0; k < 3; k++ ) {
+    colors[2][k] = ( 2 * colors[0][k] + 1 * colors[1][k] ) / 3;
+    colors[3][k] = ( 1 * colors[0][k] + 2 * colors[1][k] ) / 3;
+  }
+}
+
+// Best 4-colour mode indices for end points c0, c1. Returns the squared error.
+static int ColorIndicesHQ( const byte *colorBlock, word c0, word c1, dword &indices )
+{
+  int colors[4][3];
+  int error = 0;
+  Palette565( c0, c1, colors );
+  indices = 0;
+  for ( int i = 0; i < 16; i++ ) {
+    int minDistance = MAX_INT, index = 0;
+    for ( int j = 0; j < 4; j++ ) {
+      int d0 = colorBlock[i*4+0] - colors[j][0];
+      int d1 = colorBlock[i*4+1] - colors[j][1];
+      int d2 = colorBlock[i*4+2] - colors[j][2];
+      int dist = d0 * d0 + d1 * d1 + d2 * d2;
+      if ( dist < minDistance ) {
+	minDistance = dist;
+	index = j;
+      }
+    }
+    indices |= (dword)index << ( i << 1 );
+    error += minDistance;
+  }
+  return error;
+}
+
+static word FloatTo565( const float *color )
+{
+  int r = (int)( color[0] * ( 31.0f / 255.0f ) + 0.5f );
+  int g = (int)( color[1] * ( 63.0f / 255.0f ) + 0.5f );
+  int b = (int)( color[2] * ( 31.0f / 255.0f ) + 0.5f );
+  r = ( r < 0 ? 0 : r > 31 ? 31 : r );
+  g = ( g < 0 ? 0 : g > 63 ? 63 : g );
+  b = ( b < 0 ? 0 : b > 31 ? 31 : b );
+  return (word)( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+static void PrincipalAxisColors( const byte *colorBlock, word &c0, word &c1 )
+{
+  float mean[3] = { 0, 0, 0 }, cov[6] = { 0, 0, 0, 0, 0, 0 };
+  float axis[3];
+  int i, k;
+
+  for ( i = 0; i < 16; i++ )
+    for ( k = 0; k < 3; k++ )
+      mean[k] += colorBlock[i*4+k] * ( 1.0f / 16.0f );
+  for ( i = 0; i < 16; i++ ) {
+    float r = colorBlock[i*4+0] - mean[0];
+    float g = colorBlock[i*4+1] - mean[1];
+    float b = colorBlock[i*4+2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+
+  // power iteration, starting from the luminance direction
+  axis[0] = 1.0f; axis[1] = 2.0f; axis[2] = 1.0f;
+  for ( int iter = 0; iter < 4; iter++ ) {
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    float m = fabsf( x ) > fabsf( y ) ? fabsf( x ) : fabsf( y );
+    if ( fabsf( z ) > m ) m = fabsf( z );
+    if ( m == 0.0f ) break;
+    axis[0] = x / m; axis[1] = y / m; axis[2] = z / m;
+  }
+
+  float minProj = 1e30f, maxProj = -1e30f;
+  int imin = 0, imax = 0;
+  for ( i = 0; i < 16; i++ ) {
+    float p = colorBlock[i*4+0] * axis[0] + colorBlock[i*4+1] * axis[1] + colorBlock[i*4+2] * axis[2];
+    if ( p < minProj ) { minProj = p; imin = i; }
+    if ( p > maxProj ) { maxProj = p; imax = i; }
+  }
+  c0 = ColorTo565( colorBlock + imax*4 );
+  c1 = ColorTo565( colorBlock + imin*4 );
+}
+
+// Least squares end points for the given indices. Returns false if the
+// indices do not determine them (all pixels on one palette entry).
+static bool RefineColors( const byte *colorBlock, dword indices, word &c0, word &c1 )
+{
+  static const float weight[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+  float aa = 0, ab = 0, bb = 0;
+  float ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+
+  for ( int i = 0; i < 16; i++ ) {
+    float a = weight[( indices >> ( i << 1 ) ) & 3];
+    float b = 1.0f - a;
+    aa += a * a; ab += a * b; bb += b * b;
+    for ( int k = 0; k < 3; k++ ) {
+      ax[k] += a * colorBlock[i*4+k];
+      bx[k] += b * colorBlock[i*4+k];
+    }
+  }
+  float det = aa * bb - ab * ab;
+  if ( fabsf( det ) < 1e-6f )
+    return false;
+
+  float col0[3], col1[3];
+  for ( int k = 0; k < 3; k++ ) {
+    col0[k] = ( ax[k] * bb - bx[k] * ab ) / det;
+    col1[k] = ( bx[k] * aa - ax[k] * ab ) / det;
+  }
+  c0 = FloatTo565( col0 );
+  c1 = FloatTo565( col1 );
+  return true;
+}
+
+// Emit a 4-colour mode block. Needs c0 > c1: swap the end points
+// (indices 0<->1, 2<->3); equal end points decode as 3-colour mode, where
+// only index 0 gives the end point colour.
+static void EmitColorBlock565( word c0, word c1, dword indices, byte *&outData )
+{
+  if ( c0 < c1 ) {
+    word tmp = c0; c0 = c1; c1 = tmp;
+    indices ^= 0x55555555;
+  }
+  else if ( c0 == c1 ) {
+    indices = 0;
+  }
+  EmitWord( c0, outData );
+  EmitWord( c1, outData );
+  EmitDoubleWord( indices, outData );
+}
+
+//
+// Normal quality DXT1 block: exact indices for the bounding box and for the
+// luminance end points, keeping the pair with the lower error. The bounding
+// box candidate makes the error no larger than that of the fast tier.
+//
+void EmitColorBlockNormal( const byte *colorBlock, byte *&outData )
+{
+  ALIGN16( byte minColor[4] );
+  ALIGN16( byte maxColor[4] );
+  word c0, c1, t0, t1;
+  dword indices, t;
+
+  GetMinMaxColorsByBBox( colorBlock, minColor, maxColor );
+  c0 = ColorTo565( maxColor );
+  c1 = ColorTo565( minColor );
+  int error = ColorIndicesHQ( colorBlock, c0, c1, indices );
+  if ( error > 0 ) {
+    GetMinMaxColorsByLuminance( colorBlock, minColor, maxColor );
+    t0 = ColorTo565( maxColor );
+    t1 = ColorTo565( minColor );
+    if ( t0 != t1 && ColorIndicesHQ( colorBlock, t0, t1, t ) < error ) {
+      c0 = t0; c1 = t1; indices = t;
+    }
+  }
+  EmitColorBlock565( c0, c1, indices, outData );
+}
+
+void EmitColorBlockHQ( const byte *colorBlock, byte *&outData )
+{
+  word c0, c1, t0, t1;
+  dword indices, t;
+
+  PrincipalAxisColors( colorBlock, c0, c1 );
+  int error = ColorIndicesHQ( colorBlock, c0, c1, indices );
+  for ( int iter = 0; iter < 2 && error > 0; iter++ ) {
+    if ( !RefineColors( colorBlock, indices, t0, t1 ) )
+      break;
+    int e = ColorIndicesHQ( colorBlock, t0, t1, t );
+    if ( e >= error )
+      break;
+    error = e; c0 = t0; c1 = t1; indices = t;
+  }
+  EmitColorBlock565( c0, c1, indices, outData );
+}
+
+
 //
 // Emit indices for DXT5
 //
@@ -22,6 +22,9 @@
  *
  *****************************************************************************/
 
+#ifndef DXT_H
+#define DXT_H
+
 // From:
 //    Real-Time DXT Compression
 //    May 20th 2006 J.M.P. van Waveren
@@ -50,13 +53,50 @@ typedef unsigned int dword;
 
 #if defined(__GNUC__)
 #define   ALIGN16(_x)   _x __attribute((aligned(16)))
+#define   ALIGN32(_x)   _x __attribute((aligned(32)))
 #else
 #define   ALIGN16( x ) __declspec(align(16)) x
+#define   ALIGN32( x ) __declspec(align(32)) x
+#endif
+
+// SSE2/AVX2 code paths are only built for x86 targets. GCC and Clang need
+// functions using AVX2 intrinsics to be marked, MSVC accepts them anywhere.
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define   DXT_X86 1
 #endif
+#if defined(__GNUC__)
+#define   DXT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define   DXT_TARGET_AVX2
+#endif
+
+// Code paths of the compressors, selected at run time
+#define DXT_PATH_AUTO   -1
+#define DXT_PATH_SCALAR  0
+#define DXT_PATH_SSE2    1
+#define DXT_PATH_AVX2    2
+
+// Best path supported by the CPU and OS
+int GetDXTPathSupported();
+
+// Path currently used by the compressors
+int GetDXTPath();
+
+// Select a path (DXT_PATH_AUTO: best supported). Paths not supported by
+// the CPU fall back to the best supported one. Not thread-safe with
+// respect to running compressions.
+void SetDXTPath( int path );
+
+
+// Quality tiers of the DXT1 compressor
+#define DXT_QUALITY_FAST    0  // bounding box end points, approximate indices (SIMD paths)
+#define DXT_QUALITY_NORMAL  1  // best of bounding box and luminance end points, exact indices
+#define DXT_QUALITY_HIGH    2  // principal axis end points, refined by least squares fits
 
 
 // Compress to DXT1 format
-void CompressImageDXT1( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes );
+void CompressImageDXT1( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes,
+			int quality = DXT_QUALITY_FAST );
 
 // Compress to DXT5 format
 void CompressImageDXT5( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes );
@@ -66,3 +106,5 @@ void CompressImageDXT5YCoCg( const byte *inBuf, byte *outBuf, int width, int hei
 
 // Compute error between two images
 double ComputeError( const byte *original, const byte *dxt, int width, int height);
+
+#endif // !DXT_H
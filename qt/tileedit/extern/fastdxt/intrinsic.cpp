@@ -38,26 +38,35 @@
 
 #include "dxt.h"
 
+#if defined(DXT_X86)
+
 #include <emmintrin.h>  // sse2
+#include <immintrin.h>  // avx2
+
+// from dxt.cpp
+word ColorTo565( const byte *color );
+void EmitWord( word s, byte*& );
+void EmitDoubleWord( dword i, byte*& );
 
 
 void ExtractBlock_Intrinsics( const byte *inPtr, int width, byte *colorBlock ) 
 {
         __m128i t0, t1, t2, t3;
-	register int w = width << 2;  // width*4
+	int w = width << 2;  // width*4
 
-        t0 = _mm_load_si128 ( (__m128i*) inPtr );
+        // the source rows need not be 16-byte aligned
+        t0 = _mm_loadu_si128 ( (__m128i*) inPtr );
         _mm_store_si128 ( (__m128i*) &colorBlock[0], t0 );   // copy first row, 16bytes
 
-        t1 = _mm_load_si128 ( (__m128i*) (inPtr + w) );
+        t1 = _mm_loadu_si128 ( (__m128i*) (inPtr + w) );
         _mm_store_si128 ( (__m128i*) &colorBlock[16], t1 );   // copy second row
 
-        t2 = _mm_load_si128 ( (__m128i*) (inPtr + 2*w) );
+        t2 = _mm_loadu_si128 ( (__m128i*) (inPtr + 2*w) );
         _mm_store_si128 ( (__m128i*) &colorBlock[32], t2 );   // copy third row
 
 	inPtr = inPtr + w;     // add width, intead of *3
 
-        t3 = _mm_load_si128 ( (__m128i*) (inPtr + 2*w) );
+        t3 = _mm_loadu_si128 ( (__m128i*) (inPtr + 2*w) );
         _mm_store_si128 ( (__m128i*) &colorBlock[48], t3 );   // copy last row
 }
 
@@ -134,8 +143,11 @@ void GetMinMaxColors_Intrinsics( const byte *colorBlock, byte *minColor, byte *m
     
     // store bounding box extents
     // --------------------------
-    _mm_store_si128 ( (__m128i*) minColor, t0 );
-    _mm_store_si128 ( (__m128i*) maxColor, t1 );
+    // (4 bytes each: minColor and maxColor are byte[4] in the callers)
+    int mn = _mm_cvtsi128_si32 ( t0 );
+    int mx = _mm_cvtsi128_si32 ( t1 );
+    memcpy(minColor, &mn, 4);
+    memcpy(maxColor, &mx, 4);
 }
 
 
@@ -376,6 +388,27 @@ void EmitColorIndices_Intrinsics( const byte *colorBlock, const byte *minColor,
 }
 
 
+void CompressImageDXT1_SSE2( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes )
+{
+  ALIGN16( byte *outData );
+  ALIGN16( byte block[64] );
+  ALIGN16( byte minColor[4] );
+  ALIGN16( byte maxColor[4] );
+
+  outData = outBuf;
+  for ( int j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
+    for ( int i = 0; i < width; i += 4 ) {
+      ExtractBlock_Intrinsics( inBuf + i * 4, width, block );
+      GetMinMaxColors_Intrinsics( block, minColor, maxColor );
+      EmitWord( ColorTo565( maxColor ), outData );
+      EmitWord( ColorTo565( minColor ), outData );
+      EmitColorIndices_Intrinsics( block, minColor, maxColor, outData );
+    }
+  }
+  outputBytes = (int) ( outData - outBuf );
+}
+
+
 
 ALIGN16( static byte SIMD_SSE2_byte_1[16] ) = { 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 };
 ALIGN16( static byte SIMD_SSE2_byte_2[16] ) = { 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02 };
@@ -519,3 +552,161 @@ void EmitAlphaIndices_Intrinsics( const byte *colorBlock, const byte minAlpha, c
   outData += 6;
 */
 }
+
+
+/*
+	AVX2 version of the DXT1 compressor. Two horizontally adjacent blocks
+	are processed at once, one in each 128-bit lane: a 32-byte load of a
+	pixel row holds that row of both blocks. All operations used work
+	within lanes, so each lane performs exactly the SSE2 computation for
+	its block, and the output is identical.
+*/
+
+DXT_TARGET_AVX2
+static inline __m256i Dup_AVX2( __m128i a )
+{
+  return _mm256_inserti128_si256( _mm256_castsi128_si256( a ), a, 1 );
+}
+
+DXT_TARGET_AVX2
+static inline __m256i To565_AVX2( __m256i color, __m256i mask )
+{
+  // colour (bytes 0-3 of each lane, zero above byte 7) reduced to 5:6:5
+  // precision and unpacked to words, low bits replicated
+  __m256i t = _mm256_unpacklo_epi8( _mm256_and_si256( color, mask ), _mm256_setzero_si256() );
+  __m256i t4 = _mm256_srli_epi16( _mm256_shufflelo_epi16( t, R_SHUFFLE_D( 0, 3, 2, 3 ) ), 5 );
+  __m256i t5 = _mm256_srli_epi16( _mm256_shufflelo_epi16( t, R_SHUFFLE_D( 3, 1, 3, 3 ) ), 6 );
+  return _mm256_or_si256( _mm256_or_si256( t, t4 ), t5 );
+}
+
+DXT_TARGET_AVX2
+static inline __m256i Distances_AVX2( __m256i r0, __m256i r1, __m256i c )
+{
+  // sums of absolute differences to colour c of the 8 pixels of rows r0, r1
+  // (pixel pairs spread to 64-bit halves), as words
+  __m256i zero = _mm256_setzero_si256();
+  __m256i d0 = _mm256_packs_epi32( _mm256_sad_epu8( _mm256_unpacklo_epi32( r0, zero ), c ),
+                                   _mm256_sad_epu8( _mm256_unpackhi_epi32( r0, zero ), c ) );
+  __m256i d1 = _mm256_packs_epi32( _mm256_sad_epu8( _mm256_unpacklo_epi32( r1, zero ), c ),
+                                   _mm256_sad_epu8( _mm256_unpackhi_epi32( r1, zero ), c ) );
+  return _mm256_packs_epi32( d0, d1 );
+}
+
+DXT_TARGET_AVX2
+static inline __m256i ColorIndices_AVX2( __m256i r0, __m256i r1, __m256i c0, __m256i c1, __m256i c2, __m256i c3 )
+{
+  // 2-bit colour indices of the 8 pixels of rows r0, r1 as words, in the
+  // interleaved order of the SSE2 version
+  __m256i d0 = Distances_AVX2( r0, r1, c0 );
+  __m256i d1 = Distances_AVX2( r0, r1, c1 );
+  __m256i d2 = Distances_AVX2( r0, r1, c2 );
+  __m256i d3 = Distances_AVX2( r0, r1, c3 );
+
+  __m256i b0 = _mm256_cmpgt_epi16( d0, d3 );
+  __m256i b1 = _mm256_cmpgt_epi16( d1, d2 );
+  __m256i b2 = _mm256_cmpgt_epi16( d0, d2 );
+  __m256i b3 = _mm256_cmpgt_epi16( d1, d3 );
+  __m256i b4 = _mm256_cmpgt_epi16( d2, d3 );
+
+  __m256i x0 = _mm256_and_si256( b2, b1 );
+  __m256i x1 = _mm256_and_si256( b3, b0 );
+  __m256i x2 = _mm256_and_si256( b4, b0 );
+  return _mm256_or_si256( _mm256_and_si256( x2, _mm256_set1_epi16( 1 ) ),
+                          _mm256_and_si256( _mm256_or_si256( x0, x1 ), _mm256_set1_epi16( 2 ) ) );
+}
+
+DXT_TARGET_AVX2
+static inline void CompressBlocks_AVX2( const byte *inPtr, int width, byte *&outData )
+{
+  __m256i zero = _mm256_setzero_si256();
+  int w = width << 2;
+
+  // rows of the two blocks
+  __m256i r0 = _mm256_loadu_si256( (__m256i*) inPtr );
+  __m256i r1 = _mm256_loadu_si256( (__m256i*) (inPtr + w) );
+  __m256i r2 = _mm256_loadu_si256( (__m256i*) (inPtr + 2*w) );
+  __m256i r3 = _mm256_loadu_si256( (__m256i*) (inPtr + 3*w) );
+
+  // get bounding box
+  __m256i t0 = _mm256_min_epu8( _mm256_min_epu8( r0, r1 ), _mm256_min_epu8( r2, r3 ) );
+  __m256i t1 = _mm256_max_epu8( _mm256_max_epu8( r0, r1 ), _mm256_max_epu8( r2, r3 ) );
+  t0 = _mm256_min_epu8( t0, _mm256_shuffle_epi32( t0, R_SHUFFLE_D( 2, 3, 2, 3 ) ) );
+  t1 = _mm256_max_epu8( t1, _mm256_shuffle_epi32( t1, R_SHUFFLE_D( 2, 3, 2, 3 ) ) );
+  t0 = _mm256_min_epu8( t0, _mm256_shufflelo_epi16( t0, R_SHUFFLE_D( 2, 3, 2, 3 ) ) );
+  t1 = _mm256_max_epu8( t1, _mm256_shufflelo_epi16( t1, R_SHUFFLE_D( 2, 3, 2, 3 ) ) );
+
+  // inset the bounding box
+  t0 = _mm256_unpacklo_epi8( t0, zero );
+  t1 = _mm256_unpacklo_epi8( t1, zero );
+  __m256i t2 = _mm256_srli_epi16( _mm256_sub_epi16( t1, t0 ), INSET_SHIFT );
+  __m256i minColor = _mm256_packus_epi16( _mm256_add_epi16( t0, t2 ), zero );
+  __m256i maxColor = _mm256_packus_epi16( _mm256_sub_epi16( t1, t2 ), zero );
+
+  // palette
+  __m256i mask = Dup_AVX2( _mm_load_si128( (__m128i*) SIMD_SSE2_byte_colorMask ) );
+  __m256i div3 = Dup_AVX2( _mm_load_si128( (__m128i*) SIMD_SSE2_word_div_by_3 ) );
+  t0 = To565_AVX2( maxColor, mask );
+  t1 = To565_AVX2( minColor, mask );
+  __m256i c0 = _mm256_shuffle_epi32( _mm256_packus_epi16( t0, zero ), R_SHUFFLE_D( 0, 1, 0, 1 ) );
+  __m256i c1 = _mm256_shuffle_epi32( _mm256_packus_epi16( t1, zero ), R_SHUFFLE_D( 0, 1, 0, 1 ) );
+  t2 = _mm256_mulhi_epi16( _mm256_add_epi16( _mm256_add_epi16( t0, t0 ), t1 ), div3 );
+  __m256i c2 = _mm256_shuffle_epi32( _mm256_packus_epi16( t2, zero ), R_SHUFFLE_D( 0, 1, 0, 1 ) );
+  __m256i t3 = _mm256_mulhi_epi16( _mm256_add_epi16( _mm256_add_epi16( t1, t1 ), t0 ), div3 );
+  __m256i c3 = _mm256_shuffle_epi32( _mm256_packus_epi16( t3, zero ), R_SHUFFLE_D( 0, 1, 0, 1 ) );
+
+  // colour indices: rows 2-3 first, as in the SSE2 version
+  __m256i result = zero;
+  for ( int k = 0; k < 2; k++ ) {
+    __m256i idx = (k == 0 ? ColorIndices_AVX2( r2, r3, c0, c1, c2, c3 ) : ColorIndices_AVX2( r0, r1, c0, c1, c2, c3 ));
+    __m256i hi = _mm256_shuffle_epi32( idx, R_SHUFFLE_D( 2, 3, 0, 1 ) );
+    idx = _mm256_unpacklo_epi16( idx, zero );
+    hi = _mm256_slli_epi32( _mm256_unpacklo_epi16( hi, zero ), 8 );
+    result = _mm256_or_si256( _mm256_or_si256( _mm256_slli_epi32( result, 16 ), hi ), idx );
+  }
+  __m256i s1 = _mm256_slli_epi32( _mm256_shuffle_epi32( result, R_SHUFFLE_D( 1, 2, 3, 0 ) ), 2 );
+  __m256i s2 = _mm256_slli_epi32( _mm256_shuffle_epi32( result, R_SHUFFLE_D( 2, 3, 0, 1 ) ), 4 );
+  __m256i s3 = _mm256_slli_epi32( _mm256_shuffle_epi32( result, R_SHUFFLE_D( 3, 0, 1, 2 ) ), 6 );
+  result = _mm256_or_si256( _mm256_or_si256( result, s1 ), _mm256_or_si256( s2, s3 ) );
+
+  // emit both blocks
+  ALIGN32( byte colors[64] );
+  _mm256_store_si256( (__m256i*) colors, minColor );
+  _mm256_store_si256( (__m256i*) (colors + 32), maxColor );
+  dword indices[2] = {
+    (dword) _mm_cvtsi128_si32( _mm256_castsi256_si128( result ) ),
+    (dword) _mm_cvtsi128_si32( _mm256_extracti128_si256( result, 1 ) )
+  };
+  for ( int k = 0; k < 2; k++ ) {
+    EmitWord( ColorTo565( colors + 32 + 16*k ), outData );
+    EmitWord( ColorTo565( colors + 16*k ), outData );
+    EmitDoubleWord( indices[k], outData );
+  }
+}
+
+DXT_TARGET_AVX2
+void CompressImageDXT1_AVX2( const byte *inBuf, byte *outBuf, int width, int height, int &outputBytes )
+{
+  ALIGN16( byte block[64] );
+  ALIGN16( byte minColor[4] );
+  ALIGN16( byte maxColor[4] );
+  byte *outData = outBuf;
+  int i, j;
+
+  for ( j = 0; j < height; j += 4, inBuf += width * 4*4 ) {
+    for ( i = 0; i + 8 <= width; i += 8 )
+      CompressBlocks_AVX2( inBuf + i * 4, width, outData );
+    if ( i < width ) {
+      // odd block at the end of the row: SSE2 version
+      _mm256_zeroupper();
+      ExtractBlock_Intrinsics( inBuf + i * 4, width, block );
+      GetMinMaxColors_Intrinsics( block, minColor, maxColor );
+      EmitWord( ColorTo565( maxColor ), outData );
+      EmitWord( ColorTo565( minColor ), outData );
+      EmitColorIndices_Intrinsics( block, minColor, maxColor, outData );
+    }
+  }
+  _mm256_zeroupper();
+  outputBytes = (int) ( outData - outBuf );
+}
+
+#endif // DXT_X86
@@ -24,6 +24,10 @@
 
 #include "libdxt.h"
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #if defined(__APPLE__)
 #define memalign(x,y) malloc((y))
 #else
@@ -31,8 +35,10 @@
 #endif
 
 typedef struct _work_t {
+	void *(*func)(void*);
 	int width, height;
 	int nbb;
+	int quality;
 	byte *in, *out;
 } work_t;
 
@@ -42,7 +48,7 @@ void *slave1(void *arg)
 {
 	work_t *param = (work_t*) arg;
 	int nbbytes = 0;
-	CompressImageDXT1( param->in, param->out, param->width, param->height, nbbytes);
+	CompressImageDXT1( param->in, param->out, param->width, param->height, nbbytes, param->quality);
 	param->nbb = nbbytes;
 	return NULL;
 }
@@ -65,31 +71,130 @@ void *slave5ycocg(void *arg)
 	return NULL;
 }
 
-int CompressDXT(const byte *in, byte *out, int width, int height, int format)
+typedef void *(*slave_t)(void*);
+
+static slave_t slave(int format)
+{
+  switch (format) {
+      case FORMAT_DXT1:      return slave1;
+      case FORMAT_DXT5:      return slave5;
+      case FORMAT_DXT5YCOCG: return slave5ycocg;
+  }
+  return NULL;
+}
+
+static int numThreads(int numthreads, int njobs)
+{
+  if (numthreads <= 0)
+    numthreads = (int)std::thread::hardware_concurrency();
+  if (numthreads > njobs)
+    numthreads = njobs;
+  return (numthreads > 0 ? numthreads : 1);
+}
+
+static DXTParallelFor dxtParallelFor = NULL;
+
+void SetDXTParallelFor(DXTParallelFor pf)
+{
+  dxtParallelFor = pf;
+}
+
+static void runJob(void *arg, int i)
+{
+  work_t *job = (work_t*)arg;
+  job[i].func(&job[i]);
+}
+
+// Run all jobs, on the application's pool if set, otherwise on up to
+// numthreads threads started for this call. Threads pick the next job
+// from a shared counter.
+static void runJobs(std::vector<work_t> &job, int numthreads)
+{
+  int n = (int)job.size();
+  if (dxtParallelFor) {
+    dxtParallelFor(n, numthreads, runJob, job.data());
+    return;
+  }
+  std::atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i = next++; i < n; i = next++)
+      runJob(job.data(), i);
+  };
+  int nthreads = numThreads(numthreads, n);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < nthreads; i++)
+    threads.push_back(std::thread(worker));
+  worker();
+
+  // Join all the threads
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+// Minimum number of block rows per band. Below this handing the band to
+// another thread costs more than the band takes to compress.
+#define MIN_BAND_ROWS 16
+
+int CompressDXT(const byte *in, byte *out, int width, int height, int format, int numthreads, int quality)
 { 
   int        nbbytes;
+  slave_t func = slave(format);
 
-  work_t job;
+  if (!func)
+    return 0;
 
-  job.width = width;
-  job.height = height;
-  job.nbb = 0;
-  job.in =  (byte*)in;
-  job.out = out;
-  
-  switch (format) {
-      case FORMAT_DXT1:
-          slave1(&job);
-          break;
-      case FORMAT_DXT5:
-          slave5(&job);
-          break;
-      case FORMAT_DXT5YCOCG:
-          slave5ycocg(&job);
-          break;
+  // Each block row of 4 pixel rows compresses independently into a fixed
+  // number of bytes, so bands can be assigned to threads in any split.
+  int blockbytes = (format == FORMAT_DXT1 ? 8 : 16);
+  int nrows = height / 4;
+  int nbands = numThreads(numthreads, nrows / MIN_BAND_ROWS);
+
+  std::vector<work_t> job(nbands);
+  int row0 = 0;
+  for (int i = 0; i < nbands; i++) {
+    int row1 = nrows * (i + 1) / nbands;
+    job[i].func = func;
+    job[i].width = width;
+    job[i].height = (row1 - row0) * 4;
+    job[i].nbb = 0;
+    job[i].quality = quality;
+    job[i].in = (byte*)in + (size_t)row0 * 4 * width * 4;
+    job[i].out = out + (size_t)row0 * (width / 4) * blockbytes;
+    row0 = row1;
   }
+  runJobs(job, numthreads);
 
-  // Join all the threads
-  nbbytes = job.nbb;
+  nbbytes = 0;
+  for (int i = 0; i < nbands; i++)
+    nbbytes += job[i].nbb;
   return nbbytes;
 }
+
+int CompressDXTBatch(int count, const byte *const *in, byte *const *out, int width, int height, int format,
+                     int *nbytes, int numthreads, int quality)
+{
+  slave_t func = slave(format);
+
+  if (!func || count <= 0)
+    return 0;
+
+  std::vector<work_t> job(count);
+  for (int i = 0; i < count; i++) {
+    job[i].func = func;
+    job[i].width = width;
+    job[i].height = height;
+    job[i].nbb = 0;
+    job[i].quality = quality;
+    job[i].in = (byte*)in[i];
+    job[i].out = out[i];
+  }
+  runJobs(job, numthreads);
+
+  int total = 0;
+  for (int i = 0; i < count; i++) {
+    if (nbytes)
+      nbytes[i] = job[i].nbb;
+    total += job[i].nbb;
+  }
+  return total;
+}
@@ -22,6 +22,9 @@
  *
  *****************************************************************************/
 
+#ifndef LIBDXT_H
+#define LIBDXT_H
+
 #include "dxt.h"
 #include "util.h"
 
@@ -29,6 +32,30 @@
 #define FORMAT_DXT5      2
 #define FORMAT_DXT5YCOCG 3
 
+// Runs func(arg, i) for i = 0 ... n-1 on up to numthreads threads (0: the
+// default of the thread pool) and returns when all calls are done. The
+// calling thread may run some of the calls itself.
+typedef void (*DXTParallelFor)(int n, int numthreads, void (*func)(void *arg, int i), void *arg);
+
+// Hand the bands and batch images of the compressors to an application's
+// thread pool instead of starting threads per call (NULL: start threads).
+// Not thread-safe with respect to running compressions.
+void SetDXTParallelFor(DXTParallelFor pf);
+
+// Compress a width x height RGBA image. The image is split into horizontal
+// bands of 4-pixel block rows which are compressed concurrently by
+// numthreads threads (0: one per hardware thread). The output does not
+// depend on the number of threads. Returns the number of bytes written.
+// quality selects the DXT1 compressor tier (DXT_QUALITY_*); it is ignored
+// for the DXT5 formats.
+int CompressDXT(const byte *in, byte *out, int width, int height, int format, int numthreads = 0,
+                int quality = DXT_QUALITY_FAST);
 
-int CompressDXT(const byte *in, byte *out, int width, int height, int format);
+// Compress count images of identical size, distributing whole images over
+// numthreads threads (0: one per hardware thread). The compressed size of
+// image i is returned in nbytes[i] (if not NULL). Returns the total number
+// of bytes written.
+int CompressDXTBatch(int count, const byte *const *in, byte *const *out, int width, int height, int format,
+                     int *nbytes = NULL, int numthreads = 0, int quality = DXT_QUALITY_FAST);
 
+#endif // !LIBDXT_H
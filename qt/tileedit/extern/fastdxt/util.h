@@ -22,6 +22,9 @@
  *
  *****************************************************************************/
 
+#ifndef DXT_UTIL_H
+#define DXT_UTIL_H
+
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -106,3 +109,5 @@ public:
 };
 
 #endif
+
+#endif // !DXT_UTIL_H
@@ -1,5 +1,9 @@
 #include "ZTreeMgr.h"
+#include "nodecache.h"
+#include "fastinflate.h"
 #include "zlib.h"
+#include <vector>
+#include <algorithm>
 
 // =======================================================================
 // File header for compressed tree files
@@ -8,7 +12,7 @@ TreeFileHeader::TreeFileHeader ()
 {
 	magic[0] = 'T';
 	magic[1] = 'X';
-	magic[2] = 1;
+	magic[2] = TREEFILE_VERSION;
 	magic[3] = 0;
 	size = sizeof(TreeFileHeader);
 	flags = 0;
@@ -30,9 +34,11 @@ size_t TreeFileHeader::fwrite(FILE *f)
 bool TreeFileHeader::fread(FILE *f)
 {
 	BYTE buf[4];
-	DWORD sz, flags;
-	if (::fread(buf, 1, 4, f) < 4 || memcmp(buf, magic, 4))
+	DWORD sz;
+	if (::fread(buf, 1, 4, f) < 4 || buf[0] != magic[0] || buf[1] != magic[1] || buf[3] != magic[3] ||
+		(buf[2] != TREEFILE_VERSION && buf[2] != TREEFILE_VERSION_APPEND))
 		return false;
+	magic[2] = buf[2];
 	if (::fread(&sz, sizeof(DWORD), 1, f) != 1 || sz != size)
 		return false;
 	::fread(&flags, sizeof(DWORD), 1, f);
@@ -54,6 +60,7 @@ TreeTOC::TreeTOC()
 	ntree = 0;
 	ntreebuf = 0;
 	tree = NULL;
+	zsize = NULL;
 	totlength = 0;
 }
 
@@ -61,8 +68,10 @@ TreeTOC::TreeTOC()
 
 TreeTOC::~TreeTOC()
 {
-	if (ntreebuf)
+	if (ntreebuf) {
 		delete []tree;
+		delete []zsize;
+	}
 }
 
 // -----------------------------------------------------------------------
@@ -71,19 +80,56 @@ size_t TreeTOC::fread(DWORD size, FILE *f)
 {
 	if (ntreebuf != size) {
 		TreeNode *tmp = new TreeNode[size];
-		if (ntreebuf) delete []tree;
+		DWORD *ztmp = new DWORD[size];
+		if (ntreebuf) {
+			delete []tree;
+			delete []zsize;
+		}
 		tree = tmp;
+		zsize = ztmp;
 		ntree = ntreebuf = size;
 	}
 	return ::fread(tree, sizeof(TreeNode), size, f);
 }
 
+// -----------------------------------------------------------------------
+
+size_t TreeTOC::freadSizes(FILE *f)
+{
+	return ::fread(zsize, sizeof(DWORD), ntree, f);
+}
+
+// -----------------------------------------------------------------------
+
+void TreeTOC::ComputeSizes()
+{
+	// Node data are not necessarily stored in TOC order, so each node extends
+	// to the start of the next node by file position. Nodes without data
+	// don't occupy any space.
+	std::vector<DWORD> order;
+	order.reserve(ntree);
+	for (DWORD i = 0; i < ntree; i++) {
+		if (tree[i].size) order.push_back(i);
+		else zsize[i] = 0;
+	}
+	std::sort(order.begin(), order.end(), [this](DWORD a, DWORD b) { return tree[a].pos < tree[b].pos; });
+	for (size_t k = 0; k < order.size(); k++) {
+		__int64 next = (k + 1 < order.size() ? tree[order[k+1]].pos : totlength);
+		zsize[order[k]] = (DWORD)(next - tree[order[k]].pos);
+	}
+}
+
 // =======================================================================
 // ZTreeMgr class: manage a single layer tree for a planet
 
-ZTreeMgr *ZTreeMgr::CreateFromFile(const char *PlanetPath, Layer _layer)
+NodeCache *ZTreeMgr::s_nodeCache = 0;
+ZTreeMgr::InflateMethod ZTreeMgr::s_inflateMethod = ZTreeMgr::INFLATE_FAST;
+
+// -----------------------------------------------------------------------
+
+ZTreeMgr *ZTreeMgr::CreateFromFile(const char *PlanetPath, Layer _layer, ReadMode _mode)
 {
-	ZTreeMgr *mgr = new ZTreeMgr(PlanetPath, _layer);
+	ZTreeMgr *mgr = new ZTreeMgr(PlanetPath, _layer, _mode);
 	if (!mgr->TOC().size()) {
 		delete mgr;
 		mgr = 0;
@@ -93,12 +139,16 @@ ZTreeMgr *ZTreeMgr::CreateFromFile(const char *PlanetPath, Layer _layer)
 
 // -----------------------------------------------------------------------
 
-ZTreeMgr::ZTreeMgr(const char *PlanetPath, Layer _layer)
+ZTreeMgr::ZTreeMgr(const char *PlanetPath, Layer _layer, ReadMode _mode)
 {
 	path = new char[strlen(PlanetPath)+1];
 	strcpy(path, PlanetPath);
 	layer = _layer;
-	treef = 0;
+	mode = _mode;
+	hFile = INVALID_HANDLE_VALUE;
+	hMapObj = NULL;
+	mapv = 0;
+	fsize = 0;
 	OpenArchive();
 }
 
@@ -107,23 +157,29 @@ ZTreeMgr::ZTreeMgr(const char *PlanetPath, Layer _layer)
 ZTreeMgr::~ZTreeMgr()
 {
 	delete []path;
-	if (treef) fclose(treef);
+	CloseArchive();
+}
+
+// -----------------------------------------------------------------------
+
+const char *ZTreeMgr::LayerName(Layer _layer)
+{
+	static const char *name[6] = { "Surf", "Mask", "Elev", "Elev_mod", "Label", "Cloud" };
+	return name[_layer];
 }
 
 // -----------------------------------------------------------------------
 
 bool ZTreeMgr::OpenArchive()
 {
-	const char *name[6] = { "Surf", "Mask", "Elev", "Elev_mod", "Label", "Cloud" };
 	char fname[256];
-	sprintf (fname, "%s\\Archive\\%s.tree", path, name[layer]);
-	treef = fopen(fname, "rb");
+	sprintf (fname, "%s\\Archive\\%s.tree", path, LayerName(layer));
+	FILE *treef = fopen(fname, "rb");
 	if (!treef) return false;
 
 	TreeFileHeader tfh;
 	if (!tfh.fread(treef)) {
 		fclose(treef);
-		treef = 0;
 		return false;
 	}
 	rootPos1 = tfh.rootPos1;
@@ -133,56 +189,292 @@ bool ZTreeMgr::OpenArchive()
 		rootPos4[i] = tfh.rootPos4[i];
 	dofs = (__int64)tfh.dataOfs;
 
-	if (!toc.fread(tfh.nodeCount, treef)) {
+	// the TOC follows the header, unless nodes have been appended since the
+	// archive was built, in which case the latest TOC follows the data block
+	if (tfh.flags & TREEFLAG_TOCATEND)
+		_fseeki64(treef, dofs + tfh.dataLength, SEEK_SET);
+	if (toc.fread(tfh.nodeCount, treef) != tfh.nodeCount) {
 		fclose(treef);
-		treef = 0;
+		toc.ntree = 0;
 		return false;
 	}
 	toc.totlength = tfh.dataLength;
+	if (tfh.flags & TREEFLAG_NODESIZES) {
+		if (toc.freadSizes(treef) != tfh.nodeCount) {
+			fclose(treef);
+			toc.ntree = 0;
+			return false;
+		}
+	}
+	else
+		toc.ComputeSizes();
+	fclose(treef);
+	BuildIndex();
+
+	// node data are accessed through a separate OS handle, which allows
+	// concurrent positional reads without a shared file pointer
+	if (!OpenDataFile(fname)) {
+		toc.ntree = 0;
+		nodeKey.clear();
+		nodeIdx.clear();
+		levelOfs.clear();
+		return false;
+	}
+	if (mode == READMODE_MAPPED && !MapArchive())
+		mode = READMODE_FILE; // fall back to file reads
+
+	return true;
+}
+
+// -----------------------------------------------------------------------
+
+bool ZTreeMgr::OpenDataFile(const char *fname)
+{
+	// Writers may append to the archive while it is open: appended data never
+	// overwrite the nodes referenced by the TOC read at open time.
+	// The handle is opened for overlapped I/O: requests on a synchronous handle
+	// are serialised per file object, so concurrent readers would queue.
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS | FILE_FLAG_OVERLAPPED;
+	hFile = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, flags, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(hFile, &size) || size.QuadPart < dofs + toc.totlength) {
+		CloseArchive();
+		return false;
+	}
+	fsize = size.QuadPart;
+	return true;
+}
+
+// -----------------------------------------------------------------------
+
+bool ZTreeMgr::MapArchive()
+{
+	hMapObj = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!hMapObj)
+		return false;
 
+	// map the whole file once; the view is kept for the lifetime of the manager
+	mapv = (const BYTE*)MapViewOfFile(hMapObj, FILE_MAP_READ, 0, 0, 0);
+	if (!mapv) {
+		CloseHandle(hMapObj);
+		hMapObj = NULL;
+		return false;
+	}
 	return true;
 }
 
 // -----------------------------------------------------------------------
 
+void ZTreeMgr::CloseArchive()
+{
+	if (mapv) {
+		UnmapViewOfFile(mapv);
+		mapv = 0;
+	}
+	if (hMapObj) {
+		CloseHandle(hMapObj);
+		hMapObj = NULL;
+	}
+	if (hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(hFile);
+		hFile = INVALID_HANDLE_VALUE;
+	}
+	fsize = 0;
+}
+
+// -----------------------------------------------------------------------
+
+bool ZTreeMgr::ReadAt(__int64 ofs, BYTE *buf, DWORD size) const
+{
+	// Positional overlapped read: the offset is passed with each request, so
+	// no file pointer is shared between threads reading from the same archive,
+	// and each call waits for its own request on its own event.
+	HANDLE hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+	if (!hEvent)
+		return false;
+
+	bool ok = true;
+	while (size) {
+		OVERLAPPED ov;
+		memset(&ov, 0, sizeof(OVERLAPPED));
+		ov.Offset = (DWORD)(ofs & 0xFFFFFFFF);
+		ov.OffsetHigh = (DWORD)(ofs >> 32);
+		ov.hEvent = hEvent;
+		DWORD nread = 0;
+		if ((!ReadFile(hFile, buf, size, NULL, &ov) && GetLastError() != ERROR_IO_PENDING) ||
+			!GetOverlappedResult(hFile, &ov, &nread, TRUE) || !nread) {
+			ok = false;
+			break;
+		}
+		ofs += nread;
+		buf += nread;
+		size -= nread;
+	}
+	CloseHandle(hEvent);
+	return ok;
+}
+
+// -----------------------------------------------------------------------
+
+void ZTreeMgr::BuildIndex()
+{
+	// Walk the quadtree once from the level-4 roots and record the TOC
+	// index of every node, so that lookups don't need to descend the tree.
+	// The index is a sorted key array searched by bisection: 12 bytes per
+	// node, against several times that for a hash map on large TOCs.
+	struct NodeRef { DWORD idx; int lvl, ilat, ilng; };
+	std::vector<NodeRef> stack;
+	std::vector<std::pair<unsigned __int64, DWORD> > index;
+
+	index.reserve(toc.size());
+	for (int i = 0; i < 2; i++)
+		if (rootPos4[i] < toc.size())
+			stack.push_back({ rootPos4[i], 4, 0, i });
+
+	while (stack.size()) {
+		NodeRef node = stack.back();
+		stack.pop_back();
+		index.push_back(std::make_pair(NodeKey(node.lvl, node.ilat, node.ilng), node.idx));
+		if (node.lvl >= TREE_MAXLVL) continue; // also guards against corrupt TOCs
+		const TreeNode &tn = toc[node.idx];
+		for (int c = 0; c < 4; c++)
+			if (tn.child[c] < toc.size())
+				stack.push_back({ tn.child[c], node.lvl+1, node.ilat*2 + (c >> 1), node.ilng*2 + (c & 1) });
+	}
+
+	// a node reached twice (corrupt TOC) keeps its last index, as before
+	std::stable_sort(index.begin(), index.end(), [](const std::pair<unsigned __int64, DWORD> &a, const std::pair<unsigned __int64, DWORD> &b) { return a.first < b.first; });
+	nodeKey.clear();
+	nodeIdx.clear();
+	for (size_t i = 0; i < index.size(); i++) {
+		if (nodeKey.size() && nodeKey.back() == index[i].first)
+			nodeIdx.back() = index[i].second;
+		else {
+			nodeKey.push_back(index[i].first);
+			nodeIdx.push_back(index[i].second);
+		}
+	}
+	nodeKey.shrink_to_fit();
+	nodeIdx.shrink_to_fit();
+
+	// the keys sort by level first, so each level is a contiguous range
+	levelOfs.resize(TREE_MAXLVL + 2);
+	for (int lvl = 0; lvl <= TREE_MAXLVL + 1; lvl++)
+		levelOfs[lvl] = (DWORD)(std::lower_bound(nodeKey.begin(), nodeKey.end(), NodeKey(lvl, 0, 0)) - nodeKey.begin());
+}
+
+// -----------------------------------------------------------------------
+
 DWORD ZTreeMgr::Idx(int lvl, int ilat, int ilng) const
 {
 	if (lvl <= 4) {
 		return (lvl == 1 ? rootPos1 : lvl == 2 ? rootPos2 : lvl == 3 ? rootPos3 : rootPos4[ilng]);
 	} else {
-		int plvl = lvl-1;
-		int pilat = ilat/2;
-		int pilng = ilng/2;
-		DWORD pidx = Idx(plvl, pilat, pilng);
-		if (pidx == (DWORD)-1)
-			return pidx;
-		int cidx = ((ilat&1) << 1) + (ilng&1);
-		return toc[pidx].child[cidx];
+		// bisection within the level's range. The branch-free form (the
+		// comparison selects the next base) avoids a mispredicted branch per
+		// step, which dominates on random lookups.
+		if (lvl > TREE_MAXLVL || levelOfs.empty())
+			return (DWORD)-1;
+		unsigned __int64 key = NodeKey(lvl, ilat, ilng);
+		DWORD ofs = levelOfs[lvl];
+		size_t n = levelOfs[lvl + 1] - ofs;
+		if (!n)
+			return (DWORD)-1;
+		const unsigned __int64 *base = nodeKey.data() + ofs;
+		while (n > 1) {
+			size_t half = n / 2;
+			base = (base[half] <= key ? base + half : base);
+			n -= half;
+		}
+		return (*base == key ? nodeIdx[base - nodeKey.data()] : (DWORD)-1);
 	}
 }
 
 // -----------------------------------------------------------------------
 
+void ZTreeMgr::Idx(int lvl, const std::vector<std::pair<int, int> > &tiles, std::vector<DWORD> &idx) const
+{
+	idx.resize(tiles.size());
+	if (lvl <= 4 || lvl > TREE_MAXLVL || levelOfs.empty()) {
+		for (size_t i = 0; i < tiles.size(); i++)
+			idx[i] = Idx(lvl, tiles[i].first, tiles[i].second);
+		return;
+	}
+
+	// The tiles are resolved in key order. Each search starts where the
+	// previous one ended and brackets the key with steps of doubling size,
+	// so neighbouring tiles (e.g. those of a tile block) take a few steps.
+	std::vector<std::pair<unsigned __int64, size_t> > order(tiles.size());
+	for (size_t i = 0; i < tiles.size(); i++)
+		order[i] = std::make_pair(NodeKey(lvl, tiles[i].first, tiles[i].second), i);
+	std::sort(order.begin(), order.end());
+	size_t lo = levelOfs[lvl], end = levelOfs[lvl + 1];
+	for (auto &o : order) {
+		size_t hi = lo, step = 1;
+		while (hi < end && nodeKey[hi] < o.first) {
+			lo = hi + 1;
+			hi += step;
+			step *= 2;
+		}
+		if (hi > end) hi = end;
+		lo = std::lower_bound(nodeKey.begin() + lo, nodeKey.begin() + hi, o.first) - nodeKey.begin();
+		idx[o.second] = (lo < end && nodeKey[lo] == o.first ? nodeIdx[lo] : (DWORD)-1);
+	}
+}
+
+// -----------------------------------------------------------------------
+
+void ZTreeMgr::Nodes(std::vector<NodeRef> &nodes) const
+{
+	nodes.clear();
+	DWORD root[3] = { rootPos1, rootPos2, rootPos3 };
+	for (int i = 0; i < 3; i++)
+		if (root[i] < toc.size() && NodeSizeInflated(root[i]))
+			nodes.push_back({ i+1, 0, 0, root[i] });
+	const unsigned __int64 mask = ((unsigned __int64)1 << NODEKEY_BITS) - 1;
+	for (size_t i = 0; i < nodeKey.size(); i++) {
+		if (!NodeSizeInflated(nodeIdx[i])) continue;
+		int lvl = (int)(nodeKey[i] >> (2 * NODEKEY_BITS));
+		int ilat = (int)((nodeKey[i] >> NODEKEY_BITS) & mask);
+		int ilng = (int)(nodeKey[i] & mask);
+		nodes.push_back({ lvl, ilat, ilng, nodeIdx[i] });
+	}
+}
+
+// -----------------------------------------------------------------------
+
+DWORD ZTreeMgr::ReadDeflated(DWORD idx, BYTE *buf, DWORD bufsize) const
+{
+	if (idx >= toc.size() || !NodeSizeInflated(idx)) return 0;
+
+	__int64 ofs = toc[idx].pos + dofs;
+	DWORD zsize = NodeSizeDeflated(idx);
+	if (ofs < 0 || ofs + zsize > fsize || zsize > bufsize)
+		return 0;
+
+	if (mapv) {
+		memcpy(buf, mapv + ofs, zsize);
+		return zsize;
+	}
+	return (ReadAt(ofs, buf, zsize) ? zsize : 0);
+}
+
+// -----------------------------------------------------------------------
+
 DWORD ZTreeMgr::ReadData(DWORD idx, BYTE **outp) const
 {
+	*outp = 0;
 	if (idx == (DWORD)-1) return 0; // sanity check
 
 	DWORD esize = NodeSizeInflated(idx);
 	if (!esize) // node doesn't have data, but has descendants with data
 		return 0;
 
-	if (_fseeki64(treef, toc[idx].pos+dofs, SEEK_SET))
-		return 0;
-
-	DWORD zsize = NodeSizeDeflated(idx);
-	BYTE *zbuf = new BYTE[zsize];	
-	fread(zbuf, 1, zsize, treef);
-
 	BYTE *ebuf = new BYTE[esize];
-
-	DWORD ndata = Inflate(zbuf, zsize, ebuf, esize);
-	delete []zbuf;
-
+	DWORD ndata = ReadData(idx, ebuf, esize);
 	if (!ndata) {
 		delete []ebuf;
 		ebuf = 0;
@@ -193,8 +485,74 @@ DWORD ZTreeMgr::ReadData(DWORD idx, BYTE **outp) const
 
 // -----------------------------------------------------------------------
 
+DWORD ZTreeMgr::ReadData(DWORD idx, BYTE *buf, DWORD bufsize) const
+{
+	if (idx == (DWORD)-1) return 0; // sanity check
+
+	DWORD esize = NodeSizeInflated(idx);
+	if (!esize || esize > bufsize)
+		return 0;
+
+	__int64 ofs = toc[idx].pos + dofs;
+	DWORD zsize = NodeSizeDeflated(idx);
+	if (ofs < 0 || ofs + zsize > fsize)
+		return 0;
+
+	const BYTE *zdata;
+	if (mapv) { // inflate directly from the mapped view
+		zdata = mapv + ofs;
+	}
+	else {
+		// per-thread staging buffer for the compressed data, reused across reads
+		static thread_local std::vector<BYTE> zbuf;
+		if (zbuf.size() < zsize)
+			zbuf.resize(zsize);
+		if (!ReadAt(ofs, zbuf.data(), zsize))
+			return 0;
+		zdata = zbuf.data();
+	}
+	return Inflate(zdata, zsize, buf, esize);
+}
+
+// -----------------------------------------------------------------------
+
+DWORD ZTreeMgr::ReadData(int lvl, int ilat, int ilng, BYTE **outp) const
+{
+	DWORD ndata;
+	if (s_nodeCache && s_nodeCache->get(layer, lvl, ilat, ilng, outp, &ndata))
+		return ndata;
+
+	ndata = ReadData(Idx(lvl, ilat, ilng), outp);
+	if (ndata && s_nodeCache)
+		s_nodeCache->put(layer, lvl, ilat, ilng, *outp, ndata);
+	return ndata;
+}
+
+// -----------------------------------------------------------------------
+
+bool ZTreeMgr::Prefetch(int lvl, int ilat, int ilng) const
+{
+	if (!s_nodeCache)
+		return false;
+	if (s_nodeCache->contains(layer, lvl, ilat, ilng))
+		return true;
+
+	BYTE *buf;
+	DWORD ndata = ReadData(Idx(lvl, ilat, ilng), &buf);
+	if (!ndata)
+		return false;
+	s_nodeCache->put(layer, lvl, ilat, ilng, buf, ndata);
+	ReleaseData(buf);
+	return true;
+}
+
+// -----------------------------------------------------------------------
+
 DWORD ZTreeMgr::Inflate(const BYTE *inp, DWORD ninp, BYTE *outp, DWORD noutp) const
 {
+	if (s_inflateMethod == INFLATE_FAST)
+		return FastInflate(inp, ninp, outp, noutp);
+
 	DWORD ndata = noutp;
 	if (uncompress (outp, &ndata, inp, ninp) != Z_OK)
 		return 0;
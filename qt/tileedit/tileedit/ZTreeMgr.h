@@ -7,8 +7,11 @@
 #define __ZTREEMGR_H
 
 #include <iostream>
+#include <vector>
 #include <windows.h>
 
+class NodeCache;
+
 // =======================================================================
 // Tree node structure
 
@@ -27,13 +30,23 @@ struct TreeNode {
 // =======================================================================
 // File header for compressed tree files
 
+#define TREEFLAG_TOCATEND  0x1 // TOC is stored at dataOfs+dataLength instead of directly after the header
+#define TREEFLAG_NODESIZES 0x2 // TOC is followed by an array of nodeCount deflated node sizes (DWORD)
+
+// File format versions (third magic byte). Readers reject versions they
+// don't know, so layouts that older readers would misread get a new version.
+#define TREEFILE_VERSION        1 // TOC directly after the header
+#define TREEFILE_VERSION_APPEND 2 // TOC after the data block (TREEFLAG_TOCATEND), written by TreeWriter::Append
+
 class TreeFileHeader {
 	friend class ZTreeMgr;
+	friend class TreeWriter;
 
 public:
 	TreeFileHeader();
 	size_t TreeFileHeader::fwrite(FILE *f);
 	bool TreeFileHeader::fread(FILE *f);
+	BYTE version() const { return magic[2]; }
 
 private:
 	BYTE magic[4];      // file ID and version
@@ -48,6 +61,16 @@ private:
 	DWORD rootPos4[2];  // index of the level-4 tiles (quadtree roots; (DWORD)-1 for not present)
 };
 
+// =======================================================================
+// Quadtree node index limits. A node key packs the level and both tile
+// indices of a node; level lvl has 2^(lvl-4) x 2^(lvl-3) tiles.
+
+#define TREE_MAXLVL  24 // deepest quadtree level indexed (deeper nodes are ignored)
+#define NODEKEY_BITS 21 // bits per tile index field of a node key
+
+static_assert(TREE_MAXLVL - 3 <= NODEKEY_BITS, "tile indices of level TREE_MAXLVL must fit into a node key field");
+static_assert(2 * NODEKEY_BITS + 5 <= 64, "node key must fit into 64 bits");
+
 // =======================================================================
 // Tree table of contents
 
@@ -58,17 +81,25 @@ public:
 	TreeTOC();
 	~TreeTOC();
 	size_t fread(DWORD size, FILE *f);
+	size_t freadSizes(FILE *f);
+	// read the explicit deflated node sizes (TREEFLAG_NODESIZES)
+
+	void ComputeSizes();
+	// derive the deflated node sizes from the node positions, for archives
+	// without explicit sizes
+
 	inline DWORD size() const { return ntree; }
 	inline const TreeNode &operator[](int idx) const { return tree[idx]; }
 
 	inline DWORD NodeSizeDeflated(DWORD idx) const
-	{ return (DWORD)((idx < ntree-1 ? tree[idx+1].pos : totlength) - tree[idx].pos); }
+	{ return zsize[idx]; }
 
 	inline DWORD NodeSizeInflated(DWORD idx) const
 	{ return tree[idx].size; }
 
 private:
 	TreeNode *tree;    // array containing all tree node entries
+	DWORD *zsize;      // deflated data size of each node
 	DWORD ntree;       // number of entries
 	DWORD ntreebuf;    // array size
 	__int64 totlength; // total data size (deflated)
@@ -80,38 +111,100 @@ private:
 class ZTreeMgr {
 public:
 	enum Layer { LAYER_SURF, LAYER_MASK, LAYER_ELEV, LAYER_ELEVMOD, LAYER_LABEL, LAYER_CLOUD };
-	static ZTreeMgr *CreateFromFile(const char *PlanetPath, Layer _layer);
-	ZTreeMgr(const char *PlanetPath, Layer _layer);
+	enum ReadMode {
+		READMODE_FILE,  // read node data from the archive file with positional reads
+		READMODE_MAPPED // map the archive into memory and inflate from the mapped view
+	};
+	enum InflateMethod {
+		INFLATE_ZLIB,   // zlib uncompress
+		INFLATE_FAST    // single-shot table-driven decoder (FastInflate)
+	};
+	static ZTreeMgr *CreateFromFile(const char *PlanetPath, Layer _layer, ReadMode _mode = READMODE_MAPPED);
+	ZTreeMgr(const char *PlanetPath, Layer _layer, ReadMode _mode = READMODE_MAPPED);
 	~ZTreeMgr();
 	const TreeTOC &TOC() const { return toc; }
+	ReadMode Mode() const { return mode; }
+	Layer GetLayer() const { return layer; }
+	static const char *LayerName(Layer _layer);
+
+	static inline unsigned __int64 NodeKey(int lvl, int ilat, int ilng)
+	{ return ((unsigned __int64)lvl << (2 * NODEKEY_BITS)) | ((unsigned __int64)ilat << NODEKEY_BITS) | (unsigned __int64)ilng; }
+	// key of a tile, ordered by level, latitude and longitude index. Valid up to TREE_MAXLVL.
+
+	struct NodeRef { int lvl, ilat, ilng; DWORD idx; };
+	void Nodes(std::vector<NodeRef> &nodes) const;
+	// return all nodes of the tree that carry data
 
 	DWORD Idx(int lvl, int ilat, int ilng) const;
 	// return the array index of an arbitrary tile ((DWORD)-1: not present)
 
+	void Idx(int lvl, const std::vector<std::pair<int, int> > &tiles, std::vector<DWORD> &idx) const;
+	// return the array indices of a list of (ilat,ilng) tiles at level lvl
+
 	DWORD ReadData(DWORD idx, BYTE **outp) const;
+	// read and inflate the data of a node. Safe to call concurrently from
+	// multiple threads. The returned buffer must be freed with ReleaseData.
+
+	DWORD ReadData(DWORD idx, BYTE *buf, DWORD bufsize) const;
+	// read and inflate the data of a node into a caller-supplied buffer,
+	// which must hold at least NodeSizeInflated(idx) bytes. Returns the
+	// number of bytes written (0: error, or node has no data).
+
+	DWORD ReadDeflated(DWORD idx, BYTE *buf, DWORD bufsize) const;
+	// copy the compressed data of a node into a caller-supplied buffer of at
+	// least NodeSizeDeflated(idx) bytes. Returns the number of bytes copied.
+
+	DWORD ReadData(int lvl, int ilat, int ilng, BYTE **outp) const;
+	// read and inflate the data of a tile. Consults the node cache first, if
+	// one has been set.
 
-	inline DWORD ReadData(int lvl, int ilat, int ilng, BYTE **outp) const
-	{ return ReadData(Idx(lvl, ilat, ilng), outp); }
+	bool Prefetch(int lvl, int ilat, int ilng) const;
+	// make sure a tile is held in the node cache, reading it if necessary.
+	// Returns false if there is no cache, or the tile has no data.
 
 	void ReleaseData(BYTE *data) const;
 
 	inline DWORD NodeSizeDeflated(DWORD idx) const { return toc.NodeSizeDeflated(idx); }
 	inline DWORD NodeSizeInflated(DWORD idx) const { return toc.NodeSizeInflated(idx); }
 
+	static void SetNodeCache(NodeCache *cache) { s_nodeCache = cache; }
+	// set the cache of inflated nodes shared by all layer managers (0: no caching)
+
+	static NodeCache *GetNodeCache() { return s_nodeCache; }
+
+	static void SetInflateMethod(InflateMethod method) { s_inflateMethod = method; }
+	static InflateMethod GetInflateMethod() { return s_inflateMethod; }
+	// select the decompression backend used by all layer managers
+
 protected:
 	bool OpenArchive();
+	bool OpenDataFile(const char *fname);
+	bool MapArchive();
+	void CloseArchive();
+	void BuildIndex();
+	bool ReadAt(__int64 ofs, BYTE *buf, DWORD size) const;
 	DWORD Inflate(const BYTE *inp, DWORD ninp, BYTE *outp, DWORD noutp) const;
 
 private:
 	char *path;
 	Layer layer;
-	FILE *treef;
+	ReadMode mode;
+	HANDLE hFile;      // archive file handle, used for positional reads and for mapping
+	HANDLE hMapObj;    // file mapping object (READMODE_MAPPED only)
+	const BYTE *mapv;  // mapped view of the entire archive file (READMODE_MAPPED only)
+	__int64 fsize;     // archive file size [bytes]
 	TreeTOC toc;
 	DWORD rootPos1;    // index of level-1 tile ((DWORD)-1 for not present)
 	DWORD rootPos2;    // index of level-2 tile ((DWORD)-1 for not present)
 	DWORD rootPos3;    // index of level-3 tile ((DWORD)-1 for not present)
 	DWORD rootPos4[2]; // index of the level-4 tiles (quadtree roots; (DWORD)-1 for not present)
 	__int64 dofs;
+	std::vector<unsigned __int64> nodeKey; // sorted keys of the quadtree nodes (levels >= 4)
+	std::vector<DWORD> nodeIdx;            // TOC index of each node in nodeKey
+	std::vector<DWORD> levelOfs;           // position in nodeKey of the first node of each level (0 ... TREE_MAXLVL+1)
+
+	static NodeCache *s_nodeCache;
+	static InflateMethod s_inflateMethod;
 };
 
 #endif // !__ZTREEMGR_H
@@ -1,6 +1,7 @@
 #include <windows.h>
 #include <iostream>
 #include "ddsread.h"
+#include "dxt1decode.h"
 
 struct DDSPIXELFORMAT {
     DWORD dwSize;
@@ -30,9 +31,9 @@ struct DDSHEADER {
     DWORD dwReserved2;
 };
 
-std::vector<DWORD> ExtractDXT1 (WORD *data, DWORD ndata, DWORD height, DWORD width);
+void ExtractDXT1 (const WORD *data, DWORD height, DWORD width, const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange, Image &img);
 
-Image ddsread(const char *fname)
+Image ddsread(const char *fname, const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange, std::vector<BYTE> *dxt1)
 {
     Image img;
 
@@ -68,16 +69,16 @@ Image ddsread(const char *fname)
     }
     fclose(f);
 
-    img.data = ExtractDXT1(data, ndata, ddsh.dwHeight, ddsh.dwWidth);
-    img.width = ddsh.dwWidth;
-    img.height = ddsh.dwHeight;
+    if (dxt1)
+        dxt1->assign((const BYTE*)data, (const BYTE*)(data + ndata));
+    ExtractDXT1(data, ddsh.dwHeight, ddsh.dwWidth, xrange, yrange, img);
 
     delete []data;
     return img;
 }
 
 
-Image ddsscan(const BYTE *data, int ndata)
+Image ddsscan(const BYTE *data, int ndata, const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange, std::vector<BYTE> *dxt1)
 {
 	Image img;
 
@@ -108,72 +109,21 @@ Image ddsscan(const BYTE *data, int ndata)
 	}
 	ndata = ddsh.dwLinearSize / 2;
 
-	img.data = ExtractDXT1((WORD*)data, ndata, ddsh.dwHeight, ddsh.dwWidth);
-	img.width = ddsh.dwWidth;
-	img.height = ddsh.dwHeight;
+	if (dxt1)
+		dxt1->assign(data, data + ddsh.dwLinearSize);
+	ExtractDXT1((const WORD*)data, ddsh.dwHeight, ddsh.dwWidth, xrange, yrange, img);
 
 	return img;
 }
 
 
-std::vector<DWORD> ExtractDXT1 (WORD *data, DWORD ndata, DWORD h, DWORD w)
+void ExtractDXT1 (const WORD *data, DWORD h, DWORD w, const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange, Image &img)
 {
-    int i;
-    WORD *d, c0, c1;
-    DWORD lookup, idx, tgt, shift, xx, yy;
-    bool noalpha;
-
-    DWORD len = h*w;
-    DWORD A, R, G, B;
-
-    size_t nxblock = w/4;
-    size_t nyblock = h/4;
-    size_t ofs = 0;
-    WORD r[4], g[4], b[4];
-
-    std::vector<DWORD> argb(len);
-
-    for (size_t y = 0; y < nyblock; y++) {
-        for (size_t x = 0; x < nxblock; x++) {
-            d = data+ofs;
-            c0 = d[0];
-            c1 = d[1];
-            noalpha = (c0 > c1);
-            lookup = *(DWORD*)(d+2);
-
-            r[0] = (c0 >> 11) << 3;
-            g[0] = ((c0 >> 5) & 63) << 2;
-            b[0] = (c0 & 31) << 3;
-            r[1] = (c1 >> 11) << 3;
-            g[1] = ((c1 >> 5) & 63) << 2;
-            b[1] = (c1 & 31) << 3;
-            if (noalpha) {
-                r[2] = (r[0]*2 + r[1])/3;
-                g[2] = (g[0]*2 + g[1])/3;
-                b[2] = (b[0]*2 + b[1])/3;
-                r[3] = (r[0] + r[1]*2)/3;
-                g[3] = (g[0] + g[1]*2)/3;
-                b[3] = (b[0] + b[1]*2)/3;
-            } else {
-                r[2] = (r[0]+r[1])/2;
-                g[2] = (g[0]+g[1])/2;
-                b[2] = (b[0]+b[1])/2;
-                r[3] = g[3] = b[3] = 0;
-            }
-            for (yy = 0; yy < 4; yy++) {
-                for (xx = 0; xx < 4; xx++) {
-                    shift = (xx+yy*4)*2;
-                    idx = (lookup >> shift) & 3;
-                    R = (BYTE)r[idx];
-                    G = (BYTE)g[idx];
-                    B = (BYTE)b[idx];
-                    A = (idx == 3 && !noalpha ? 0 : 0xFF);
-                    //argb[(y*4+yy) + (x*4+xx)*h] = (A << 0x18) | (R << 0x10) | (G << 0x08) | B;
-                    argb[(y*4+yy)*w + (x*4+xx)] = (A << 0x18) | (R << 0x10) | (G << 0x08) | B;
-                }
-            }
-            ofs += 4;
-        }
-    }
-    return argb;
+    DWORD x0 = min(xrange.first, w), x1 = min(xrange.second, w);
+    DWORD y0 = min(yrange.first, h), y1 = min(yrange.second, h);
+    img.width = (x1 > x0 ? x1 - x0 : 0);
+    img.height = (y1 > y0 ? y1 - y0 : 0);
+    img.data.resize(img.width * img.height);
+    if (img.data.size())
+    	DecodeDXT1(data, w, h, x0, y0, img.width, img.height, img.data.data(), img.width);
 }
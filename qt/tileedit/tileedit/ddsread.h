@@ -3,7 +3,13 @@
 
 #include "imagetools.h"
 
-Image ddsread(const char *fname);
-Image ddsscan(const BYTE *data, int ndata);
+// pixel range [first, second) covering the whole image
+const std::pair<DWORD, DWORD> DDS_FULLRANGE(0, (DWORD)-1);
+
+Image ddsread(const char *fname, const std::pair<DWORD, DWORD> &xrange = DDS_FULLRANGE, const std::pair<DWORD, DWORD> &yrange = DDS_FULLRANGE, std::vector<BYTE> *dxt1 = 0);
+Image ddsscan(const BYTE *data, int ndata, const std::pair<DWORD, DWORD> &xrange = DDS_FULLRANGE, const std::pair<DWORD, DWORD> &yrange = DDS_FULLRANGE, std::vector<BYTE> *dxt1 = 0);
+// Read a DXT1 image from a file or memory buffer. If a pixel range is given,
+// only that subsection (clipped to the image) is decoded and returned.
+// If dxt1 is given, it receives a copy of the compressed blocks of the whole image.
 
 #endif // !DDSREAD_H
@@ -0,0 +1,176 @@
+#include "dlgbuildarchive.h"
+#include "ui_dlgBuildArchive.h"
+#include "tileedit.h"
+#include "treewriter.h"
+#include "tile.h"
+
+#include <QCheckBox>
+#include <QComboBox>
+#include <direct.h>
+
+DlgBuildArchive::DlgBuildArchive(tileedit *parent)
+	: QDialog(parent)
+	, m_tileedit(parent)
+	, ui(new Ui::DlgBuildArchive)
+{
+	ui->setupUi(this);
+	m_busy = false;
+
+	connect(ui->buildButton, SIGNAL(clicked()), this, SLOT(onBuild()));
+}
+
+DlgBuildArchive::~DlgBuildArchive()
+{
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void DlgBuildArchive::log(const char *msg)
+{
+	// called on the worker thread
+	QMetaObject::invokeMethod(this, "onLog", Qt::QueuedConnection, Q_ARG(QString, QString(msg)));
+}
+
+void DlgBuildArchive::onLog(QString msg)
+{
+	ui->textLog->appendPlainText(msg);
+}
+
+void DlgBuildArchive::onProgress(int done, int total)
+{
+	ui->progressBar->setMaximum(total);
+	ui->progressBar->setValue(done);
+}
+
+void DlgBuildArchive::reject()
+{
+	if (!m_busy) // don't close while a build is in progress
+		QDialog::reject();
+}
+
+void DlgBuildArchive::onBuild()
+{
+	struct {
+		QCheckBox *check;
+		ZTreeMgr::Layer layer;
+		ZTreeMgr *mgr;
+	} layers[4] = {
+		{ ui->checkSurf, ZTreeMgr::LAYER_SURF, m_tileedit->m_mgrSurf },
+		{ ui->checkMask, ZTreeMgr::LAYER_MASK, m_tileedit->m_mgrMask },
+		{ ui->checkElev, ZTreeMgr::LAYER_ELEV, m_tileedit->m_mgrElev },
+		{ ui->checkElevMod, ZTreeMgr::LAYER_ELEVMOD, m_tileedit->m_mgrElevMod }
+	};
+	char cbuf[1024];
+
+	m_jobs.clear();
+	for (int i = 0; i < 4; i++) {
+		if (layers[i].check->isChecked()) {
+			Job job = { layers[i].layer, layers[i].mgr };
+			m_jobs.push_back(job);
+		}
+	}
+	m_mode = ui->comboMode->currentIndex();
+	m_root = Tile::root();
+	m_replace.clear();
+	m_appended = false;
+
+	m_busy = true;
+	ui->buildButton->setEnabled(false);
+	ui->closeButton->setEnabled(false);
+
+	sprintf(cbuf, "%s/Archive", m_root.c_str());
+	mkdir(cbuf);
+
+	// The archives are written on a worker thread, so the GUI stays responsive
+	// without re-entering the event loop from the build. The dialog is modal,
+	// so the open archives can't be closed or replaced until onBuildFinished.
+	if (m_thread.joinable())
+		m_thread.join();
+	m_thread = std::thread(&DlgBuildArchive::build, this);
+}
+
+void DlgBuildArchive::build()
+{
+	enum { MODE_MERGE, MODE_CACHEONLY, MODE_APPEND };
+	char cbuf[1024];
+
+	for (auto &job : m_jobs) {
+		const char *name = ZTreeMgr::LayerName(job.layer);
+
+		TreeWriter writer(m_root.c_str(), job.layer);
+		writer.setProgressCallback([this](DWORD done, DWORD total) {
+			QMetaObject::invokeMethod(this, "onProgress", Qt::QueuedConnection, Q_ARG(int, (int)done), Q_ARG(int, (int)total));
+		});
+
+		if (m_mode == MODE_APPEND && job.mgr) {
+			sprintf(cbuf, "%s: appending ...", name);
+			log(cbuf);
+			if (writer.Append(job.mgr)) {
+				const TreeWriter::Stats &stats = writer.stats();
+				sprintf(cbuf, "%s: %d nodes (%d appended, %d kept), %0.1lf MB -> %0.1lf MB in %0.2lf s, %0.1lf MB unused",
+					name, stats.nodeCount, stats.cacheTiles, stats.archiveTiles,
+					stats.inflatedBytes / 1048576.0, stats.deflatedBytes / 1048576.0, stats.seconds,
+					stats.garbageBytes / 1048576.0);
+				log(cbuf);
+				if (stats.cacheTiles)
+					m_appended = true;
+				if (stats.garbageBytes)
+					log("Rebuild the archive to remove unused data.");
+			}
+			else {
+				sprintf(cbuf, "%s: no tiles found, or archive could not be updated", name);
+				log(cbuf);
+			}
+			continue;
+		}
+
+		// rebuild; also used for appending if there is no archive yet
+		sprintf(cbuf, "%s: building ...", name);
+		log(cbuf);
+		if (m_mode != MODE_CACHEONLY && job.mgr)
+			writer.setMergeSource(job.mgr);
+
+		// write to a temporary file; the open archives are replaced once all layers are done
+		std::string fname = m_root + "/Archive/" + name + ".tree";
+		std::string tmpname = fname + ".tmp";
+		if (writer.Write(tmpname.c_str())) {
+			const TreeWriter::Stats &stats = writer.stats();
+			sprintf(cbuf, "%s: %d nodes (%d from cache, %d from archive), %0.1lf MB -> %0.1lf MB in %0.2lf s (%0.1lf MB/s)",
+				name, stats.nodeCount, stats.cacheTiles, stats.archiveTiles,
+				stats.inflatedBytes / 1048576.0, stats.deflatedBytes / 1048576.0, stats.seconds,
+				stats.seconds > 0.0 ? stats.inflatedBytes / 1048576.0 / stats.seconds : 0.0);
+			log(cbuf);
+			m_replace.push_back(std::make_pair(tmpname, fname));
+		}
+		else {
+			sprintf(cbuf, "%s: no tiles found, or archive could not be written", name);
+			log(cbuf);
+		}
+	}
+	QMetaObject::invokeMethod(this, "onBuildFinished", Qt::QueuedConnection);
+}
+
+void DlgBuildArchive::onBuildFinished()
+{
+	char cbuf[1024];
+	m_thread.join();
+
+	if (m_replace.size() || m_appended) {
+		// the archives must be closed (and unmapped) before they can be replaced,
+		// and reopened to pick up appended nodes
+		m_tileedit->releaseTreeManagers();
+		for (auto &r : m_replace) {
+			if (!MoveFileExA(r.first.c_str(), r.second.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+				sprintf(cbuf, "Failed to replace %s", r.second.c_str());
+				onLog(QString(cbuf));
+			}
+		}
+		m_tileedit->setupTreeManagers(m_root);
+		m_tileedit->setTile(m_tileedit->m_lvl, m_tileedit->m_ilat, m_tileedit->m_ilng);
+	}
+	onLog("Done.");
+
+	ui->buildButton->setEnabled(true);
+	ui->closeButton->setEnabled(true);
+	m_busy = false;
+}
@@ -0,0 +1,56 @@
+#ifndef DLGBUILDARCHIVE_H
+#define DLGBUILDARCHIVE_H
+
+#include <QDialog>
+#include "ZTreeMgr.h"
+#include <string>
+#include <vector>
+#include <thread>
+
+namespace Ui {
+	class DlgBuildArchive;
+}
+
+class tileedit;
+
+class DlgBuildArchive : public QDialog
+{
+	Q_OBJECT
+
+public:
+	DlgBuildArchive(tileedit *parent);
+	~DlgBuildArchive();
+
+public slots:
+	void onBuild();
+	void reject();
+	void onLog(QString msg);
+	void onProgress(int done, int total);
+	void onBuildFinished();
+
+private:
+	struct Job {
+		ZTreeMgr::Layer layer;
+		ZTreeMgr *mgr;     // open archive of the layer, or 0
+	};
+
+	void build();
+	// write the archives of m_jobs; runs on m_thread and posts its log
+	// lines and progress to the dialog's slots
+
+	void log(const char *msg);
+
+	Ui::DlgBuildArchive *ui;
+	tileedit *m_tileedit;
+	bool m_busy;
+
+	// build state, owned by the worker thread until onBuildFinished
+	std::thread m_thread;
+	std::vector<Job> m_jobs;
+	int m_mode;
+	std::string m_root;
+	std::vector<std::pair<std::string, std::string> > m_replace; // temporary and final archive names
+	bool m_appended;
+};
+
+#endif // !DLGBUILDARCHIVE_H
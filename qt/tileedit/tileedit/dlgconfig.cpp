@@ -13,6 +13,14 @@ DlgConfig::DlgConfig(tileedit *parent)
 	ui->comboLoadSequence->setCurrentIndex(flag == 1 ? 2 : flag == 2 ? 1 : 0);
 	ui->checkInterpolateFromAncestor->setChecked(m_tileedit->m_globalLoadMode != TILELOADMODE_DIRECTONLY);
 	ui->comboDisplayMode->setCurrentIndex(m_tileedit->m_blocksize == 1 ? 0 : 1);
+	ui->spinCacheSize->setValue(m_tileedit->m_cachesize);
+	ui->comboDXTQuality->setCurrentIndex((int)m_tileedit->m_dxtquality);
+
+	NodeCache::Stats stats = m_tileedit->m_nodeCache->stats();
+	char cbuf[256];
+	sprintf(cbuf, "In use: %0.1lf MB (%d nodes)\nHits: %lld, misses: %lld, evicted: %lld",
+		stats.bytes / 1048576.0, (int)stats.entries, stats.hits, stats.misses, stats.evictions);
+	ui->labelCacheStats->setText(cbuf);
 }
 
 void DlgConfig::accept()
@@ -28,5 +36,9 @@ void DlgConfig::accept()
 	idx = ui->comboDisplayMode->currentIndex();
 	m_tileedit->setBlockSize(idx == 0 ? 1 : 2);
 
+	m_tileedit->setCacheSize(ui->spinCacheSize->value());
+
+	m_tileedit->setDXTQuality((DXT1Quality)ui->comboDXTQuality->currentIndex());
+
 	QDialog::accept();
 }
\ No newline at end of file
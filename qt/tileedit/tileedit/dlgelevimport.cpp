@@ -187,11 +187,13 @@ void DlgElevImport::accept()
 		return;
 	}
 	ElevTileBlock *eblock = ElevTileBlock::Load(m_metaInfo.lvl, m_metaInfo.ilat0, m_metaInfo.ilat1, m_metaInfo.ilng0, m_metaInfo.ilng1);
-	if (!elvread_png(ui->editPath->text().toLatin1(), m_metaInfo, eblock->getData())) {
+	ElevData edata = eblock->getData();
+	if (!elvread_png(ui->editPath->text().toLatin1(), m_metaInfo, edata)) {
 		QMessageBox mbox(QMessageBox::Warning, tr("tileedit: Warning"), tr("Error reading PNG file"), QMessageBox::Close);
 		mbox.exec();
 		return;
 	}
+	eblock->setData(edata);
 
 	int ilat0 = ui->spinIlat0->value();
 	int ilat1 = ui->spinIlat1->value() + 1;
@@ -209,7 +211,7 @@ void DlgElevImport::accept()
 				if (tile) {
 					tile->dataChanged();
 					tile->Save();
-					tile->getData() = etile->getData();
+					tile->setData(etile->getData());
 					tile->dataChanged();
 					tile->SaveMod();
 				}
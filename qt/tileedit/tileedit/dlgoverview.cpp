@@ -0,0 +1,64 @@
+#include "dlgoverview.h"
+#include "ui_dlgOverview.h"
+#include "tileedit.h"
+#include "overviewcanvas.h"
+
+DlgOverview::DlgOverview(tileedit *parent)
+	: QDialog(parent)
+	, m_tileedit(parent)
+	, ui(new Ui::DlgOverview)
+{
+	ui->setupUi(this);
+
+	const ElevDisplayParam &prm = m_tileedit->m_elevDisplayParam;
+	ui->widgetCanvas->setElevDisplay(prm.cmName, prm.rangeMin, prm.rangeMax);
+	setTreeMgr(m_tileedit->m_mgrSurf, m_tileedit->m_mgrElev, m_tileedit->m_mgrElevMod);
+
+	connect(ui->comboLayer, SIGNAL(currentIndexChanged(int)), this, SLOT(onLayerChanged(int)));
+	connect(ui->widgetCanvas, SIGNAL(tileSelected(int, int, int)), this, SLOT(onTileSelected(int, int, int)));
+	connect(ui->widgetCanvas, SIGNAL(positionChanged(double, double, int)), this, SLOT(onPositionChanged(double, double, int)));
+}
+
+DlgOverview::~DlgOverview()
+{
+	delete ui;
+}
+
+void DlgOverview::setTreeMgr(const ZTreeMgr *mgrSurf, const ZTreeMgr *mgrElev, const ZTreeMgr *mgrElevMod)
+{
+	ui->widgetCanvas->setTreeMgr(mgrSurf, mgrElev, mgrElevMod);
+}
+
+void DlgOverview::elevDisplayParamChanged()
+{
+	// In auto-range mode the range follows the current block, which would
+	// invalidate the overview at every move, so the overview keeps its range.
+	const ElevDisplayParam &prm = m_tileedit->m_elevDisplayParam;
+	OverviewCanvas *canvas = ui->widgetCanvas;
+	if (prm.autoRange)
+		canvas->setElevDisplay(prm.cmName, canvas->elevMin(), canvas->elevMax());
+	else
+		canvas->setElevDisplay(prm.cmName, prm.rangeMin, prm.rangeMax);
+}
+
+void DlgOverview::done(int r)
+{
+	emit finished(r);
+}
+
+void DlgOverview::onLayerChanged(int idx)
+{
+	ui->widgetCanvas->setLayer(idx == 1 ? OverviewCanvas::LAYER_ELEV : OverviewCanvas::LAYER_SURF);
+}
+
+void DlgOverview::onTileSelected(int lvl, int ilat, int ilng)
+{
+	m_tileedit->setTile(lvl, ilat, ilng);
+}
+
+void DlgOverview::onPositionChanged(double lng, double lat, int lvl)
+{
+	char cbuf[256];
+	sprintf(cbuf, "Lng=%+0.4f, Lat=%+0.4f, Level %d", lng, lat, lvl);
+	ui->labelPosition->setText(cbuf);
+}
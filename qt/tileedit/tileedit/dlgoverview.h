@@ -0,0 +1,40 @@
+#ifndef DLGOVERVIEW_H
+#define DLGOVERVIEW_H
+
+#include <QDialog>
+
+namespace Ui {
+	class DlgOverview;
+}
+
+class tileedit;
+class OverviewCanvas;
+class ZTreeMgr;
+
+class DlgOverview : public QDialog
+{
+	Q_OBJECT
+
+public:
+	DlgOverview(tileedit *parent);
+	~DlgOverview();
+
+	void setTreeMgr(const ZTreeMgr *mgrSurf, const ZTreeMgr *mgrElev, const ZTreeMgr *mgrElevMod);
+	// archives shown by the overview (0: none). Must be reset before the
+	// archives are closed.
+
+	void elevDisplayParamChanged();
+	// the elevation display parameters of tileedit were changed
+
+public slots:
+	void done(int r);
+	void onLayerChanged(int idx);
+	void onTileSelected(int lvl, int ilat, int ilng);
+	void onPositionChanged(double lng, double lat, int lvl);
+
+private:
+	Ui::DlgOverview *ui;
+	tileedit *m_tileedit;
+};
+
+#endif // !DLGOVERVIEW_H
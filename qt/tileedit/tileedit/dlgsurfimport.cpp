@@ -145,12 +145,13 @@ void DlgSurfImport::accept()
 		settings->setValue("export/path", fi.absolutePath());
 	}
 
+	std::vector<SurfTile*> stiles;
 	for (int ilat = m_metaInfo.ilat0; ilat < m_metaInfo.ilat1; ilat++)
 		for (int ilng = m_metaInfo.ilng0; ilng < m_metaInfo.ilng1; ilng++) {
 			sblock->syncTile(ilat, ilng);
-			SurfTile *stile = (SurfTile*)sblock->_getTile(ilat, ilng);
-			stile->Save();
+			stiles.push_back((SurfTile*)sblock->_getTile(ilat, ilng));
 		}
+	SurfTile::Save(stiles);
 	if (ui->checkPropagateChanges->isChecked())
 		sblock->mapToAncestors(ui->spinPropagationLevel->value());
 	
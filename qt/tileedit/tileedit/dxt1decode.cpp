@@ -0,0 +1,374 @@
+#include "dxt1decode.h"
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+// The AVX2 functions are compiled for AVX2 individually, so the rest of the
+// file keeps the baseline instruction set and is safe on any CPU. MSVC
+// accepts AVX2 intrinsics without a target option.
+#if defined(__GNUC__)
+#define DXT1_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DXT1_TARGET_AVX2
+#endif
+
+// =======================================================================
+// Scalar reference decoder
+
+static void DecodeRowScalar(const WORD *d, DWORD *dst, size_t w, size_t nblock)
+{
+	// decode nblock consecutive blocks of a block row into dst (row stride w)
+	WORD r[4], g[4], b[4];
+
+	for (size_t n = 0; n < nblock; n++, d += 4, dst += 4) {
+		WORD c0 = d[0];
+		WORD c1 = d[1];
+		bool noalpha = (c0 > c1);
+		DWORD lookup = (DWORD)d[2] | ((DWORD)d[3] << 16);
+
+		r[0] = (c0 >> 11) << 3;
+		g[0] = ((c0 >> 5) & 63) << 2;
+		b[0] = (c0 & 31) << 3;
+		r[1] = (c1 >> 11) << 3;
+		g[1] = ((c1 >> 5) & 63) << 2;
+		b[1] = (c1 & 31) << 3;
+		if (noalpha) {
+			r[2] = (r[0] * 2 + r[1]) / 3;
+			g[2] = (g[0] * 2 + g[1]) / 3;
+			b[2] = (b[0] * 2 + b[1]) / 3;
+			r[3] = (r[0] + r[1] * 2) / 3;
+			g[3] = (g[0] + g[1] * 2) / 3;
+			b[3] = (b[0] + b[1] * 2) / 3;
+		}
+		else {
+			r[2] = (r[0] + r[1]) / 2;
+			g[2] = (g[0] + g[1]) / 2;
+			b[2] = (b[0] + b[1]) / 2;
+			r[3] = g[3] = b[3] = 0;
+		}
+		for (int yy = 0; yy < 4; yy++) {
+			for (int xx = 0; xx < 4; xx++) {
+				DWORD idx = (lookup >> ((xx + yy * 4) * 2)) & 3;
+				DWORD A = (idx == 3 && !noalpha ? 0 : 0xFF);
+				dst[yy*w + xx] = (A << 0x18) | ((DWORD)(BYTE)r[idx] << 0x10) | ((DWORD)(BYTE)g[idx] << 0x08) | (BYTE)b[idx];
+			}
+		}
+	}
+}
+
+// =======================================================================
+// SSE2 decoder: palettes of 4 blocks are computed in parallel, one block
+// per 32-bit lane. Division by 3 uses (x*21846)>>16, which is exact for
+// x < 32768 (here x <= 765).
+
+static inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// -----------------------------------------------------------------------
+
+static inline __m128i PackARGB(__m128i r, __m128i g, __m128i b)
+{
+	return _mm_or_si128(_mm_or_si128(_mm_set1_epi32(0xFF000000), _mm_slli_epi32(r, 16)),
+		_mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+// -----------------------------------------------------------------------
+
+static inline void PaletteSSE2(__m128i hdr, __m128i p[4])
+{
+	// hdr: c0 | c1 << 16 of 4 blocks. Returns palette entry i of all blocks in p[i].
+	const __m128i m5 = _mm_set1_epi32(31);
+	const __m128i m6 = _mm_set1_epi32(63);
+	const __m128i third = _mm_set1_epi32(21846);
+
+	__m128i c0 = _mm_and_si128(hdr, _mm_set1_epi32(0xFFFF));
+	__m128i c1 = _mm_srli_epi32(hdr, 16);
+	__m128i noalpha = _mm_cmpgt_epi32(c0, c1);
+
+	__m128i r0 = _mm_slli_epi32(_mm_srli_epi32(c0, 11), 3);
+	__m128i g0 = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(c0, 5), m6), 2);
+	__m128i b0 = _mm_slli_epi32(_mm_and_si128(c0, m5), 3);
+	__m128i r1 = _mm_slli_epi32(_mm_srli_epi32(c1, 11), 3);
+	__m128i g1 = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(c1, 5), m6), 2);
+	__m128i b1 = _mm_slli_epi32(_mm_and_si128(c1, m5), 3);
+
+	__m128i r2 = Select(noalpha, _mm_mulhi_epu16(_mm_add_epi32(_mm_add_epi32(r0, r0), r1), third), _mm_srli_epi32(_mm_add_epi32(r0, r1), 1));
+	__m128i g2 = Select(noalpha, _mm_mulhi_epu16(_mm_add_epi32(_mm_add_epi32(g0, g0), g1), third), _mm_srli_epi32(_mm_add_epi32(g0, g1), 1));
+	__m128i b2 = Select(noalpha, _mm_mulhi_epu16(_mm_add_epi32(_mm_add_epi32(b0, b0), b1), third), _mm_srli_epi32(_mm_add_epi32(b0, b1), 1));
+	__m128i r3 = _mm_mulhi_epu16(_mm_add_epi32(_mm_add_epi32(r1, r1), r0), third);
+	__m128i g3 = _mm_mulhi_epu16(_mm_add_epi32(_mm_add_epi32(g1, g1), g0), third);
+	__m128i b3 = _mm_mulhi_epu16(_mm_add_epi32(_mm_add_epi32(b1, b1), b0), third);
+
+	p[0] = PackARGB(r0, g0, b0);
+	p[1] = PackARGB(r1, g1, b1);
+	p[2] = PackARGB(r2, g2, b2);
+	p[3] = _mm_and_si128(noalpha, PackARGB(r3, g3, b3)); // transparent black for blocks with alpha
+}
+
+// -----------------------------------------------------------------------
+
+static void DecodeRowSSE2(const WORD *d, DWORD *row, size_t w, size_t nblock)
+{
+	const __m128i bit0 = _mm_setr_epi32(1, 4, 16, 64);  // low index bit of the 4 pixels of a row
+	const __m128i bit1 = _mm_setr_epi32(2, 8, 32, 128); // high index bit
+
+	size_t x = 0;
+	for (; x + 4 <= nblock; x += 4, d += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)d);
+		__m128i b = _mm_loadu_si128((const __m128i*)(d + 8));
+		__m128i hdr = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i lk = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+		__m128i p[4];
+		PaletteSSE2(hdr, p);
+
+		// transpose, so that q[k] holds the palette of block k
+		__m128i t0 = _mm_unpacklo_epi32(p[0], p[1]);
+		__m128i t1 = _mm_unpacklo_epi32(p[2], p[3]);
+		__m128i t2 = _mm_unpackhi_epi32(p[0], p[1]);
+		__m128i t3 = _mm_unpackhi_epi32(p[2], p[3]);
+		__m128i q[4] = {
+			_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+			_mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)
+		};
+
+		for (int k = 0; k < 4; k++) {
+			__m128i p0 = _mm_shuffle_epi32(q[k], 0x00);
+			__m128i p1 = _mm_shuffle_epi32(q[k], 0x55);
+			__m128i p2 = _mm_shuffle_epi32(q[k], 0xAA);
+			__m128i p3 = _mm_shuffle_epi32(q[k], 0xFF);
+			DWORD lookup = (DWORD)_mm_cvtsi128_si32(lk);
+			lk = _mm_srli_si128(lk, 4);
+			DWORD *dst = row + (x + k) * 4;
+			for (int yy = 0; yy < 4; yy++, dst += w, lookup >>= 8) {
+				__m128i v = _mm_set1_epi32(lookup & 0xFF);
+				__m128i lo = _mm_cmpeq_epi32(_mm_and_si128(v, bit0), bit0);
+				__m128i hi = _mm_cmpeq_epi32(_mm_and_si128(v, bit1), bit1);
+				__m128i c = Select(hi, Select(lo, p3, p2), Select(lo, p1, p0));
+				_mm_storeu_si128((__m128i*)dst, c);
+			}
+		}
+	}
+	DecodeRowScalar(d, row + x * 4, w, nblock - x);
+}
+
+// =======================================================================
+// AVX2 decoder: palettes of 8 blocks are computed in parallel, and the
+// pixels of two rows of a block are looked up with a single permute.
+
+DXT1_TARGET_AVX2
+static inline __m256i Select256(__m256i mask, __m256i a, __m256i b)
+{
+	return _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b));
+}
+
+// -----------------------------------------------------------------------
+
+DXT1_TARGET_AVX2
+static inline __m256i PackARGB256(__m256i r, __m256i g, __m256i b)
+{
+	return _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32(0xFF000000), _mm256_slli_epi32(r, 16)),
+		_mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+// -----------------------------------------------------------------------
+
+DXT1_TARGET_AVX2
+static inline void PaletteAVX2(__m256i hdr, __m256i p[4])
+{
+	const __m256i m5 = _mm256_set1_epi32(31);
+	const __m256i m6 = _mm256_set1_epi32(63);
+	const __m256i third = _mm256_set1_epi32(21846);
+
+	__m256i c0 = _mm256_and_si256(hdr, _mm256_set1_epi32(0xFFFF));
+	__m256i c1 = _mm256_srli_epi32(hdr, 16);
+	__m256i noalpha = _mm256_cmpgt_epi32(c0, c1);
+
+	__m256i r0 = _mm256_slli_epi32(_mm256_srli_epi32(c0, 11), 3);
+	__m256i g0 = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 5), m6), 2);
+	__m256i b0 = _mm256_slli_epi32(_mm256_and_si256(c0, m5), 3);
+	__m256i r1 = _mm256_slli_epi32(_mm256_srli_epi32(c1, 11), 3);
+	__m256i g1 = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(c1, 5), m6), 2);
+	__m256i b1 = _mm256_slli_epi32(_mm256_and_si256(c1, m5), 3);
+
+	__m256i r2 = Select256(noalpha, _mm256_mulhi_epu16(_mm256_add_epi32(_mm256_add_epi32(r0, r0), r1), third), _mm256_srli_epi32(_mm256_add_epi32(r0, r1), 1));
+	__m256i g2 = Select256(noalpha, _mm256_mulhi_epu16(_mm256_add_epi32(_mm256_add_epi32(g0, g0), g1), third), _mm256_srli_epi32(_mm256_add_epi32(g0, g1), 1));
+	__m256i b2 = Select256(noalpha, _mm256_mulhi_epu16(_mm256_add_epi32(_mm256_add_epi32(b0, b0), b1), third), _mm256_srli_epi32(_mm256_add_epi32(b0, b1), 1));
+	__m256i r3 = _mm256_mulhi_epu16(_mm256_add_epi32(_mm256_add_epi32(r1, r1), r0), third);
+	__m256i g3 = _mm256_mulhi_epu16(_mm256_add_epi32(_mm256_add_epi32(g1, g1), g0), third);
+	__m256i b3 = _mm256_mulhi_epu16(_mm256_add_epi32(_mm256_add_epi32(b1, b1), b0), third);
+
+	p[0] = PackARGB256(r0, g0, b0);
+	p[1] = PackARGB256(r1, g1, b1);
+	p[2] = PackARGB256(r2, g2, b2);
+	p[3] = _mm256_and_si256(noalpha, PackARGB256(r3, g3, b3));
+}
+
+// -----------------------------------------------------------------------
+
+DXT1_TARGET_AVX2
+static void DecodeRowAVX2(const WORD *d, DWORD *row, size_t w, size_t nblock)
+{
+	const __m256i shift01 = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);      // index bits of rows 0 and 1
+	const __m256i shift23 = _mm256_setr_epi32(16, 18, 20, 22, 24, 26, 28, 30); // index bits of rows 2 and 3
+	const __m256i three = _mm256_set1_epi32(3);
+
+	size_t x = 0;
+	for (; x + 8 <= nblock; x += 8, d += 32) {
+		__m256 a = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)d));
+		__m256 b = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(d + 16)));
+		// the in-lane shuffle yields blocks 0,1,4,5,2,3,6,7; restore the order
+		__m256i hdr = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i lk = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+		__m256i p[4];
+		PaletteAVX2(hdr, p);
+
+		// transpose within each 128-bit lane: q[k] holds the palettes of blocks k and k+4
+		__m256i t0 = _mm256_unpacklo_epi32(p[0], p[1]);
+		__m256i t1 = _mm256_unpacklo_epi32(p[2], p[3]);
+		__m256i t2 = _mm256_unpackhi_epi32(p[0], p[1]);
+		__m256i t3 = _mm256_unpackhi_epi32(p[2], p[3]);
+		__m256i q[4] = {
+			_mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1),
+			_mm256_unpacklo_epi64(t2, t3), _mm256_unpackhi_epi64(t2, t3)
+		};
+
+		for (int k = 0; k < 8; k++) {
+			__m256i pal = (k < 4 ? _mm256_permute2x128_si256(q[k], q[k], 0x00) : _mm256_permute2x128_si256(q[k - 4], q[k - 4], 0x11));
+			__m256i v = _mm256_permutevar8x32_epi32(lk, _mm256_set1_epi32(k));
+			__m256i c01 = _mm256_permutevar8x32_epi32(pal, _mm256_and_si256(_mm256_srlv_epi32(v, shift01), three));
+			__m256i c23 = _mm256_permutevar8x32_epi32(pal, _mm256_and_si256(_mm256_srlv_epi32(v, shift23), three));
+			DWORD *dst = row + (x + k) * 4;
+			_mm_storeu_si128((__m128i*)dst, _mm256_castsi256_si128(c01));
+			_mm_storeu_si128((__m128i*)(dst + w), _mm256_extracti128_si256(c01, 1));
+			_mm_storeu_si128((__m128i*)(dst + 2 * w), _mm256_castsi256_si128(c23));
+			_mm_storeu_si128((__m128i*)(dst + 3 * w), _mm256_extracti128_si256(c23, 1));
+		}
+	}
+	_mm256_zeroupper();
+	DecodeRowScalar(d, row + x * 4, w, nblock - x);
+}
+
+// =======================================================================
+// Dispatch
+
+static DXT1DecodeMethod DetectMethod()
+{
+	unsigned int info[4];
+#if defined(_MSC_VER)
+	__cpuid((int*)info, 0);
+#else
+	__cpuid(0, info[0], info[1], info[2], info[3]);
+#endif
+	unsigned int nid = info[0];
+	if (nid < 1)
+		return DXT1DECODE_SCALAR;
+
+#if defined(_MSC_VER)
+	__cpuid((int*)info, 1);
+#else
+	__cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+	if (!(info[3] & (1 << 26))) // SSE2
+		return DXT1DECODE_SCALAR;
+
+	// AVX2 requires OS support for saving the YMM registers
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (nid < 7 || !osxsave || !avx)
+		return DXT1DECODE_SSE2;
+#if defined(_MSC_VER)
+	unsigned __int64 xcr0 = _xgetbv(0);
+#else
+	unsigned int xlo, xhi;
+	__asm__ __volatile__("xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0));
+	unsigned long long xcr0 = ((unsigned long long)xhi << 32) | xlo;
+#endif
+	if ((xcr0 & 6) != 6)
+		return DXT1DECODE_SSE2;
+
+#if defined(_MSC_VER)
+	__cpuidex((int*)info, 7, 0);
+#else
+	__cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+	return (info[1] & (1 << 5)) ? DXT1DECODE_AVX2 : DXT1DECODE_SSE2;
+}
+
+// -----------------------------------------------------------------------
+
+DXT1DecodeMethod DXT1DecodeBest()
+{
+	static const DXT1DecodeMethod best = DetectMethod();
+	return best;
+}
+
+// -----------------------------------------------------------------------
+
+void DecodeDXT1(const WORD *data, DWORD w, DWORD h, DWORD *argb, DXT1DecodeMethod method)
+{
+	DecodeDXT1(data, w, h, 0, 0, w, h, argb, w, method);
+}
+
+// -----------------------------------------------------------------------
+
+void DecodeDXT1(const WORD *data, DWORD w, DWORD h, DWORD x0, DWORD y0, DWORD rw, DWORD rh,
+	DWORD *dst, size_t stride, DXT1DecodeMethod method)
+{
+	if (x0 >= w || y0 >= h)
+		return;
+	if (rw > w - x0) rw = w - x0;
+	if (rh > h - y0) rh = h - y0;
+	if (!rw || !rh)
+		return;
+
+	DXT1DecodeMethod best = DXT1DecodeBest();
+	if (method == DXT1DECODE_AUTO || method > best)
+		method = best;
+
+	void (*decodeRow)(const WORD*, DWORD*, size_t, size_t);
+	switch (method) {
+	case DXT1DECODE_AVX2:
+		decodeRow = DecodeRowAVX2;
+		break;
+	case DXT1DECODE_SSE2:
+		decodeRow = DecodeRowSSE2;
+		break;
+	default:
+		decodeRow = DecodeRowScalar;
+		break;
+	}
+
+	// Only the blocks overlapping the rectangle are decoded. Full block rows
+	// of an x-aligned rectangle go straight to the destination, the others
+	// through a 4-row buffer.
+	size_t nxblock = w / 4;
+	DWORD bx0 = x0 / 4, bx1 = (x0 + rw + 3) / 4;
+	DWORD by0 = y0 / 4, by1 = (y0 + rh + 3) / 4;
+	size_t nblock = bx1 - bx0;
+	bool xaligned = (x0 % 4 == 0 && rw % 4 == 0);
+	std::vector<DWORD> buf;
+
+	for (DWORD by = by0; by < by1; by++) {
+		const WORD *d = data + (by * nxblock + bx0) * 4;
+		DWORD ya = max(by * 4, y0);
+		DWORD yb = min(by * 4 + 4, y0 + rh);
+		DWORD *out = dst + (ya - y0) * stride;
+		if (xaligned && yb - ya == 4) {
+			decodeRow(d, out, stride, nblock);
+		}
+		else {
+			if (buf.empty())
+				buf.resize(nblock * 16);
+			decodeRow(d, buf.data(), nblock * 4, nblock);
+			for (DWORD y = ya; y < yb; y++, out += stride)
+				memcpy(out, buf.data() + (y - by * 4) * nblock * 4 + (x0 - bx0 * 4), rw * sizeof(DWORD));
+		}
+	}
+}
@@ -0,0 +1,32 @@
+// =======================================================================
+// dxt1decode.h
+// DXT1 (BC1) block decoder with scalar, SSE2 and AVX2 implementations.
+// =======================================================================
+
+#ifndef DXT1DECODE_H
+#define DXT1DECODE_H
+
+#include <windows.h>
+
+enum DXT1DecodeMethod {
+	DXT1DECODE_AUTO,   // best method supported by the CPU
+	DXT1DECODE_SCALAR,
+	DXT1DECODE_SSE2,
+	DXT1DECODE_AVX2
+};
+
+void DecodeDXT1(const WORD *data, DWORD w, DWORD h, DWORD *argb, DXT1DecodeMethod method = DXT1DECODE_AUTO);
+// decode a w x h DXT1 image (w, h multiples of 4) into 32-bit ARGB pixels,
+// row by row. All methods produce identical output. Methods not supported
+// by the CPU fall back to the best supported one.
+
+void DecodeDXT1(const WORD *data, DWORD w, DWORD h, DWORD x0, DWORD y0, DWORD rw, DWORD rh,
+	DWORD *dst, size_t stride, DXT1DecodeMethod method = DXT1DECODE_AUTO);
+// decode the rw x rh pixel rectangle at (x0, y0) of a w x h DXT1 image into
+// dst, with a row stride of 'stride' pixels. Only the 4x4 blocks covering the
+// rectangle are decoded. The rectangle is clipped to the image.
+
+DXT1DecodeMethod DXT1DecodeBest();
+// fastest method supported by the CPU
+
+#endif // !DXT1DECODE_H
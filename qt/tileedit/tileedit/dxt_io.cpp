@@ -1,4 +1,5 @@
 #include "dxt_io.h"
+#include "parallel.h"
 #include <png.h>
 #include <libdxt.h>
 
@@ -46,29 +47,110 @@ void setdxt1header(const Image &idata, DDS_HEADER &hdr)
 	hdr.dwCaps = 0x1000;
 }
 
-void dxt1write(const char *fname, const Image &idata)
+static void dxt1input(const DWORD *id, int n, DWORD *inp)
 {
-	const char magic[4] = { 'D', 'D', 'S', ' ' };
-	int format = FORMAT_DXT1;
-	byte *dxt1 = new byte[idata.width * idata.height * 4];
-
 	// Need to flip RGB order for the compression engine
-	DWORD *inp = new DWORD[idata.width * idata.height];
-	const DWORD *id = idata.data.data();
-	for (int i = 0; i < idata.width*idata.height; i++)
+	for (int i = 0; i < n; i++)
 		inp[i] = 0xff000000 | ((id[i] & 0xff) << 16) | (id[i] & 0xff00) | ((id[i] & 0xff0000) >> 16);
+}
+
+static int dxtquality(DXT1Quality quality)
+{
+	switch (quality) {
+	case DXT1_NORMAL: return DXT_QUALITY_NORMAL;
+	case DXT1_HIGH:   return DXT_QUALITY_HIGH;
+	default:          return DXT_QUALITY_FAST;
+	}
+}
+
+static void dxtParallelFor(int n, int numthreads, void (*func)(void *arg, int i), void *arg)
+{
+	parallelFor(n, [func, arg](int i) { func(arg, i); }, numthreads);
+}
+
+void dxtUseWorkerPool()
+{
+	SetDXTParallelFor(dxtParallelFor);
+}
+
+void dxt1compress(const Image &idata, std::vector<BYTE> &dxt1, DXT1Quality quality)
+{
+	std::vector<DWORD> inp(idata.width * idata.height);
+	dxt1input(idata.data.data(), (int)inp.size(), inp.data());
+	dxt1.resize(idata.width * idata.height / 2);
+	CompressDXT((const byte*)inp.data(), dxt1.data(), idata.width, idata.height, FORMAT_DXT1, 0, dxtquality(quality));
+}
+
+void dxt1compress(const std::vector<const Image*> &idata, const std::vector<std::vector<BYTE>*> &dxt1,
+	DXT1Quality quality)
+{
+	// Images of equal size are compressed together, one image per thread
+	size_t i0, i1;
+	for (i0 = 0; i0 < idata.size(); i0 = i1) {
+		DWORD w = idata[i0]->width, h = idata[i0]->height;
+		for (i1 = i0 + 1; i1 < idata.size() && idata[i1]->width == w && idata[i1]->height == h; i1++);
+		int count = (int)(i1 - i0);
+
+		std::vector<DWORD> inp((size_t)count * w * h);
+		std::vector<const byte*> in(count);
+		std::vector<byte*> out(count);
+		for (int i = 0; i < count; i++) {
+			dxt1input(idata[i0 + i]->data.data(), w * h, inp.data() + i * w * h);
+			dxt1[i0 + i]->resize(w * h / 2);
+			in[i] = (const byte*)(inp.data() + i * w * h);
+			out[i] = dxt1[i0 + i]->data();
+		}
 
-	int n = CompressDXT((const byte*)inp, dxt1, idata.width, idata.height, format);
+		CompressDXTBatch(count, in.data(), out.data(), w, h, FORMAT_DXT1, NULL, 0, dxtquality(quality));
+	}
+}
 
+void dxt1compress(const Image &idata, std::vector<BYTE> &dxt1, std::vector<BYTE> &dirty,
+	DXT1Quality quality)
+{
+	// DXT1 blocks are encoded independently, so re-encoding runs of dirty
+	// blocks gives the same bytes as compressing the whole image
+	int nbx = idata.width / 4;
+	int nby = idata.height / 4;
+	std::vector<DWORD> inp(idata.width * 4);
+	std::vector<byte> out(nbx * 8);
+
+	for (int by = 0; by < nby; by++) {
+		BYTE *d = dirty.data() + by * nbx;
+		int bx0, bx1;
+		for (bx0 = 0; bx0 < nbx; bx0 = bx1) {
+			if (!d[bx0]) {
+				bx1 = bx0 + 1;
+				continue;
+			}
+			for (bx1 = bx0 + 1; bx1 < nbx && d[bx1]; bx1++);
+			int w = (bx1 - bx0) * 4;
+			for (int y = 0; y < 4; y++)
+				dxt1input(idata.data.data() + (by * 4 + y) * idata.width + bx0 * 4, w, inp.data() + y * w);
+			int n = CompressDXT((const byte*)inp.data(), out.data(), w, 4, FORMAT_DXT1, 1, dxtquality(quality));
+			memcpy(dxt1.data() + (by * nbx + bx0) * 8, out.data(), n);
+			memset(d + bx0, 0, bx1 - bx0);
+		}
+	}
+}
+
+void dxt1write(const char *fname, const Image &idata, const std::vector<BYTE> &dxt1)
+{
+	const char magic[4] = { 'D', 'D', 'S', ' ' };
 	DDS_HEADER hdr;
 	setdxt1header(idata, hdr);
 	FILE *f = fopen(fname, "wb");
 	fwrite(magic, 1, 4, f);
 	fwrite(&hdr, sizeof(DDS_HEADER), 1, f);
-	fwrite(dxt1, n, 1, f);
+	fwrite(dxt1.data(), dxt1.size(), 1, f);
 	fclose(f);
-	delete[]dxt1;
-	delete[]inp;
+}
+
+void dxt1write(const char *fname, const Image &idata, DXT1Quality quality)
+{
+	std::vector<BYTE> dxt1;
+	dxt1compress(idata, dxt1, quality);
+	dxt1write(fname, idata, dxt1);
 }
 
 bool pngread_tmp(const char *fname, Image &idata)
@@ -13,7 +13,24 @@ struct SurfPatchMetaInfo
 	int colourMatch;
 };
 
-void dxt1write(const char *fname, const Image &idata);
+void dxtUseWorkerPool();
+// run the bands and batches of the DXT compressors on the shared WorkerPool
+// (see parallel.h) rather than on threads started per call
+
+void dxt1write(const char *fname, const Image &idata, DXT1Quality quality = DXT1_FAST);
+void dxt1write(const char *fname, const Image &idata, const std::vector<BYTE> &dxt1);
+// write a DXT1 file, compressing idata or from already compressed blocks
+
+void dxt1compress(const Image &idata, std::vector<BYTE> &dxt1, DXT1Quality quality = DXT1_FAST);
+void dxt1compress(const std::vector<const Image*> &idata, const std::vector<std::vector<BYTE>*> &dxt1,
+	DXT1Quality quality = DXT1_FAST);
+// compress one image, or several images concurrently, into DXT1 blocks
+
+void dxt1compress(const Image &idata, std::vector<BYTE> &dxt1, std::vector<BYTE> &dirty,
+	DXT1Quality quality = DXT1_FAST);
+// re-encode the 4x4 blocks of idata flagged in dirty (one flag per block,
+// row by row) into the existing compressed data, and clear the flags.
+// All other blocks keep their bytes.
 
 bool pngread_tmp(const char *fname, Image &idata);
 void pngwrite_tmp(const char *fname, const Image &idata);
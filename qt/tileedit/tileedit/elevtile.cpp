@@ -6,6 +6,7 @@
 #include <algorithm>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <float.h>
 
 
 // ==================================================================================
@@ -47,7 +48,7 @@ double ElevData::nodeValue(int ix, int iy) const
 
 void ElevData::setNodeValue(int ix, int iy, double v)
 {
-	data[(ix+1) + (iy+1)*width] = v;
+	data[(ix+1) + (iy+1)*width] = (elev_t)v;
 }
 
 void ElevData::RescanLimits()
@@ -67,12 +68,12 @@ ElevData ElevData::SubTile(const std::pair<DWORD, DWORD> &xrange, const std::pai
 
 	sub.data.resize(sub.width * sub.height);
 
-	double *dataptr = data.data();
-	double *subptr = sub.data.data();
+	elev_t *dataptr = data.data();
+	elev_t *subptr = sub.data.data();
 	int y0 = TILE_FILERES - yrange.second;
 
 	for (int y = 0; y < sub.height; y++) {
-		memcpy(subptr + y*sub.width, dataptr + (y + y0) * width + xrange.first, sub.width * sizeof(double));
+		memcpy(subptr + y*sub.width, dataptr + (y + y0) * width + xrange.first, sub.width * sizeof(elev_t));
 	}
 
 	sub.dmin = *std::min_element(sub.data.begin(), sub.data.end());
@@ -84,6 +85,192 @@ ElevData ElevData::SubTile(const std::pair<DWORD, DWORD> &xrange, const std::pai
 
 // ==================================================================================
 
+elev_t ElevModData::baseValue(DWORD idx, elev_t v) const
+{
+	if (!isModified(idx))
+		return v;
+	if (m_base.size())
+		return m_base[idx];
+	auto it = std::lower_bound(m_node.begin(), m_node.end(), std::make_pair(idx, -FLT_MAX));
+	return it->second;
+}
+
+void ElevModData::setNode(DWORD idx, elev_t vbase, elev_t v, DWORD n)
+{
+	if (m_batch) {
+		if (vbase != v) {
+			if (m_mask.empty())
+				m_mask.resize(n);
+			if (m_base.empty())
+				m_base.resize(n);
+			m_mask[idx] = 1;
+			m_base[idx] = vbase;
+		}
+		else if (isModified(idx))
+			m_mask[idx] = 0;
+		return;
+	}
+
+	if (vbase != v) {
+		if (m_mask.empty())
+			m_mask.resize(n);
+		if (m_mask[idx]) {
+			auto it = std::lower_bound(m_node.begin(), m_node.end(), std::make_pair(idx, -FLT_MAX));
+			it->second = vbase;
+		}
+		else {
+			m_mask[idx] = 1;
+			if (m_node.empty() || m_node.back().first < idx) // nodes are mostly added in order
+				m_node.push_back(std::make_pair(idx, vbase));
+			else
+				m_node.insert(std::lower_bound(m_node.begin(), m_node.end(), std::make_pair(idx, -FLT_MAX)), std::make_pair(idx, vbase));
+		}
+	}
+	else if (isModified(idx)) {
+		m_mask[idx] = 0;
+		m_node.erase(std::lower_bound(m_node.begin(), m_node.end(), std::make_pair(idx, -FLT_MAX)));
+		if (m_node.empty())
+			clear();
+	}
+}
+
+void ElevModData::beginBatch()
+{
+	m_batch = true;
+	if (m_node.size()) {
+		m_base.resize(m_mask.size());
+		for (auto it = m_node.begin(); it != m_node.end(); it++)
+			m_base[it->first] = it->second;
+	}
+}
+
+void ElevModData::endBatch()
+{
+	m_batch = false;
+	if (m_base.empty())
+		return;
+	m_node.clear();
+	for (DWORD idx = 0; idx < m_mask.size(); idx++)
+		if (m_mask[idx])
+			m_node.push_back(std::make_pair(idx, m_base[idx]));
+	std::vector<elev_t>().swap(m_base);
+	if (m_node.empty())
+		clear();
+}
+
+void ElevModData::clear()
+{
+	std::vector<BYTE>().swap(m_mask);
+	std::vector<std::pair<DWORD, elev_t> >().swap(m_node);
+	std::vector<elev_t>().swap(m_base);
+}
+
+ElevModData ElevModData::SubTile(DWORD width, const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange) const
+{
+	ElevModData sub;
+	DWORD subw = xrange.second - xrange.first + 3;
+	DWORD subh = yrange.second - yrange.first + 3;
+	DWORD x0 = xrange.first;
+	DWORD y0 = TILE_FILERES - yrange.second;
+
+	for (auto it = m_node.begin(); it != m_node.end(); it++) {
+		DWORD x = it->first % width;
+		DWORD y = it->first / width;
+		if (x >= x0 && x < x0 + subw && y >= y0 && y < y0 + subh) {
+			if (sub.m_mask.empty())
+				sub.m_mask.resize(subw * subh);
+			DWORD idx = (y - y0) * subw + (x - x0);
+			sub.m_mask[idx] = 1;
+			sub.m_node.push_back(std::make_pair(idx, it->second)); // row-major order is preserved
+		}
+	}
+	return sub;
+}
+
+// ==================================================================================
+
+ElevLimits::ElevLimits()
+{
+	m_width = m_height = 0;
+	m_nx = m_ny = 0;
+	m_dmin = m_dmax = 0;
+}
+
+void ElevLimits::build(const ElevData &edata)
+{
+	m_width = edata.width;
+	m_height = edata.height;
+	m_nx = (m_width + ELEV_LIMITCELL - 1) / ELEV_LIMITCELL;
+	m_ny = (m_height + ELEV_LIMITCELL - 1) / ELEV_LIMITCELL;
+	m_cellMin.resize(m_nx * m_ny);
+	m_cellMax.resize(m_nx * m_ny);
+	m_rowMin.resize(m_ny);
+	m_rowMax.resize(m_ny);
+
+	for (int cy = 0; cy < m_ny; cy++) {
+		for (int cx = 0; cx < m_nx; cx++)
+			scanCell(edata, cx, cy);
+		reduceRow(cy);
+	}
+	reduce();
+}
+
+void ElevLimits::update(const ElevData &edata, int exmin, int exmax, int eymin, int eymax)
+{
+	if (edata.width != m_width || edata.height != m_height || edata.data.size() != m_width * m_height) {
+		build(edata);
+		return;
+	}
+
+	int cx0 = max(exmin, 0) / ELEV_LIMITCELL;
+	int cx1 = min(exmax, (int)m_width - 1) / ELEV_LIMITCELL;
+	int cy0 = max(eymin, 0) / ELEV_LIMITCELL;
+	int cy1 = min(eymax, (int)m_height - 1) / ELEV_LIMITCELL;
+
+	for (int cy = cy0; cy <= cy1; cy++) {
+		for (int cx = cx0; cx <= cx1; cx++)
+			scanCell(edata, cx, cy);
+		reduceRow(cy);
+	}
+	reduce();
+}
+
+void ElevLimits::scanCell(const ElevData &edata, int cx, int cy)
+{
+	int x0 = cx * ELEV_LIMITCELL, x1 = min(x0 + ELEV_LIMITCELL, (int)m_width);
+	int y0 = cy * ELEV_LIMITCELL, y1 = min(y0 + ELEV_LIMITCELL, (int)m_height);
+	const elev_t *e = edata.data.data();
+	elev_t vmin = e[y0 * m_width + x0];
+	elev_t vmax = vmin;
+	for (int y = y0; y < y1; y++) {
+		const elev_t *row = e + y * m_width;
+		for (int x = x0; x < x1; x++) {
+			if (row[x] < vmin) vmin = row[x];
+			if (row[x] > vmax) vmax = row[x];
+		}
+	}
+	m_cellMin[cy * m_nx + cx] = vmin;
+	m_cellMax[cy * m_nx + cx] = vmax;
+}
+
+void ElevLimits::reduceRow(int cy)
+{
+	const elev_t *cmin = m_cellMin.data() + cy * m_nx;
+	const elev_t *cmax = m_cellMax.data() + cy * m_nx;
+	m_rowMin[cy] = *std::min_element(cmin, cmin + m_nx);
+	m_rowMax[cy] = *std::max_element(cmax, cmax + m_nx);
+}
+
+void ElevLimits::reduce()
+{
+	if (m_ny) {
+		m_dmin = *std::min_element(m_rowMin.begin(), m_rowMin.end());
+		m_dmax = *std::max_element(m_rowMax.begin(), m_rowMax.end());
+	}
+}
+
+// ==================================================================================
+
 const ZTreeMgr *ElevTile::s_treeMgr = 0;
 const ZTreeMgr *ElevTile::s_treeModMgr = 0;
 
@@ -98,7 +285,7 @@ ElevTile::ElevTile(int lvl, int ilat, int ilng)
 ElevTile::ElevTile(const ElevTile &etile)
 	: Tile(etile)
 	, m_edata(etile.m_edata)
-	, m_edataBase(etile.m_edataBase)
+	, m_mod(etile.m_mod)
 {
 	m_modified = false;
 }
@@ -110,7 +297,7 @@ void ElevTile::set(const Tile *tile)
 	const ElevTile *etile = static_cast<const ElevTile*>(tile);
 	if (etile) {
 		m_edata = etile->m_edata;
-		m_edataBase = etile->m_edataBase;
+		m_mod = etile->m_mod;
 		m_waterMask = etile->m_waterMask;
 	}
 }
@@ -121,6 +308,14 @@ double ElevTile::nodeElevation(int ndx, int ndy)
 	return (double)m_edata.data[idx];
 }
 
+void ElevTile::setData(const ElevData &edata)
+{
+	for (DWORD i = 0; i < edata.data.size(); i++)
+		if (edata.data[i] != m_edata.data[i])
+			m_mod.update(i, m_edata.data[i], edata.data[i], edata.data.size());
+	m_edata = edata;
+}
+
 void ElevTile::RescanLimits()
 {
 	m_edata.RescanLimits();
@@ -128,11 +323,11 @@ void ElevTile::RescanLimits()
 
 bool ElevTile::Load(bool directOnly)
 {
-	LoadData(m_edataBase, m_lvl, m_ilat, m_ilng);
-	m_edata = m_edataBase;
+	LoadData(m_edata, m_lvl, m_ilat, m_ilng);
+	m_mod.clear();
 
 	if (m_edata.data.size()) {
-		LoadModData(m_edata, m_lvl, m_ilat, m_ilng);
+		LoadModData(m_edata, m_mod, m_lvl, m_ilat, m_ilng);
 	}
 	else if (!directOnly && s_globalLoadMode != TILELOADMODE_DIRECTONLY) {
 		// interpolate from ancestor
@@ -159,9 +354,6 @@ bool ElevTile::InterpolateFromAncestor()
 	m_edata.width = TILE_ELEVSTRIDE;
 	m_edata.height = TILE_ELEVSTRIDE;
 	m_edata.data.resize(m_edata.width * m_edata.height);
-	m_edataBase.width = TILE_ELEVSTRIDE;
-	m_edataBase.height = TILE_ELEVSTRIDE;
-	m_edataBase.data.resize(m_edataBase.width * m_edataBase.height);
 
 	bool ok = tblock->copyTile(m_ilat, m_ilng, this);
 	delete tblock;
@@ -185,19 +377,19 @@ void ElevTile::LoadData(ElevData &edata, int lvl, int ilat, int ilng)
 	}
 }
 
-void ElevTile::LoadModData(ElevData &edata, int lvl, int ilat, int ilng)
+void ElevTile::LoadModData(ElevData &edata, ElevModData &mod, int lvl, int ilat, int ilng)
 {
 	bool found = false;
 	if (s_openMode & 0x1) { // try cache
 		char path[1024];
 		sprintf(path, "%s/%s_mod/%02d/%06d/%06d.elv", s_root.c_str(), Layer().c_str(), m_lvl, m_ilat, m_ilng);
-		found = elvmodread(path, edata);
+		found = elvmodread(path, edata, mod);
 	}
 	if (!found && s_openMode & 0x2 && s_treeModMgr) { // try archive
 		BYTE *buf;
 		DWORD ndata = s_treeModMgr->ReadData(lvl, ilat, ilng, &buf);
 		if (ndata) {
-			elvmodscan(buf, ndata, edata);
+			elvmodscan(buf, ndata, edata, mod);
 			s_treeModMgr->ReleaseData(buf);
 		}
 	}
@@ -222,11 +414,11 @@ void ElevTile::LoadSubset()
 		m_subilat /= 2;
 		m_subilng /= 2;
 
-		LoadData(m_edataBase, m_sublvl, m_subilat, m_subilng);
-		if (m_edataBase.data.size()) {
-			m_edata = m_edataBase;
-			LoadModData(m_edata, m_sublvl, m_subilat, m_subilng);
-			m_edataBase = m_edataBase.SubTile(lng_subrange, lat_subrange);
+		LoadData(m_edata, m_sublvl, m_subilat, m_subilng);
+		if (m_edata.data.size()) {
+			m_mod.clear();
+			LoadModData(m_edata, m_mod, m_sublvl, m_subilat, m_subilng);
+			m_mod = m_mod.SubTile(m_edata.width, lng_subrange, lat_subrange);
 			m_edata = m_edata.SubTile(lng_subrange, lat_subrange);
 		}
 		else {
@@ -269,7 +461,7 @@ void ElevTile::SaveMod()
 		double lngmax = lngmin + 2.0*M_PI / nlng;
 		RescanLimits();
 
-		elvmodwrite(path, m_edata, m_edataBase, latmin, latmax, lngmin, lngmax);
+		elvmodwrite(path, m_edata, m_mod, latmin, latmax, lngmin, lngmax);
 		m_modified = false;
 	}
 }
@@ -362,11 +554,13 @@ bool ElevTile::mapToAncestors(int minlvl) const
 	for (int y = 0; y < edata.height; y++) {
 		for (int x = 0; x < edata.width; x++) {
 			int ref = ofs + y * 2 * w4 + x * 2;
-			double v = (edata4.data[ref] * 4.0 +
+			elev_t v = (elev_t)((edata4.data[ref] * 4.0 +
 				(edata4.data[ref - 1] + edata4.data[ref + 1] + edata4.data[ref - w4] + edata4.data[ref + w4]) * 2.0 +
-				(edata4.data[ref - w4 - 1] + edata4.data[ref - w4 + 1] + edata4.data[ref + w4 - 1] + edata4.data[ref + w4 + 1])) / 16.0;
-			if (fabs(edata.data[x + y*edata.width] - v) > eps) {
-				edata.data[x + y*edata.width] = v;
+				(edata4.data[ref - w4 - 1] + edata4.data[ref - w4 + 1] + edata4.data[ref + w4 - 1] + edata4.data[ref + w4 + 1])) / 16.0);
+			int idx = x + y*edata.width;
+			if (fabs(edata.data[idx] - v) > eps) {
+				etile->m_mod.update(idx, edata.data[idx], v, edata.data.size());
+				edata.data[idx] = v;
 				isModified = true;
 			}
 		}
@@ -393,43 +587,56 @@ TileBlock *ElevTile::ProlongToChildren() const
 	int lvl = m_lvl + 1;
 	ElevTileBlock *tblock = new ElevTileBlock(lvl, ilat0, ilat1, ilng0, ilng1);
 	ElevData &edata = tblock->getData();
-	ElevData &edataBase = tblock->getBaseData();
+	ElevModData &emod = tblock->getModData();
+	bool hasMod = !m_mod.empty();
+
+	// base values of the parent nodes, interpolated alongside the data if the parent is modified
+	auto nodeBase = [&](int ix, int iy) {
+		return (double)m_mod.baseValue((ix + 1) + (iy + 1)*m_edata.width, (elev_t)m_edata.nodeValue(ix, iy));
+	};
 
 	for (i = 0; i < edata.height; i++) {
 		ip = i - 1;
 		for (j = 0; j < edata.width; j++) {
 			idx = i*edata.width + j;
 			jp = j - 1;
+			double vb = 0.0;
 			if (!(ip & 1)) {
 				if (!(jp & 1)) {
 					edata.data[idx] = m_edata.nodeValue(jp / 2, ip / 2);
-					edataBase.data[idx] = m_edataBase.nodeValue(jp / 2, ip / 2);
+					if (hasMod)
+						vb = nodeBase(jp / 2, ip / 2);
 				}
 				else {
 					edata.data[idx] = (m_edata.nodeValue((jp - 1) / 2, ip / 2) +
 						               m_edata.nodeValue((jp + 1) / 2, ip / 2)) * 0.5;
-					edataBase.data[idx] = (m_edataBase.nodeValue((jp - 1) / 2, ip / 2) +
-						                   m_edataBase.nodeValue((jp + 1) / 2, ip / 2)) * 0.5;
+					if (hasMod)
+						vb = (nodeBase((jp - 1) / 2, ip / 2) +
+						      nodeBase((jp + 1) / 2, ip / 2)) * 0.5;
 				}
 			}
 			else {
 				if (!(jp & 1)) {
 					edata.data[idx] = (m_edata.nodeValue(jp / 2, (ip - 1) / 2) +
 						               m_edata.nodeValue(jp / 2, (ip + 1) / 2)) * 0.5;
-					edataBase.data[idx] = (m_edataBase.nodeValue(jp / 2, (ip - 1) / 2) +
-						                   m_edataBase.nodeValue(jp / 2, (ip + 1) / 2)) * 0.5;
+					if (hasMod)
+						vb = (nodeBase(jp / 2, (ip - 1) / 2) +
+						      nodeBase(jp / 2, (ip + 1) / 2)) * 0.5;
 				}
 				else {
 					edata.data[idx] = (m_edata.nodeValue((jp - 1) / 2, (ip - 1) / 2) +
 						               m_edata.nodeValue((jp + 1) / 2, (ip - 1) / 2) +
 						               m_edata.nodeValue((jp - 1) / 2, (ip + 1) / 2) +
 						               m_edata.nodeValue((jp + 1) / 2, (ip + 1) / 2)) * 0.25;
-					edataBase.data[idx] = (m_edataBase.nodeValue((jp - 1) / 2, (ip - 1) / 2) +
-						                   m_edataBase.nodeValue((jp + 1) / 2, (ip - 1) / 2) +
-						                   m_edataBase.nodeValue((jp - 1) / 2, (ip + 1) / 2) +
-						                   m_edataBase.nodeValue((jp + 1) / 2, (ip + 1) / 2)) * 0.25;
+					if (hasMod)
+						vb = (nodeBase((jp - 1) / 2, (ip - 1) / 2) +
+						      nodeBase((jp + 1) / 2, (ip - 1) / 2) +
+						      nodeBase((jp - 1) / 2, (ip + 1) / 2) +
+						      nodeBase((jp + 1) / 2, (ip + 1) / 2)) * 0.25;
 				}
 			}
+			if (hasMod)
+				emod.setNode(idx, (elev_t)vb, edata.data[idx], edata.data.size());
 		}
 	}
 	tblock->syncTiles();
@@ -7,10 +7,15 @@
 #define TILE_FILERES 256
 #define TILE_ELEVSTRIDE (TILE_FILERES+3)
 
+// Elevation sample type. The file values are 8 or 16-bit integers times a
+// power-of-2 resolution, which single precision represents exactly.
+// The elv_io kernels assume float.
+typedef float elev_t;
+
 struct ElevData {
 	DWORD width;              // elevation grid width (including padding)
 	DWORD height;             // elevation grid height (including padding)
-	std::vector<double> data; // elevation grid data [m]
+	std::vector<elev_t> data; // elevation grid data [m]
 	double dmin, dmax;        // min, max tile elevation [m]
 	double dres;              // target elevation resolution [m] (must be 2^n with integer n)
 	ElevData();
@@ -22,6 +27,74 @@ struct ElevData {
 	void RescanLimits();
 };
 
+// Sparse record of the modified nodes of an elevation grid: a per-node flag
+// plus the base (unmodified) value of each flagged node, sorted by node
+// index. A grid without modifications allocates nothing.
+class ElevModData {
+public:
+	ElevModData(): m_batch(false) {}
+	bool empty() const { return m_mask.empty(); }
+	size_t size() const { return m_node.size(); }
+	bool isModified(DWORD idx) const { return m_mask.size() && m_mask[idx]; }
+	const BYTE *mask() const { return m_mask.size() ? m_mask.data() : 0; }
+	// per-node modification flags, or 0 if no node is modified
+
+	elev_t baseValue(DWORD idx, elev_t v) const;
+	// base value of node idx with current value v
+
+	void setNode(DWORD idx, elev_t vbase, elev_t v, DWORD n);
+	// set the base value of node idx with current value v in a grid of n nodes.
+	// The node is flagged as modified if vbase != v, and unflagged otherwise.
+
+	void update(DWORD idx, elev_t vold, elev_t vnew, DWORD n) { setNode(idx, baseValue(idx, vold), vnew, n); }
+	// record a change of node idx from vold to vnew
+
+	void beginBatch();
+	void endBatch();
+	// Between these calls the base values are kept in dense per-node storage,
+	// so that nodes can be set in any order at constant cost (e.g. stitching
+	// tiles into a block). endBatch rebuilds the sorted node list. size() and
+	// SubTile only reflect the batch after endBatch.
+
+	void clear();
+	ElevModData SubTile(DWORD width, const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange) const;
+	// extract the same subrange as ElevData::SubTile from a grid of the given width
+
+private:
+	std::vector<BYTE> m_mask;
+	std::vector<std::pair<DWORD, elev_t> > m_node; // modified node index, base value
+	std::vector<elev_t> m_base; // batch mode: base value of each node (allocated on first modification)
+	bool m_batch;
+};
+
+// Hierarchical min/max summary of an elevation grid: bounds per cell of
+// ELEV_LIMITCELL x ELEV_LIMITCELL nodes, per row of cells, and overall. After an
+// edit only the cells overlapping the edited range are rescanned, and the
+// overall bounds are reduced from the cell rows.
+#define ELEV_LIMITCELL 16
+
+class ElevLimits {
+public:
+	ElevLimits();
+	void build(const ElevData &edata);
+	void update(const ElevData &edata, int exmin, int exmax, int eymin, int eymax);
+	// rescan the cells overlapping nodes exmin..exmax, eymin..eymax (inclusive,
+	// clipped to the grid). Rebuilds if the grid size has changed.
+	elev_t dmin() const { return m_dmin; }
+	elev_t dmax() const { return m_dmax; }
+
+private:
+	void scanCell(const ElevData &edata, int cx, int cy);
+	void reduceRow(int cy);
+	void reduce();
+
+	DWORD m_width, m_height; // grid size
+	int m_nx, m_ny;          // number of cells
+	std::vector<elev_t> m_cellMin, m_cellMax;
+	std::vector<elev_t> m_rowMin, m_rowMax;
+	elev_t m_dmin, m_dmax;
+};
+
 struct ElevDisplayParam {
 	CmapName cmName;
 	bool useWaterMask;
@@ -55,8 +128,9 @@ public:
 
 	ElevData &getData() { return m_edata; }
 	const ElevData &getData() const { return m_edata; }
-	ElevData &getBaseData() { return m_edataBase; }
-	const ElevData &getBaseData() const { return m_edataBase; }
+	ElevModData &getModData() { return m_mod; }
+	const ElevModData &getModData() const { return m_mod; }
+	void setData(const ElevData &edata);
 	bool isModified() const { return m_modified; }
 	void dataChanged(int exmin = -1, int exmax = -1, int eymin = -1, int eymax = -1);
 	void Save();
@@ -77,12 +151,12 @@ protected:
 	bool InterpolateFromAncestor();
 	void LoadSubset();
 	void LoadData(ElevData &edata, int lvl, int ilat, int ilng);
-	void LoadModData(ElevData &edata, int lvl, int ilat, int ilng);
+	void LoadModData(ElevData &edata, ElevModData &mod, int lvl, int ilat, int ilng);
 	void RescanLimits();
 
 private:
 	ElevData m_edata;
-	ElevData m_edataBase;
+	ElevModData m_mod;
 	bool m_modified;
 	std::vector<bool> m_waterMask;
 
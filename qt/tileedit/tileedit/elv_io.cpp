@@ -1,8 +1,11 @@
 #include <windows.h>
 #include <vector>
 #include <algorithm>
+#include <numeric>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <float.h>
+#include <emmintrin.h>
 #include <png.h>
 #include "elv_io.h"
 
@@ -24,112 +27,204 @@ struct ELEVFILEHEADER { // file header for patch elevation data file
 #pragma pack(pop)
 
 // ==================================================================================
+// Dequantisation of the tile payload: e = v*scale+offset, with the min/max of
+// the resulting tile computed in the same pass.
 
-ElevData elvread(const char *fname)
+static inline __m128i load4(const UINT8 *v)
 {
-	const int ndat = TILE_ELEVSTRIDE*TILE_ELEVSTRIDE;
-	ElevData edata;
-	ELEVFILEHEADER hdr;
-	double scale, offset;
-	int i;
+	int x;
+	memcpy(&x, v, 4);
+	__m128i zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(x), zero), zero);
+}
 
-	FILE *f = fopen(fname, "rb");
-	if (!f)
-		return edata;
+static inline __m128i load4(const INT16 *v)
+{
+	__m128i x = _mm_loadl_epi64((const __m128i*)v);
+	return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+}
 
-	int res = fread(&hdr, sizeof(ELEVFILEHEADER), 1, f);
-	if (res != 1 || strncmp(hdr.id, "ELE\01", 4))
-		return edata;
+template<typename T>
+static void dequantise(const T *v, int n, double scale, double offset, elev_t *e, double &emin, double &emax)
+{
+	// evaluated in double and rounded once, like the scalar tail
+	const __m128d s = _mm_set1_pd(scale);
+	const __m128d o = _mm_set1_pd(offset);
+	__m128 vmin = _mm_set1_ps(FLT_MAX);
+	__m128 vmax = _mm_set1_ps(-FLT_MAX);
+	int i;
 
-	if (hdr.hdrsize != sizeof(ELEVFILEHEADER)) {
-		fseek(f, hdr.hdrsize, SEEK_SET);
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i x = load4(v + i);
+		__m128d e0 = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(x), s), o);
+		__m128d e1 = _mm_add_pd(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(x, 8)), s), o);
+		__m128 e4 = _mm_movelh_ps(_mm_cvtpd_ps(e0), _mm_cvtpd_ps(e1));
+		_mm_storeu_ps(e + i, e4);
+		vmin = _mm_min_ps(vmin, e4);
+		vmax = _mm_max_ps(vmax, e4);
 	}
-	scale = hdr.scale;
-	offset = hdr.offset;
-	edata.data.resize(ndat);
-	edata.width = TILE_ELEVSTRIDE;
-	edata.height = TILE_ELEVSTRIDE;
-	double *e = edata.data.data();
+	vmin = _mm_min_ps(vmin, _mm_movehl_ps(vmin, vmin));
+	vmin = _mm_min_ss(vmin, _mm_shuffle_ps(vmin, vmin, 1));
+	vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+	vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+	emin = _mm_cvtss_f32(vmin);
+	emax = _mm_cvtss_f32(vmax);
+
+	for (; i < n; i++) {
+		e[i] = (elev_t)((double)v[i] * scale + offset);
+		if (e[i] < emin) emin = e[i];
+		if (e[i] > emax) emax = e[i];
+	}
+}
+
+static int elvpayload(const ELEVFILEHEADER &hdr)
+{
+	const int ndat = TILE_ELEVSTRIDE*TILE_ELEVSTRIDE;
+	return (hdr.dtype == 8 ? ndat * sizeof(UINT8) : hdr.dtype == -16 ? ndat * sizeof(INT16) : 0);
+}
+
+static void elvdecode(const ELEVFILEHEADER &hdr, const BYTE *data, ElevData &edata)
+{
+	const int ndat = TILE_ELEVSTRIDE*TILE_ELEVSTRIDE;
+	elev_t *e = edata.data.data();
+	double offset = hdr.offset;
+	double scale = hdr.scale;
 
 	switch (hdr.dtype) {
 	case 0:
-		for (i = 0; i < ndat; i++)
-			e[i] = offset;
+		std::fill(e, e + ndat, (elev_t)offset);
+		edata.dmin = edata.dmax = (elev_t)offset;
 		break;
 	case 8:
-		for (i = 0; i < ndat; i++) {
-			UINT8 v;
-			fread(&v, sizeof(UINT8), 1, f);
-			e[i] = (double)v * scale + offset;
-		}
+		dequantise((const UINT8*)data, ndat, scale, offset, e, edata.dmin, edata.dmax);
 		break;
 	case -16:
-		for (i = 0; i < ndat; i++) {
-			INT16 v;
-			fread(&v, sizeof(INT16), 1, f);
-			e[i] = (double)v * scale + offset;
-		}
+		dequantise((const INT16*)data, ndat, scale, offset, e, edata.dmin, edata.dmax);
+		break;
+	default:
+		edata.RescanLimits();
 		break;
 	}
-	fclose(f);
+}
 
-	edata.dmin = *std::min_element(edata.data.begin(), edata.data.end());
-	edata.dmax = *std::max_element(edata.data.begin(), edata.data.end());
-	edata.dres = scale;
+// ==================================================================================
+// Application of a mod payload to the base tile. Samples equal to 'skip' mark
+// unmodified nodes. These are the large majority, so they are skipped four at a
+// time, and only the modified nodes are written and recorded in 'mod'.
 
-	return edata;
+static inline void applymodnode(DWORD idx, elev_t v, ElevData &edata, ElevModData &mod, bool &rescan)
+{
+	elev_t &e = edata.data[idx];
+	if (v == e)
+		return;
+	if ((e == edata.dmin && v > e) || (e == edata.dmax && v < e))
+		rescan = true;
+	if (v < edata.dmin) edata.dmin = v;
+	if (v > edata.dmax) edata.dmax = v;
+	mod.update(idx, e, v, edata.data.size());
+	e = v;
 }
 
-// ==================================================================================
+template<typename T>
+static void applymod(const T *v, int n, double scale, double offset, T skip, ElevData &edata, ElevModData &mod)
+{
+	const __m128i sk = _mm_set1_epi32(skip);
+	bool rescan = false;
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		int unmod = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(load4(v + i), sk)));
+		if (unmod == 0xf)
+			continue;
+		for (int k = 0; k < 4; k++)
+			if (!(unmod & (1 << k)))
+				applymodnode(i + k, (elev_t)((double)v[i + k] * scale + offset), edata, mod, rescan);
+	}
+	for (; i < n; i++)
+		if (v[i] != skip)
+			applymodnode(i, (elev_t)((double)v[i] * scale + offset), edata, mod, rescan);
 
-bool elvmodread(const char *fname, ElevData &edata)
+	if (rescan)
+		edata.RescanLimits();
+}
+
+static void elvdecodemod(const ELEVFILEHEADER &hdr, const BYTE *data, ElevData &edata, ElevModData &mod)
 {
 	const int ndat = TILE_ELEVSTRIDE*TILE_ELEVSTRIDE;
-	ELEVFILEHEADER hdr;
-	int i;
+	bool rescan = false;
 
+	switch (hdr.dtype) {
+	case 0:
+		for (int i = 0; i < ndat; i++)
+			applymodnode(i, (elev_t)hdr.offset, edata, mod, rescan);
+		if (rescan)
+			edata.RescanLimits();
+		break;
+	case 8:
+		applymod((const UINT8*)data, ndat, hdr.scale, hdr.offset, (UINT8)UCHAR_MAX, edata, mod);
+		break;
+	case -16:
+		applymod((const INT16*)data, ndat, hdr.scale, hdr.offset, (INT16)SHRT_MAX, edata, mod);
+		break;
+	}
+}
+
+// ==================================================================================
+
+static bool elvfread(const char *fname, ELEVFILEHEADER &hdr, std::vector<BYTE> &payload)
+{
 	FILE *f = fopen(fname, "rb");
 	if (!f)
 		return false;
 
 	int res = fread(&hdr, sizeof(ELEVFILEHEADER), 1, f);
-	if (res != 1 || strncmp(hdr.id, "ELE\01", 4))
+	if (res != 1 || strncmp(hdr.id, "ELE\01", 4)) {
+		fclose(f);
 		return false;
+	}
 
 	if (hdr.hdrsize != sizeof(ELEVFILEHEADER)) {
 		fseek(f, hdr.hdrsize, SEEK_SET);
 	}
-	double *e = edata.data.data();
-	double offset = hdr.offset;
-	double scale = hdr.scale;
-
-	switch (hdr.dtype) {
-	case 0:
-		for (i = 0; i < ndat; i++)
-			e[i] = offset;
-		break;
-	case 8: 
-		for (i = 0; i < ndat; i++) {
-			UINT8 v;
-			fread(&v, sizeof(UINT8), 1, f);
-			if (v != UCHAR_MAX)
-				e[i] = (double)v * scale + offset;
-		}
-		break;
-	case -16:
-		for (i = 0; i < ndat; i++) {
-			INT16 v;
-			fread(&v, sizeof(INT16), 1, f);
-			if (v != SHRT_MAX)
-				e[i] = (double)v * scale + offset;
-		}
-		break;
-	}
+	payload.resize(elvpayload(hdr));
+	size_t nread = (payload.size() ? fread(payload.data(), 1, payload.size(), f) : 0);
 	fclose(f);
-	edata.dmin = *std::min_element(edata.data.begin(), edata.data.end());
-	edata.dmax = *std::max_element(edata.data.begin(), edata.data.end());
-	if (scale < edata.dres)
-		edata.dres = scale;
+	return nread == payload.size(); // false for a truncated file
+}
+
+// ==================================================================================
+
+ElevData elvread(const char *fname)
+{
+	ElevData edata;
+	ELEVFILEHEADER hdr;
+	std::vector<BYTE> payload;
+
+	if (!elvfread(fname, hdr, payload))
+		return edata;
+
+	edata.data.resize(TILE_ELEVSTRIDE*TILE_ELEVSTRIDE);
+	edata.width = TILE_ELEVSTRIDE;
+	edata.height = TILE_ELEVSTRIDE;
+	elvdecode(hdr, payload.data(), edata);
+	edata.dres = hdr.scale;
+
+	return edata;
+}
+
+// ==================================================================================
+
+bool elvmodread(const char *fname, ElevData &edata, ElevModData &mod)
+{
+	ELEVFILEHEADER hdr;
+	std::vector<BYTE> payload;
+
+	if (!elvfread(fname, hdr, payload))
+		return false;
+
+	elvdecodemod(hdr, payload.data(), edata, mod);
+	if (hdr.scale < edata.dres)
+		edata.dres = hdr.scale;
 
 	return true;
 }
@@ -138,11 +233,8 @@ bool elvmodread(const char *fname, ElevData &edata)
 
 ElevData elvscan(const BYTE *data, int ndata)
 {
-	const int ndat = TILE_ELEVSTRIDE*TILE_ELEVSTRIDE;
 	ElevData edata;
 	ELEVFILEHEADER hdr;
-	double scale, offset;
-	int i;
 
 	if (ndata < sizeof(ELEVFILEHEADER))
 		return edata;
@@ -151,47 +243,23 @@ ElevData elvscan(const BYTE *data, int ndata)
 	data += sizeof(ELEVFILEHEADER);
 	ndata -= sizeof(ELEVFILEHEADER);
 
-	if (strncmp(hdr.id, "ELE\01", 4) || hdr.hdrsize != sizeof(ELEVFILEHEADER))
+	if (strncmp(hdr.id, "ELE\01", 4) || hdr.hdrsize != sizeof(ELEVFILEHEADER) || ndata < elvpayload(hdr))
 		return edata;
 
-	scale = hdr.scale;
-	offset = hdr.offset;
-	edata.data.resize(ndat);
+	edata.data.resize(TILE_ELEVSTRIDE*TILE_ELEVSTRIDE);
 	edata.width = TILE_ELEVSTRIDE;
 	edata.height = TILE_ELEVSTRIDE;
-	double *e = edata.data.data();
-
-	switch (hdr.dtype) {
-	case 0:
-		for (i = 0; i < ndat; i++)
-			e[i] = offset;
-		break;
-	case 8: {
-		UINT8 *data_uint8 = (UINT8*)data;
-		for (i = 0; i < ndat; i++)
-			e[i] = (double)data_uint8[i] * scale + offset;
-		} break;
-	case -16: {
-		INT16 *data_int16 = (INT16*)data;
-		for (i = 0; i < ndat; i++)
-			e[i] = (double)data_int16[i] * scale + offset;
-		} break;
-	}
-
-	edata.dmin = *std::min_element(edata.data.begin(), edata.data.end());
-	edata.dmax = *std::max_element(edata.data.begin(), edata.data.end());
-	edata.dres = scale;
+	elvdecode(hdr, data, edata);
+	edata.dres = hdr.scale;
 
 	return edata;
 }
 
 // ==================================================================================
 
-bool elvmodscan(const BYTE*data, int ndata, ElevData &edata)
+bool elvmodscan(const BYTE*data, int ndata, ElevData &edata, ElevModData &mod)
 {
-	const int ndat = TILE_ELEVSTRIDE*TILE_ELEVSTRIDE;
 	ELEVFILEHEADER hdr;
-	int i;
 
 	if (ndata < sizeof(ELEVFILEHEADER))
 		return false;
@@ -200,124 +268,71 @@ bool elvmodscan(const BYTE*data, int ndata, ElevData &edata)
 	data += sizeof(ELEVFILEHEADER);
 	ndata -= sizeof(ELEVFILEHEADER);
 
-	if (strncmp(hdr.id, "ELE\01", 4) || hdr.hdrsize != sizeof(ELEVFILEHEADER))
+	if (strncmp(hdr.id, "ELE\01", 4) || hdr.hdrsize != sizeof(ELEVFILEHEADER) || ndata < elvpayload(hdr))
 		return false;
 
-	double *e = edata.data.data();
-	double offset = hdr.offset;
-	double scale = hdr.scale;
-
-	switch (hdr.dtype) {
-	case 0:
-		for (i = 0; i < ndat; i++)
-			e[i] = offset;
-		break;
-	case 8: {
-		UINT8 *data_uint8 = (UINT8*)data;
-		for (i = 0; i < ndat; i++) {
-			UINT8 v = data_uint8[i];
-			if (v != UCHAR_MAX)
-				e[i] = (double)v * scale + offset;
-		}
-		} break;
-	case -16: {
-		INT16 *data_int16 = (INT16*)data;
-		for (i = 0; i < ndat; i++) {
-			INT16 v = data_int16[i];
-			if (v != SHRT_MAX)
-				e[i] = (double)v * scale + offset;
-		}
-		} break;
-	}
-
-	edata.dmin = *std::min_element(edata.data.begin(), edata.data.end());
-	edata.dmax = *std::max_element(edata.data.begin(), edata.data.end());
-	if (scale < edata.dres)
-		edata.dres = scale;
+	elvdecodemod(hdr, data, edata, mod);
+	if (hdr.scale < edata.dres)
+		edata.dres = hdr.scale;
 
 	return true;
 }
 
 // ==================================================================================
+// Quantisation of the tile payload: v = (int)(e/scale)-shift, computed four
+// samples at a time. If a modification mask is given (mod files), unmodified
+// nodes are written as 'skip'. Returns the sum of the elevations.
 
-void elvwrite(const char *fname, const ElevData &edata, double latmin, double latmax, double lngmin, double lngmax)
+static inline void store4(__m128i q, UINT8 *v)
 {
-	ELEVFILEHEADER hdr;
-	strncpy(hdr.id, "ELE\01", 4);
-	hdr.hdrsize = sizeof(ELEVFILEHEADER);
-	hdr.xgrd = TILE_ELEVSTRIDE;
-	hdr.ygrd = TILE_ELEVSTRIDE;
-	hdr.xpad = 1;
-	hdr.ypad = 1;
-	hdr.latmin = latmin;
-	hdr.latmax = latmax;
-	hdr.lngmin = lngmin;
-	hdr.lngmax = lngmax;
-	hdr.emin = edata.dmin;
-	hdr.emax = edata.dmax;
-
-	hdr.emean = 0.0;
-	for (int j = hdr.ypad; j < hdr.ygrd - hdr.ypad; j++) {
-		for (int i = hdr.xpad; i < hdr.xgrd - hdr.xpad; i++) {
-			hdr.emean += edata.data[j*TILE_ELEVSTRIDE + i];
-		}
-	}
-	hdr.emean /= (hdr.xgrd - hdr.xpad * 2) * (hdr.ygrd - hdr.ypad * 2);
-
-	hdr.scale = edata.dres;
-
-	int imin = (int)(hdr.emin / hdr.scale);
-	int imax = (int)(hdr.emax / hdr.scale);
-	int shift;
+	q = _mm_and_si128(q, _mm_set1_epi32(0xff));
+	q = _mm_packus_epi16(_mm_packs_epi32(q, q), q);
+	int x = _mm_cvtsi128_si32(q);
+	memcpy(v, &x, 4);
+}
 
-	while ((imax - imin) > (1 << 16)) { // need to rescale to fit range
-		hdr.scale *= 2.0;
-		imin = (int)(hdr.emin / hdr.scale);
-		imax = (int)(hdr.emax / hdr.scale);
-	}
+static inline void store4(__m128i q, INT16 *v)
+{
+	q = _mm_srai_epi32(_mm_slli_epi32(q, 16), 16);
+	_mm_storel_epi64((__m128i*)v, _mm_packs_epi32(q, q));
+}
 
-	if (imin == imax) {
-		hdr.dtype = 0;
-		shift = imin;
-	}
-	else if (imax - imin < 256) {
-		hdr.dtype = 8;
-		if (imin >= 0 && imax < 256)
-			shift = 0;
-		else
-			shift = imin;
-	}
-	else {
-		hdr.dtype = -16;
-		if (imin >= SHRT_MIN && imax < SHRT_MAX)
-			shift = 0;
-		else
-			shift = (imin + imax) / 2;
-	}
-	hdr.offset = shift * hdr.scale;
+template<typename T>
+static double quantise(const elev_t *e, const BYTE *mask, int n, double scale, int shift, T skip, T *v)
+{
+	const __m128d s = _mm_set1_pd(scale);
+	const __m128i sh = _mm_set1_epi32(shift);
+	const __m128i sk = _mm_set1_epi32(skip);
+	__m128d sum = _mm_setzero_pd();
+	int i;
 
-	FILE *f = fopen(fname, "wb");
-	fwrite(&hdr, sizeof(ELEVFILEHEADER), 1, f);
-	if (hdr.dtype == 8) {
-		for (int i = 0; i < edata.data.size(); i++) {
-			UINT8 v = (UINT8)((int)(edata.data[i] / hdr.scale) - shift);
-			fwrite(&v, sizeof(UINT8), 1, f);
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 e4 = _mm_loadu_ps(e + i);
+		__m128d e0 = _mm_cvtps_pd(e4);
+		__m128d e1 = _mm_cvtps_pd(_mm_movehl_ps(e4, e4));
+		sum = _mm_add_pd(sum, _mm_add_pd(e0, e1));
+		__m128i q = _mm_unpacklo_epi64(_mm_cvttpd_epi32(_mm_div_pd(e0, s)), _mm_cvttpd_epi32(_mm_div_pd(e1, s)));
+		q = _mm_sub_epi32(q, sh);
+		if (mask) {
+			__m128i m = _mm_cmpeq_epi32(load4(mask + i), _mm_setzero_si128());
+			q = _mm_or_si128(_mm_and_si128(m, sk), _mm_andnot_si128(m, q));
 		}
+		store4(q, v + i);
 	}
-	else if (hdr.dtype == -16) {
-		for (int i = 0; i < edata.data.size(); i++) {
-			INT16 v = (INT16)((int)(edata.data[i] / hdr.scale) - shift);
-			fwrite(&v, sizeof(INT16), 1, f);
-		}
+	sum = _mm_add_pd(sum, _mm_unpackhi_pd(sum, sum));
+	double esum = _mm_cvtsd_f64(sum);
+
+	for (; i < n; i++) {
+		esum += e[i];
+		v[i] = (mask && !mask[i] ? skip : (T)((int)(e[i] / scale) - shift));
 	}
-	fclose(f);
+	return esum;
 }
 
-// ==================================================================================
-
-void elvmodwrite(const char *fname, const ElevData &edata, const ElevData &ebasedata, double latmin, double latmax, double lngmin, double lngmax)
+static void elvencode(const char *fname, const ElevData &edata, const ElevModData *mod,
+	double latmin, double latmax, double lngmin, double lngmax)
 {
-	const double EPS = 1e-8;
+	const int ndat = TILE_ELEVSTRIDE*TILE_ELEVSTRIDE;
 
 	ELEVFILEHEADER hdr;
 	strncpy(hdr.id, "ELE\01", 4);
@@ -333,14 +348,6 @@ void elvmodwrite(const char *fname, const ElevData &edata, const ElevData &ebase
 	hdr.emin = edata.dmin;
 	hdr.emax = edata.dmax;
 
-	hdr.emean = 0.0;
-	for (int j = hdr.ypad; j < hdr.ygrd - hdr.ypad; j++) {
-		for (int i = hdr.xpad; i < hdr.xgrd - hdr.xpad; i++) {
-			hdr.emean += edata.data[j*TILE_ELEVSTRIDE + i];
-		}
-	}
-	hdr.emean /= (hdr.xgrd - hdr.xpad * 2) * (hdr.ygrd - hdr.ypad * 2);
-
 	hdr.scale = edata.dres;
 
 	int imin = (int)(hdr.emin / hdr.scale);
@@ -373,27 +380,49 @@ void elvmodwrite(const char *fname, const ElevData &edata, const ElevData &ebase
 	}
 	hdr.offset = shift * hdr.scale;
 
-	FILE *f = fopen(fname, "wb");
-	fwrite(&hdr, sizeof(ELEVFILEHEADER), 1, f);
-	if (hdr.dtype == 8) {
-		for (int i = 0; i < edata.data.size(); i++) {
-			UINT8 v = fabs(edata.data[i] - ebasedata.data[i]) < EPS ? UCHAR_MAX :
-				(UINT8)((int)(edata.data[i] / hdr.scale) - shift);
-			fwrite(&v, sizeof(UINT8), 1, f);
-		}
-	}
-	else if (hdr.dtype == -16) {
-		for (int i = 0; i < edata.data.size(); i++) {
-			INT16 v = fabs(edata.data[i] - ebasedata.data[i]) < EPS ? SHRT_MAX :
-				(INT16)((int)(edata.data[i] / hdr.scale) - shift);
-			fwrite(&v, sizeof(INT16), 1, f);
-		}
+	// Quantise row by row into the file image, accumulating the mean
+	// elevation of the non-padding nodes in the same pass
+	std::vector<BYTE> buf(sizeof(ELEVFILEHEADER) + elvpayload(hdr));
+	BYTE *payload = buf.data() + sizeof(ELEVFILEHEADER);
+	std::vector<BYTE> nomod(mod && !mod->mask() ? TILE_ELEVSTRIDE : 0);
+	hdr.emean = 0.0;
+	for (int j = 0; j < hdr.ygrd; j++) {
+		const elev_t *e = edata.data.data() + j*TILE_ELEVSTRIDE;
+		const BYTE *b = (!mod ? 0 : mod->mask() ? mod->mask() + j*TILE_ELEVSTRIDE : nomod.data());
+		double rsum;
+		if (hdr.dtype == 8)
+			rsum = quantise(e, b, hdr.xgrd, hdr.scale, shift, (UINT8)UCHAR_MAX, (UINT8*)payload + j*TILE_ELEVSTRIDE);
+		else if (hdr.dtype == -16)
+			rsum = quantise(e, b, hdr.xgrd, hdr.scale, shift, (INT16)SHRT_MAX, (INT16*)payload + j*TILE_ELEVSTRIDE);
+		else
+			rsum = std::accumulate(e, e + hdr.xgrd, 0.0);
+		if (j >= hdr.ypad && j < hdr.ygrd - hdr.ypad)
+			hdr.emean += rsum - e[0] - e[hdr.xgrd - 1];
 	}
+	hdr.emean /= (hdr.xgrd - hdr.xpad * 2) * (hdr.ygrd - hdr.ypad * 2);
+	memcpy(buf.data(), &hdr, sizeof(ELEVFILEHEADER));
+
+	FILE *f = fopen(fname, "wb");
+	fwrite(buf.data(), 1, buf.size(), f);
 	fclose(f);
 }
 
 // ==================================================================================
 
+void elvwrite(const char *fname, const ElevData &edata, double latmin, double latmax, double lngmin, double lngmax)
+{
+	elvencode(fname, edata, 0, latmin, latmax, lngmin, lngmax);
+}
+
+// ==================================================================================
+
+void elvmodwrite(const char *fname, const ElevData &edata, const ElevModData &mod, double latmin, double latmax, double lngmin, double lngmax)
+{
+	elvencode(fname, edata, &mod, latmin, latmax, lngmin, lngmax);
+}
+
+// ==================================================================================
+
 bool elvread_png(const char *fname, const ElevPatchMetaInfo &meta, ElevData &edata)
 {
 	bool ok = false;
@@ -424,7 +453,7 @@ bool elvread_png(const char *fname, const ElevPatchMetaInfo &meta, ElevData &eda
 			for (int iw = 0; iw < w; iw++) {
 				unsigned short v16 = buf[idx++];
 				double v = (double)v16 * s + vmin;
-				edata.data[iw + ih*w] = v;
+				edata.data[iw + ih*w] = (elev_t)v;
 			}
 		}
 		delete[]buf;
@@ -16,13 +16,13 @@ struct ElevPatchMetaInfo
 };
 
 ElevData elvread(const char *fname);
-bool elvmodread(const char *fname, ElevData &edata);
+bool elvmodread(const char *fname, ElevData &edata, ElevModData &mod);
 
 ElevData elvscan(const BYTE *data, int ndata);
-bool elvmodscan(const BYTE *data, int ndata, ElevData &edata);
+bool elvmodscan(const BYTE *data, int ndata, ElevData &edata, ElevModData &mod);
 
 void elvwrite(const char *fname, const ElevData &edata, double latmin, double latmax, double lngmin, double lngmax);
-void elvmodwrite(const char *fname, const ElevData &edata, const ElevData &ebasedata, double latmin, double latmax, double lngmin, double lngmax);
+void elvmodwrite(const char *fname, const ElevData &edata, const ElevModData &mod, double latmin, double latmax, double lngmin, double lngmax);
 
 bool elvread_png(const char *fname, const ElevPatchMetaInfo &meta, ElevData &edata);
 void elvwrite_png(const char *fname, const ElevData &edata, double vmin, double vmax);
@@ -0,0 +1,327 @@
+#include "fastinflate.h"
+#include "zlib.h"
+#include <string.h>
+
+// =======================================================================
+// Huffman decoding tables
+
+namespace {
+
+const int FASTBITS = 10; // codes up to this length are resolved with a single table lookup
+const int FASTMASK = (1 << FASTBITS) - 1;
+
+const int lbase[29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+const int lext[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+const int dbase[30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+const int dext[30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+const int clorder[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+
+enum CodeType { CODE_LENGTHS, CODE_LITLEN, CODE_DIST };
+
+struct Huffman {
+	WORD fast[1 << FASTBITS]; // (length << 9) | symbol for short codes, indexed by the next FASTBITS input bits (0: use slow path)
+	int maxcode[17];          // one past the last code of each length, left-aligned to 16 bits
+	WORD firstcode[16];       // first code of each length
+	WORD firstsym[16];        // index of the first symbol of each length in 'value'
+	BYTE size[288];           // code lengths of the symbols in 'value'
+	WORD value[288];          // symbols in canonical code order
+};
+
+inline int BitReverse(int v, int bits)
+{
+	v = ((v & 0xAAAA) >> 1) | ((v & 0x5555) << 1);
+	v = ((v & 0xCCCC) >> 2) | ((v & 0x3333) << 2);
+	v = ((v & 0xF0F0) >> 4) | ((v & 0x0F0F) << 4);
+	v = ((v & 0xFF00) >> 8) | ((v & 0x00FF) << 8);
+	return v >> (16 - bits);
+}
+
+bool BuildHuffman(Huffman &h, const BYTE *lens, int n, CodeType type)
+{
+	int count[16] = { 0 };
+	int nextcode[16];
+	int i, code = 0, k = 0, left = 1, maxlen = 0;
+
+	for (i = 0; i < n; i++)
+		count[lens[i]]++;
+	for (i = 1; i < 16; i++) {
+		left = (left << 1) - count[i];
+		if (left < 0) return false; // over-subscribed code
+		if (count[i]) maxlen = i;
+		nextcode[i] = code;
+		h.firstcode[i] = (WORD)code;
+		h.firstsym[i] = (WORD)k;
+		code += count[i];
+		h.maxcode[i] = code << (16 - i);
+		code <<= 1;
+		k += count[i];
+	}
+	h.maxcode[16] = 0x10000;
+
+	// Same acceptance rules as zlib: incomplete codes are only allowed for
+	// literal/length and distance codes consisting of a single 1-bit code.
+	if (maxlen && left > 0 && (type == CODE_LENGTHS || maxlen != 1))
+		return false;
+
+	memset(h.fast, 0, sizeof(h.fast));
+	for (i = 0; i < n; i++) {
+		int s = lens[i];
+		if (!s) continue;
+		int c = nextcode[s] - h.firstcode[s] + h.firstsym[s];
+		h.size[c] = (BYTE)s;
+		h.value[c] = (WORD)i;
+		if (s <= FASTBITS) {
+			WORD f = (WORD)((s << 9) | i);
+			for (int j = BitReverse(nextcode[s], s); j < (1 << FASTBITS); j += (1 << s))
+				h.fast[j] = f;
+		}
+		nextcode[s]++;
+	}
+	return true;
+}
+
+struct FixedTables {
+	Huffman lit, dist;
+	FixedTables() {
+		BYTE lens[288];
+		int i;
+		for (i = 0; i < 144; i++) lens[i] = 8;
+		for (; i < 256; i++) lens[i] = 9;
+		for (; i < 280; i++) lens[i] = 7;
+		for (; i < 288; i++) lens[i] = 8;
+		BuildHuffman(lit, lens, 288, CODE_LITLEN);
+		for (i = 0; i < 32; i++) lens[i] = 5; // including the two unused codes
+		BuildHuffman(dist, lens, 32, CODE_DIST);
+	}
+};
+
+// =======================================================================
+// Bit stream reader. Holds up to 64 bits; zeros are supplied past the end
+// of the input, and overruns are detected by checking Consumed().
+
+struct BitReader {
+	const BYTE *inp;
+	size_t ninp;
+	size_t pos;            // next input byte to load
+	unsigned __int64 buf;  // bit buffer, next bit in the LSB
+	int cnt;               // number of valid bits in buf
+
+	inline void Refill()
+	{
+		if (pos + 8 <= ninp) {
+			// load 8 bytes at once; bits beyond cnt are the correct upcoming input bits
+			unsigned __int64 v;
+			memcpy(&v, inp + pos, 8);
+			buf |= v << cnt;
+			pos += (63 - cnt) >> 3;
+			cnt |= 56;
+		}
+		else {
+			for (; cnt <= 56; cnt += 8, pos++)
+				if (pos < ninp) buf |= (unsigned __int64)inp[pos] << cnt;
+		}
+	}
+	inline int Bits(int n)
+	{
+		if (cnt < n) Refill();
+		return BitsBuffered(n);
+	}
+	inline int BitsBuffered(int n)
+	{
+		int v = (int)(buf & ((1u << n) - 1));
+		buf >>= n;
+		cnt -= n;
+		return v;
+	}
+	inline size_t AlignToByte()
+	{
+		// drop bits up to the next byte boundary and return the position of
+		// the next unread byte; the bit buffer is emptied
+		size_t p = pos - (cnt >> 3);
+		buf = 0;
+		cnt = 0;
+		pos = p;
+		return p;
+	}
+	inline size_t Consumed() const { return pos - (cnt >> 3); }
+};
+
+inline int DecodeBuffered(BitReader &br, const Huffman &h)
+{
+	// decode a symbol, assuming the bit buffer holds at least 15 bits
+	int f = h.fast[br.buf & FASTMASK];
+	if (f) {
+		int s = f >> 9;
+		br.buf >>= s;
+		br.cnt -= s;
+		return f & 511;
+	}
+	int k = BitReverse((int)(br.buf & 0xFFFF), 16);
+	int s;
+	for (s = FASTBITS + 1; k >= h.maxcode[s]; s++);
+	if (s >= 16) return -1;
+	int c = (k >> (16 - s)) - h.firstcode[s] + h.firstsym[s];
+	if (c >= 288 || h.size[c] != s) return -1;
+	br.buf >>= s;
+	br.cnt -= s;
+	return h.value[c];
+}
+
+inline int Decode(BitReader &br, const Huffman &h)
+{
+	if (br.cnt < 16) br.Refill();
+	return DecodeBuffered(br, h);
+}
+
+bool ReadDynamicTables(BitReader &br, Huffman &lit, Huffman &dist)
+{
+	int hlit = br.Bits(5) + 257;
+	int hdist = br.Bits(5) + 1;
+	int hclen = br.Bits(4) + 4;
+	if (hlit > 286 || hdist > 30) return false;
+
+	BYTE lens[286 + 30];
+	memset(lens, 0, 19);
+	for (int i = 0; i < hclen; i++)
+		lens[clorder[i]] = (BYTE)br.Bits(3);
+	Huffman codes;
+	if (!BuildHuffman(codes, lens, 19, CODE_LENGTHS)) return false;
+
+	int n = 0, ntot = hlit + hdist;
+	while (n < ntot) {
+		int sym = Decode(br, codes);
+		if (sym < 0) return false;
+		if (sym < 16) {
+			lens[n++] = (BYTE)sym;
+		}
+		else {
+			int rep;
+			BYTE v = 0;
+			if (sym == 16) {
+				if (!n) return false;
+				v = lens[n - 1];
+				rep = 3 + br.Bits(2);
+			}
+			else if (sym == 17) rep = 3 + br.Bits(3);
+			else rep = 11 + br.Bits(7);
+			if (n + rep > ntot) return false;
+			memset(lens + n, v, rep);
+			n += rep;
+		}
+	}
+	if (!lens[256]) return false; // no end-of-block code
+	return BuildHuffman(lit, lens, hlit, CODE_LITLEN) && BuildHuffman(dist, lens + hlit, hdist, CODE_DIST);
+}
+
+bool InflateBlock(BitReader &br, const Huffman &lit, const Huffman &dist, BYTE *outp, BYTE *&op, BYTE *oend)
+{
+	// work on local copies, so that the bit buffer and output pointer can be kept in registers
+	BitReader b = br;
+	BYTE *o = op;
+	bool ok = false;
+
+	for (;;) {
+		// a length/distance pair needs at most 15+5+15+13 = 48 bits, so no
+		// further refills are required until the next symbol
+		if (b.cnt < 48) b.Refill();
+		int sym = DecodeBuffered(b, lit);
+		if (sym < 256) {
+			if (sym < 0 || o == oend) break;
+			*o++ = (BYTE)sym;
+			continue;
+		}
+		if (sym == 256) {
+			ok = true;
+			break;
+		}
+		sym -= 257;
+		if (sym >= 29) break;
+		int len = lbase[sym] + b.BitsBuffered(lext[sym]);
+		int dsym = DecodeBuffered(b, dist);
+		if (dsym < 0 || dsym >= 30) break;
+		int d = dbase[dsym] + b.BitsBuffered(dext[dsym]);
+		if (d > o - outp || len > oend - o) break;
+
+		const BYTE *src = o - d;
+		BYTE *cend = o + len;
+		if (d >= 8 && oend - cend >= 8) {
+			// 8-byte chunks don't overlap for d >= 8; the overshoot past cend
+			// stays within the buffer and is overwritten by subsequent output
+			do {
+				memcpy(o, src, 8);
+				o += 8;
+				src += 8;
+			} while (o < cend);
+		}
+		else if (d == 1) {
+			memset(o, *src, len);
+		}
+		else {
+			while (o < cend) *o++ = *src++;
+		}
+		o = cend;
+	}
+	br = b;
+	op = o;
+	return ok;
+}
+
+} // namespace
+
+// =======================================================================
+
+DWORD FastInflate(const BYTE *inp, DWORD ninp, BYTE *outp, DWORD noutp)
+{
+	static const FixedTables fixed;
+
+	// zlib header: deflate method, window size <= 32K, no preset dictionary
+	if (ninp < 6) return 0;
+	int cmf = inp[0], flg = inp[1];
+	if ((cmf & 15) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 || (flg & 0x20))
+		return 0;
+
+	BitReader br;
+	br.inp = inp;
+	br.ninp = ninp;
+	br.pos = 2;
+	br.buf = 0;
+	br.cnt = 0;
+
+	BYTE *op = outp, *oend = outp + noutp;
+	Huffman lit, dist;
+	int final;
+	do {
+		if (br.Consumed() > ninp) return 0; // truncated stream
+		final = br.Bits(1);
+		int type = br.Bits(2);
+		if (type == 0) { // stored block
+			size_t p = br.AlignToByte();
+			if (p + 4 > ninp) return 0;
+			DWORD len = inp[p] | (inp[p + 1] << 8);
+			DWORD nlen = inp[p + 2] | (inp[p + 3] << 8);
+			if (len != (~nlen & 0xFFFF)) return 0;
+			p += 4;
+			if (p + len > ninp || len > (DWORD)(oend - op)) return 0;
+			memcpy(op, inp + p, len);
+			op += len;
+			br.pos = p + len;
+		}
+		else if (type == 1) { // fixed Huffman codes
+			if (!InflateBlock(br, fixed.lit, fixed.dist, outp, op, oend)) return 0;
+		}
+		else if (type == 2) { // dynamic Huffman codes
+			if (!ReadDynamicTables(br, lit, dist)) return 0;
+			if (!InflateBlock(br, lit, dist, outp, op, oend)) return 0;
+		}
+		else return 0;
+	} while (!final);
+
+	// Adler-32 checksum of the uncompressed data, stored MSB first
+	size_t p = br.AlignToByte();
+	if (p + 4 > ninp) return 0;
+	uLong check = ((uLong)inp[p] << 24) | ((uLong)inp[p + 1] << 16) | ((uLong)inp[p + 2] << 8) | (uLong)inp[p + 3];
+	DWORD ndata = (DWORD)(op - outp);
+	if (adler32(adler32(0L, Z_NULL, 0), outp, ndata) != check)
+		return 0;
+	return ndata;
+}
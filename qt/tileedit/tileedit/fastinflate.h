@@ -0,0 +1,15 @@
+#ifndef FASTINFLATE_H
+#define FASTINFLATE_H
+
+#include <windows.h>
+
+// Single-shot decoder for zlib streams (RFC 1950/1951), for the case where
+// the complete compressed block and an output buffer of sufficient size
+// are available up front, as for tree archive nodes.
+// Returns the number of bytes written to outp, or 0 if the stream is
+// invalid, fails its checksum or doesn't fit into noutp bytes.
+// The output is identical to zlib's uncompress.
+
+DWORD FastInflate(const BYTE *inp, DWORD ninp, BYTE *outp, DWORD noutp);
+
+#endif // !FASTINFLATE_H
@@ -9,6 +9,14 @@ Image &Image::operator=(const Image &img)
 	return *this;
 }
 
+Image &Image::operator=(Image &&img)
+{
+	data = std::move(img.data);
+	width = img.width;
+	height = img.height;
+	return *this;
+}
+
 Image Image::SubImage(const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange)
 {
 	Image sub;
@@ -10,7 +10,10 @@ struct Image {
 	DWORD height;
 
 	Image() { width = height = 0; }
+	Image(const Image &img) = default;
+	Image(Image &&img) = default;
 	Image &operator=(const Image &img);
+	Image &operator=(Image &&img);
 	Image SubImage(const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange);
 };
 
@@ -0,0 +1,141 @@
+#include "nodecache.h"
+#include "ZTreeMgr.h"
+#include <string.h>
+
+#define NODECACHE_LAYERBITS 3 // bits of the layer field of a cache key
+
+static_assert(ZTreeMgr::LAYER_CLOUD < (1 << NODECACHE_LAYERBITS), "layer must fit into the cache key");
+static_assert(2 * NODEKEY_BITS + 5 + NODECACHE_LAYERBITS <= 64, "cache key must fit into 64 bits");
+
+// =======================================================================
+// NodeCache class
+
+NodeCache::NodeCache(size_t budget)
+{
+	m_budget = budget;
+	m_bytes = 0;
+	m_hits = m_misses = m_evictions = 0;
+}
+
+// -----------------------------------------------------------------------
+
+NodeCache::~NodeCache()
+{
+	clear();
+}
+
+// -----------------------------------------------------------------------
+
+unsigned __int64 NodeCache::key(int layer, int lvl, int ilat, int ilng)
+{
+	// the layer above the node key of the tile (lvl <= TREE_MAXLVL < 32)
+	return ((unsigned __int64)layer << (2 * NODEKEY_BITS + 5)) | ZTreeMgr::NodeKey(lvl, ilat, ilng);
+}
+
+// -----------------------------------------------------------------------
+
+void NodeCache::setBudget(size_t budget)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_budget = budget;
+	evict(m_budget);
+}
+
+// -----------------------------------------------------------------------
+
+bool NodeCache::get(int layer, int lvl, int ilat, int ilng, BYTE **outp, DWORD *ndata)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_map.find(key(layer, lvl, ilat, ilng));
+	if (it == m_map.end()) {
+		m_misses++;
+		return false;
+	}
+	m_hits++;
+	m_lru.splice(m_lru.begin(), m_lru, it->second); // mark as most recently used
+
+	const std::vector<BYTE> &data = it->second->data;
+	BYTE *buf = new BYTE[data.size()];
+	memcpy(buf, data.data(), data.size());
+	*outp = buf;
+	*ndata = (DWORD)data.size();
+	return true;
+}
+
+// -----------------------------------------------------------------------
+
+bool NodeCache::contains(int layer, int lvl, int ilat, int ilng) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_map.find(key(layer, lvl, ilat, ilng)) != m_map.end();
+}
+
+// -----------------------------------------------------------------------
+
+void NodeCache::put(int layer, int lvl, int ilat, int ilng, const BYTE *data, DWORD ndata)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (ndata > m_budget)
+		return;
+
+	unsigned __int64 k = key(layer, lvl, ilat, ilng);
+	auto it = m_map.find(k);
+	if (it != m_map.end()) { // replace existing entry
+		m_bytes -= it->second->data.size();
+		m_lru.erase(it->second);
+		m_map.erase(it);
+	}
+	evict(m_budget - ndata);
+
+	Entry entry;
+	entry.key = k;
+	entry.data.assign(data, data + ndata);
+	m_lru.push_front(std::move(entry));
+	m_map[k] = m_lru.begin();
+	m_bytes += ndata;
+}
+
+// -----------------------------------------------------------------------
+
+void NodeCache::evict(size_t budget)
+{
+	while (m_bytes > budget && m_lru.size()) {
+		Entry &entry = m_lru.back();
+		m_bytes -= entry.data.size();
+		m_map.erase(entry.key);
+		m_lru.pop_back();
+		m_evictions++;
+	}
+}
+
+// -----------------------------------------------------------------------
+
+void NodeCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_lru.clear();
+	m_map.clear();
+	m_bytes = 0;
+}
+
+// -----------------------------------------------------------------------
+
+NodeCache::Stats NodeCache::stats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Stats s;
+	s.hits = m_hits;
+	s.misses = m_misses;
+	s.evictions = m_evictions;
+	s.bytes = m_bytes;
+	s.entries = m_lru.size();
+	return s;
+}
+
+// -----------------------------------------------------------------------
+
+void NodeCache::resetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_hits = m_misses = m_evictions = 0;
+}
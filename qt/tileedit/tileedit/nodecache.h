@@ -0,0 +1,71 @@
+// =======================================================================
+// nodecache.h
+// Bounded LRU cache of inflated tree archive nodes.
+// =======================================================================
+
+#ifndef NODECACHE_H
+#define NODECACHE_H
+
+#include <windows.h>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+// =======================================================================
+// NodeCache class: keeps the decompressed payloads of recently read tree
+// nodes, keyed by (layer, lvl, ilat, ilng), up to a fixed memory budget.
+// All methods are thread-safe.
+
+class NodeCache {
+public:
+	struct Stats {
+		__int64 hits;      // number of successful lookups
+		__int64 misses;    // number of failed lookups
+		__int64 evictions; // number of entries dropped to stay within budget
+		size_t bytes;      // memory currently held by cached payloads
+		size_t entries;    // number of cached nodes
+	};
+
+	NodeCache(size_t budget);
+	~NodeCache();
+
+	void setBudget(size_t budget);
+	// set the memory budget [bytes]. Evicts entries if necessary.
+
+	size_t budget() const { return m_budget; }
+
+	bool get(int layer, int lvl, int ilat, int ilng, BYTE **outp, DWORD *ndata);
+	// look up a node. On a hit, a copy of the payload is returned in *outp,
+	// which the caller must free with delete[].
+
+	bool contains(int layer, int lvl, int ilat, int ilng) const;
+	// check for a node without counting a hit or miss or changing its LRU position
+
+	void put(int layer, int lvl, int ilat, int ilng, const BYTE *data, DWORD ndata);
+	// store a copy of a node payload and mark it as most recently used
+
+	void clear();
+	// drop all entries (e.g. after the archives were reopened or rebuilt)
+
+	Stats stats() const;
+	void resetStats();
+
+protected:
+	static unsigned __int64 key(int layer, int lvl, int ilat, int ilng);
+	void evict(size_t budget);
+
+private:
+	struct Entry {
+		unsigned __int64 key;
+		std::vector<BYTE> data;
+	};
+	std::list<Entry> m_lru; // front: most recently used
+	std::unordered_map<unsigned __int64, std::list<Entry>::iterator> m_map;
+	size_t m_budget;
+	size_t m_bytes;
+	__int64 m_hits, m_misses, m_evictions;
+	mutable std::mutex m_mutex;
+};
+
+#endif // !NODECACHE_H
@@ -0,0 +1,508 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "overviewcanvas.h"
+#include "ddsread.h"
+#include "elv_io.h"
+#include "QPainter"
+#include "QPaintEvent"
+#include "QResizeEvent"
+#include "QWheelEvent"
+#include "QMouseEvent"
+#include "QRunnable"
+#include "QThreadPool"
+
+#define OVERVIEW_MAXLVL TREE_MAXLVL // deepest level visited
+#define OVERVIEW_MAXEDITLVL 19     // deepest level opened in the editor (resolution spin box range)
+#define OVERVIEW_CACHESIZE 64  // default tile cache budget [MB]
+#define OVERVIEW_MINCACHE 16   // smallest tile cache budget [MB]; the current view is kept even if larger
+#define OVERVIEW_NTHREAD 2     // tile reader threads
+
+// =======================================================================
+// OverviewLoader: reads and decodes one tile on a worker thread, and passes
+// the image to the canvas slot onTileLoaded through a queued connection.
+// A null image is returned if the tile could not be decoded. Node headers
+// are validated first, so a damaged node only fails that tile.
+
+class OverviewLoader : public QRunnable
+{
+public:
+	OverviewLoader(OverviewCanvas *receiver, int generation, quint64 key, OverviewCanvas::Layer layer,
+		const ZTreeMgr *mgr, const ZTreeMgr *mgrMod, DWORD idx, int lvl, int ilat, int ilng,
+		CmapName cmName, double dmin, double dmax);
+	void run();
+
+protected:
+	QImage surfImage(const BYTE *data, DWORD ndata) const;
+	QImage elevImage(const BYTE *data, DWORD ndata) const;
+
+private:
+	OverviewCanvas *m_receiver;
+	int m_generation;
+	quint64 m_key;
+	OverviewCanvas::Layer m_layer;
+	const ZTreeMgr *m_mgr;
+	const ZTreeMgr *m_mgrMod;
+	DWORD m_idx;
+	int m_lvl, m_ilat, m_ilng;
+	CmapName m_cmName;
+	double m_dmin, m_dmax;
+};
+
+OverviewLoader::OverviewLoader(OverviewCanvas *receiver, int generation, quint64 key, OverviewCanvas::Layer layer,
+	const ZTreeMgr *mgr, const ZTreeMgr *mgrMod, DWORD idx, int lvl, int ilat, int ilng,
+	CmapName cmName, double dmin, double dmax)
+	: QRunnable()
+{
+	m_receiver = receiver;
+	m_generation = generation;
+	m_key = key;
+	m_layer = layer;
+	m_mgr = mgr;
+	m_mgrMod = mgrMod;
+	m_idx = idx;
+	m_lvl = lvl;
+	m_ilat = ilat;
+	m_ilng = ilng;
+	m_cmName = cmName;
+	m_dmin = dmin;
+	m_dmax = dmax;
+	setAutoDelete(true);
+}
+
+void OverviewLoader::run()
+{
+	// Nodes are read directly rather than through ReadData(lvl,ilat,ilng),
+	// so the overview doesn't displace the editor's blocks from the node cache.
+	QImage img;
+	BYTE *data;
+	DWORD ndata = m_mgr->ReadData(m_idx, &data);
+	if (ndata) {
+		img = (m_layer == OverviewCanvas::LAYER_SURF ? surfImage(data, ndata) : elevImage(data, ndata));
+		m_mgr->ReleaseData(data);
+	}
+	QMetaObject::invokeMethod(m_receiver, "onTileLoaded", Qt::QueuedConnection,
+		Q_ARG(int, m_generation), Q_ARG(quint64, m_key), Q_ARG(QImage, img));
+}
+
+// true if the node holds a complete DXT1 DDS image. ddsscan exits on a
+// malformed header, so the overview checks nodes before decoding them.
+static bool ddsvalid(const BYTE *data, DWORD ndata)
+{
+	const DWORD hdrsize = 128; // magic and DDS_HEADER
+	if (ndata < hdrsize || strncmp((const char*)data, "DDS ", 4) || strncmp((const char*)data + 84, "DXT1", 4))
+		return false;
+	DWORD size = *(const DWORD*)(data + 4);
+	DWORD h = *(const DWORD*)(data + 12), w = *(const DWORD*)(data + 16);
+	DWORD linsize = *(const DWORD*)(data + 20);
+	return size == hdrsize - 4 && w && h && w % 4 == 0 && h % 4 == 0
+		&& linsize >= (unsigned __int64)(w / 4) * (h / 4) * 8 && ndata - hdrsize >= linsize;
+}
+
+QImage OverviewLoader::surfImage(const BYTE *data, DWORD ndata) const
+{
+	if (!ddsvalid(data, ndata))
+		return QImage();
+	Image sdata = ddsscan(data, ndata);
+	if (!sdata.width || !sdata.height)
+		return QImage();
+
+	// box-filter down to the overview resolution
+	int f = max(1, (int)sdata.width / OVERVIEW_TILERES);
+	int w = sdata.width / f, h = sdata.height / f;
+	QImage img(w, h, QImage::Format_RGB32);
+	for (int y = 0; y < h; y++) {
+		DWORD *dst = (DWORD*)img.scanLine(y);
+		for (int x = 0; x < w; x++) {
+			DWORD r = 0, g = 0, b = 0;
+			for (int j = 0; j < f; j++) {
+				const DWORD *src = sdata.data.data() + (y * f + j) * sdata.width + x * f;
+				for (int i = 0; i < f; i++) {
+					r += (src[i] >> 16) & 0xff;
+					g += (src[i] >> 8) & 0xff;
+					b += src[i] & 0xff;
+				}
+			}
+			DWORD n = f * f;
+			dst[x] = 0xff000000 | ((r / n) << 16) | ((g / n) << 8) | (b / n);
+		}
+	}
+	return img;
+}
+
+QImage OverviewLoader::elevImage(const BYTE *data, DWORD ndata) const
+{
+	ElevData edata = elvscan(data, ndata);
+	if (edata.width < 4 || edata.height < 4)
+		return QImage();
+
+	if (m_mgrMod) {
+		DWORD idx = m_mgrMod->Idx(m_lvl, m_ilat, m_ilng);
+		if (idx < m_mgrMod->TOC().size()) {
+			BYTE *mdata;
+			DWORD nmdata = m_mgrMod->ReadData(idx, &mdata);
+			if (nmdata) {
+				ElevModData mod;
+				elvmodscan(mdata, nmdata, edata, mod);
+				m_mgrMod->ReleaseData(mdata);
+			}
+		}
+	}
+
+	// The grid has one node of padding on each side, and its rows run from
+	// south to north. Nodes are sampled at the overview resolution.
+	const Cmap &cm = cmap(m_cmName);
+	double dscale = (m_dmax > m_dmin ? 256.0 / (m_dmax - m_dmin) : 1.0);
+	int nx = edata.width - 2, ny = edata.height - 2;
+	int w = min(OVERVIEW_TILERES, nx - 1), h = min(OVERVIEW_TILERES, ny - 1);
+	QImage img(w, h, QImage::Format_RGB32);
+	for (int y = 0; y < h; y++) {
+		DWORD *dst = (DWORD*)img.scanLine(y);
+		int ey = 1 + (h - 1 - y) * (ny - 1) / (h - 1);
+		const elev_t *e = edata.data.data() + ey * edata.width;
+		for (int x = 0; x < w; x++) {
+			int ex = 1 + x * (nx - 1) / (w - 1);
+			int v = max(min((int)((e[ex] - m_dmin) * dscale), 255), 0);
+			dst[x] = 0xff000000 | cm[v];
+		}
+	}
+	return img;
+}
+
+// =======================================================================
+
+OverviewCanvas::OverviewCanvas(QWidget *parent)
+	: QWidget(parent)
+{
+	m_mgrSurf = 0;
+	m_mgrElev = 0;
+	m_mgrElevMod = 0;
+	m_layer = LAYER_SURF;
+	m_cmName = CMAP_GREY;
+	m_elevMin = 0.0;
+	m_elevMax = 1000.0;
+
+	m_cx = 1.0;
+	m_cy = 0.5;
+	m_scale = 0.0; // fit to the widget on the first resize
+	m_drag = false;
+
+	m_cacheBytes = 0;
+	m_cacheBudget = (size_t)OVERVIEW_CACHESIZE << 20;
+	m_frame = 0;
+
+	m_pool = new QThreadPool(this);
+	m_pool->setMaxThreadCount(OVERVIEW_NTHREAD);
+	m_generation = 0;
+
+	setMouseTracking(true);
+}
+
+OverviewCanvas::~OverviewCanvas()
+{
+	// the readers post their results to this object
+	m_pool->waitForDone();
+}
+
+void OverviewCanvas::setTreeMgr(const ZTreeMgr *mgrSurf, const ZTreeMgr *mgrElev, const ZTreeMgr *mgrElevMod)
+{
+	m_pool->waitForDone();
+	m_mgrSurf = mgrSurf;
+	m_mgrElev = mgrElev;
+	m_mgrElevMod = mgrElevMod;
+	resetCache();
+	update();
+}
+
+void OverviewCanvas::setLayer(Layer layer)
+{
+	if (layer != m_layer) {
+		m_layer = layer;
+		resetCache();
+		update();
+	}
+}
+
+void OverviewCanvas::setElevDisplay(CmapName cmName, double dmin, double dmax)
+{
+	if (cmName != m_cmName || dmin != m_elevMin || dmax != m_elevMax) {
+		m_cmName = cmName;
+		m_elevMin = dmin;
+		m_elevMax = dmax;
+		if (m_layer == LAYER_ELEV) {
+			resetCache();
+			update();
+		}
+	}
+}
+
+void OverviewCanvas::setCacheBudget(size_t bytes)
+{
+	m_cacheBudget = max(bytes, (size_t)OVERVIEW_MINCACHE << 20);
+	evict();
+}
+
+int OverviewCanvas::targetLevel() const
+{
+	// finest level whose tiles are not drawn larger than their image
+	int lvl = 4;
+	while (lvl < OVERVIEW_MAXLVL && m_scale / (double)(1 << (lvl - 4)) > OVERVIEW_TILERES)
+		lvl++;
+	return lvl;
+}
+
+bool OverviewCanvas::tileAt(const QPoint &p, int lvl, int &ilat, int &ilng) const
+{
+	if (lvl < 4 || m_scale <= 0.0)
+		return false;
+	double x = m_cx + (p.x() - width() * 0.5) / m_scale;
+	double y = m_cy + (p.y() - height() * 0.5) / m_scale;
+	if (x < 0.0 || x >= 2.0 || y < 0.0 || y >= 1.0)
+		return false;
+	int n = 1 << (lvl - 4);
+	ilat = (int)(y * n);
+	ilng = (int)(x * n);
+	return true;
+}
+
+QRectF OverviewCanvas::tileRect(int lvl, int ilat, int ilng) const
+{
+	// tiles of level >= 4 are squares of side 2^(4-lvl) in planet coordinates
+	double s = m_scale / (double)(1 << (lvl - 4));
+	return QRectF((ilng * s) - m_cx * m_scale + width() * 0.5, (ilat * s) - m_cy * m_scale + height() * 0.5, s, s);
+}
+
+bool OverviewCanvas::collectTiles(const ZTreeMgr *mgr, DWORD idx, int lvl, int ilat, int ilng, int tgtLvl, const QRectF &view, std::vector<TileRef> &tiles) const
+{
+	// Visible tiles with data down to the target level, parents before their
+	// children. Nodes without data may still have descendants with data.
+	// A tile whose visible part is covered by loaded descendants is left out,
+	// so it is neither drawn nor kept in the cache for this view.
+	// Returns true if the visible part of the tile is covered by loaded tiles.
+	if (!tileRect(lvl, ilat, ilng).intersects(view))
+		return true;
+	bool hasData = (mgr->NodeSizeInflated(idx) != 0);
+	size_t pos = tiles.size();
+	if (hasData)
+		tiles.push_back({ lvl, ilat, ilng, idx });
+	bool covered = (lvl < tgtLvl);
+	if (lvl < tgtLvl) {
+		const TreeNode &node = mgr->TOC()[idx];
+		for (int c = 0; c < 4; c++) {
+			int clat = ilat * 2 + (c >> 1), clng = ilng * 2 + (c & 1);
+			if (node.child[c] < mgr->TOC().size()) {
+				if (!collectTiles(mgr, node.child[c], lvl + 1, clat, clng, tgtLvl, view, tiles))
+					covered = false;
+			}
+			else if (tileRect(lvl + 1, clat, clng).intersects(view))
+				covered = false;
+		}
+	}
+	if (covered) {
+		if (hasData)
+			tiles.erase(tiles.begin() + pos);
+		return true;
+	}
+	return hasData && m_cache.count(tileKey(lvl, ilat, ilng));
+}
+
+void OverviewCanvas::paintEvent(QPaintEvent *event)
+{
+	QPainter painter(this);
+	painter.fillRect(event->rect(), Qt::black);
+
+	const ZTreeMgr *mgr = treeMgr();
+	if (!mgr || m_scale <= 0.0)
+		return;
+
+	std::vector<TileRef> tiles, missing;
+	int tgtLvl = targetLevel();
+	m_frame++;
+	for (int i = 0; i < 2; i++) {
+		DWORD idx = mgr->Idx(4, 0, i);
+		if (idx < mgr->TOC().size())
+			collectTiles(mgr, idx, 4, 0, i, tgtLvl, QRectF(rect()), tiles);
+	}
+
+	// Each tile is drawn over its parent, so a region shows the finest tile
+	// loaded so far. Only the visible part of a tile is scaled.
+	QRectF clip(event->rect());
+	for (auto &t : tiles) {
+		quint64 key = tileKey(t.lvl, t.ilat, t.ilng);
+		auto it = m_cache.find(key);
+		if (it == m_cache.end()) {
+			if (!m_failed.count(key))
+				missing.push_back(t);
+			continue;
+		}
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+		it->second->frame = m_frame;
+		const QImage &img = it->second->img;
+		QRectF r = tileRect(t.lvl, t.ilat, t.ilng);
+		QRectF vis = r & clip;
+		if (vis.isEmpty())
+			continue;
+		double sx = img.width() / r.width(), sy = img.height() / r.height();
+		QRectF src((vis.left() - r.left()) * sx, (vis.top() - r.top()) * sy, vis.width() * sx, vis.height() * sy);
+		painter.drawImage(vis, img, src);
+	}
+
+	requestTiles(missing);
+}
+
+void OverviewCanvas::requestTiles(const std::vector<TileRef> &missing)
+{
+	// Coarse tiles first, so the view fills quickly and then refines; within a
+	// level, the tiles nearest the view centre first. Requests from earlier
+	// frames that are no longer visible are dropped.
+	QPointF c(width() * 0.5, height() * 0.5);
+	std::vector<std::pair<double, TileRef> > req;
+	for (auto &t : missing) {
+		if (m_loading.count(tileKey(t.lvl, t.ilat, t.ilng)))
+			continue;
+		QPointF d = tileRect(t.lvl, t.ilat, t.ilng).center() - c;
+		req.push_back(std::make_pair(t.lvl * 1e12 + d.x() * d.x() + d.y() * d.y(), t));
+	}
+	std::sort(req.begin(), req.end(), [](const std::pair<double, TileRef> &a, const std::pair<double, TileRef> &b) { return a.first < b.first; });
+
+	m_queue.clear();
+	for (auto &r : req)
+		m_queue.push_back(r.second);
+	startLoads();
+}
+
+void OverviewCanvas::startLoads()
+{
+	// Only as many reads are started as there are reader threads, so a changed
+	// view takes effect as soon as a reader becomes free.
+	const ZTreeMgr *mgr = treeMgr();
+	const ZTreeMgr *mgrMod = (m_layer == LAYER_ELEV ? m_mgrElevMod : 0);
+	size_t n = 0;
+	while (mgr && m_loading.size() < OVERVIEW_NTHREAD && n < m_queue.size()) {
+		const TileRef &t = m_queue[n++];
+		quint64 key = tileKey(t.lvl, t.ilat, t.ilng);
+		if (m_cache.count(key) || m_loading.count(key))
+			continue;
+		m_loading.insert(key);
+		m_pool->start(new OverviewLoader(this, m_generation, key, m_layer, mgr, mgrMod, t.idx, t.lvl, t.ilat, t.ilng,
+			m_cmName, m_elevMin, m_elevMax));
+	}
+	m_queue.erase(m_queue.begin(), m_queue.begin() + n);
+}
+
+void OverviewCanvas::onTileLoaded(int generation, quint64 key, QImage img)
+{
+	if (generation != m_generation)
+		return; // archive or layer changed since the request
+
+	m_loading.erase(key);
+	if (img.isNull())
+		m_failed.insert(key);
+	else if (!m_cache.count(key)) {
+		m_lru.push_front({ key, img, m_frame }); // requested for the current view
+		m_cache[key] = m_lru.begin();
+		m_cacheBytes += img.byteCount();
+		evict();
+	}
+	startLoads();
+	update();
+}
+
+void OverviewCanvas::evict()
+{
+	// least recently drawn tiles first. The tiles of the current frame are at
+	// the front and are never evicted, so a view larger than the budget
+	// overruns it instead of evicting and reloading its own tiles.
+	while (m_cacheBytes > m_cacheBudget && m_lru.size() && m_lru.back().frame != m_frame) {
+		const CacheEntry &e = m_lru.back();
+		m_cacheBytes -= e.img.byteCount();
+		m_cache.erase(e.key);
+		m_lru.pop_back();
+	}
+}
+
+void OverviewCanvas::resetCache()
+{
+	m_generation++;
+	m_lru.clear();
+	m_cache.clear();
+	m_cacheBytes = 0;
+	m_queue.clear();
+	m_loading.clear();
+	m_failed.clear();
+}
+
+void OverviewCanvas::clampView()
+{
+	// zoom out no further than the whole planet, zoom in no further than
+	// OVERVIEW_MAXLVL, and keep the planet centred if it is smaller than the view
+	double minScale = min(width() * 0.5, (double)height());
+	double maxScale = (double)OVERVIEW_TILERES * (double)(1 << (OVERVIEW_MAXLVL - 4));
+	m_scale = max(minScale, min(maxScale, m_scale));
+
+	double hw = width() * 0.5 / m_scale, hh = height() * 0.5 / m_scale;
+	m_cx = (hw >= 1.0 ? 1.0 : max(hw, min(2.0 - hw, m_cx)));
+	m_cy = (hh >= 0.5 ? 0.5 : max(hh, min(1.0 - hh, m_cy)));
+}
+
+void OverviewCanvas::resizeEvent(QResizeEvent *event)
+{
+	clampView();
+}
+
+void OverviewCanvas::wheelEvent(QWheelEvent *event)
+{
+	// zoom by a factor sqrt(2) per wheel step, keeping the point under the
+	// cursor in place
+	double px = event->pos().x() - width() * 0.5;
+	double py = event->pos().y() - height() * 0.5;
+	double x = m_cx + px / m_scale;
+	double y = m_cy + py / m_scale;
+	m_scale *= pow(2.0, event->angleDelta().y() / 240.0);
+	clampView();
+	m_cx = x - px / m_scale;
+	m_cy = y - py / m_scale;
+	clampView();
+	update();
+	event->accept();
+}
+
+void OverviewCanvas::mousePressEvent(QMouseEvent *event)
+{
+	if (event->button() == Qt::LeftButton) {
+		m_drag = true;
+		m_dragPos = event->pos();
+	}
+}
+
+void OverviewCanvas::mouseMoveEvent(QMouseEvent *event)
+{
+	if (m_drag) {
+		QPoint d = event->pos() - m_dragPos;
+		m_dragPos = event->pos();
+		m_cx -= d.x() / m_scale;
+		m_cy -= d.y() / m_scale;
+		clampView();
+		update();
+	}
+	if (m_scale > 0.0) {
+		double x = m_cx + (event->pos().x() - width() * 0.5) / m_scale;
+		double y = m_cy + (event->pos().y() - height() * 0.5) / m_scale;
+		emit positionChanged(x * 180.0 - 180.0, 90.0 - y * 180.0, targetLevel());
+	}
+}
+
+void OverviewCanvas::mouseReleaseEvent(QMouseEvent *event)
+{
+	if (event->button() == Qt::LeftButton)
+		m_drag = false;
+}
+
+void OverviewCanvas::mouseDoubleClickEvent(QMouseEvent *event)
+{
+	// the overview zooms deeper than the editor supports
+	int lvl = min(targetLevel(), OVERVIEW_MAXEDITLVL);
+	int ilat, ilng;
+	if (event->button() == Qt::LeftButton && tileAt(event->pos(), lvl, ilat, ilng))
+		emit tileSelected(lvl, ilat, ilng);
+}
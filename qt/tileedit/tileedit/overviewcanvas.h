@@ -0,0 +1,132 @@
+#ifndef OVERVIEWCANVAS_H
+#define OVERVIEWCANVAS_H
+
+#include <windows.h>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "QWidget"
+#include "QImage"
+#include "ZTreeMgr.h"
+#include "cmap.h"
+
+class QThreadPool;
+
+#define OVERVIEW_TILERES 256 // pixel size of the tile images held by the overview cache
+
+// =======================================================================
+// OverviewCanvas class: zoomable map of a whole planet layer, built from
+// the quadtree pyramid of the layer archive. For every visible region the
+// most detailed tile loaded so far is drawn, and tiles down to the level
+// matching the zoom are requested from a worker pool, coarse to fine, so
+// the view refines progressively. Only tiles present in the archive TOC
+// are visited. Decoded tiles are kept in an LRU cache with a fixed memory
+// budget.
+
+class OverviewCanvas : public QWidget
+{
+	Q_OBJECT
+
+public:
+	enum Layer {
+		LAYER_SURF,
+		LAYER_ELEV
+	};
+
+	explicit OverviewCanvas(QWidget *parent = 0);
+	~OverviewCanvas();
+
+	void setTreeMgr(const ZTreeMgr *mgrSurf, const ZTreeMgr *mgrElev, const ZTreeMgr *mgrElevMod);
+	// set the archives to display (0: layer not available). Waits for
+	// pending tile reads, so must be called before the archives are closed.
+
+	void setLayer(Layer layer);
+	Layer layer() const { return m_layer; }
+
+	void setElevDisplay(CmapName cmName, double dmin, double dmax);
+	// colour map and elevation range [m] used for the elevation layer
+	double elevMin() const { return m_elevMin; }
+	double elevMax() const { return m_elevMax; }
+
+	void setCacheBudget(size_t bytes);
+	size_t cacheSize() const { return m_cacheBytes; }
+	// tile cache budget and current size [bytes]. The tiles of the current view
+	// are kept even if they exceed the budget.
+
+	int targetLevel() const;
+	// tile resolution level matching the current zoom
+
+	bool tileAt(const QPoint &p, int lvl, int &ilat, int &ilng) const;
+	// tile of resolution level lvl under widget position p
+
+	void paintEvent(QPaintEvent *event);
+	void resizeEvent(QResizeEvent *event);
+	void wheelEvent(QWheelEvent *event);
+	void mousePressEvent(QMouseEvent *event);
+	void mouseMoveEvent(QMouseEvent *event);
+	void mouseReleaseEvent(QMouseEvent *event);
+	void mouseDoubleClickEvent(QMouseEvent *event);
+
+public slots:
+	void onTileLoaded(int generation, quint64 key, QImage img);
+
+signals:
+	void tileSelected(int lvl, int ilat, int ilng);
+	// a tile was double-clicked
+	void positionChanged(double lng, double lat, int lvl);
+	// mouse position [deg] and target level
+
+protected:
+	struct TileRef {
+		int lvl, ilat, ilng;
+		DWORD idx;
+	};
+	const ZTreeMgr *treeMgr() const { return (m_layer == LAYER_SURF ? m_mgrSurf : m_mgrElev); }
+	bool collectTiles(const ZTreeMgr *mgr, DWORD idx, int lvl, int ilat, int ilng, int tgtLvl, const QRectF &view, std::vector<TileRef> &tiles) const;
+	QRectF tileRect(int lvl, int ilat, int ilng) const;
+	void requestTiles(const std::vector<TileRef> &missing);
+	void startLoads();
+	void resetCache();
+	void evict();
+	void clampView();
+
+	static quint64 tileKey(int lvl, int ilat, int ilng)
+	{ return ((quint64)lvl << 48) | ((quint64)ilat << 24) | (quint64)ilng; }
+
+private:
+	const ZTreeMgr *m_mgrSurf;
+	const ZTreeMgr *m_mgrElev;
+	const ZTreeMgr *m_mgrElevMod;
+	Layer m_layer;
+	CmapName m_cmName;
+	double m_elevMin, m_elevMax;
+
+	// view: planet coordinates x = [0,2] from 180W eastward, y = [0,1] from
+	// the north pole southward. m_scale is the pixel size of one unit.
+	double m_cx, m_cy;
+	double m_scale;
+	bool m_drag;
+	QPoint m_dragPos;
+
+	// LRU cache of decoded tile images, most recently used first
+	struct CacheEntry {
+		quint64 key;
+		QImage img;
+		int frame; // last frame the tile was drawn in (or requested for)
+	};
+	std::list<CacheEntry> m_lru;
+	std::unordered_map<quint64, std::list<CacheEntry>::iterator> m_cache;
+	size_t m_cacheBytes;
+	size_t m_cacheBudget;
+	int m_frame;   // paint counter; tiles of the current frame are not evicted
+
+	// tile reads
+	QThreadPool *m_pool;
+	std::vector<TileRef> m_queue; // tiles still to be requested, in request order
+	std::set<quint64> m_loading;  // tiles being read
+	std::set<quint64> m_failed;   // tiles that could not be decoded
+	int m_generation;             // discards results for a previous archive or layer
+};
+
+#endif // !OVERVIEWCANVAS_H
@@ -0,0 +1,63 @@
+#include "parallel.h"
+
+static std::atomic<int> s_nthread(0); // 0: one per core
+
+int numWorkerThreads()
+{
+	int n = s_nthread;
+	return (n > 0 ? n : numCores());
+}
+
+void setNumWorkerThreads(int n)
+{
+	s_nthread = (n > 0 ? n : 0);
+}
+
+WorkerPool &WorkerPool::instance()
+{
+	static WorkerPool pool(numCores() - 1);
+	return pool;
+}
+
+WorkerPool::WorkerPool(int nthread)
+{
+	m_stop = false;
+	for (int i = 0; i < nthread; i++)
+		m_threads.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	for (auto &t : m_threads)
+		t.join();
+}
+
+void WorkerPool::submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_cv.notify_one();
+}
+
+void WorkerPool::run()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this]() { return m_stop || m_tasks.size(); });
+			if (m_stop && !m_tasks.size())
+				return;
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,111 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+
+// Number of cores
+inline int numCores()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return (n ? (int)n : 1);
+}
+
+// Number of threads used by parallelFor by default: one per core, unless
+// limited with setNumWorkerThreads
+int numWorkerThreads();
+
+// Limit the threads used by parallelFor by default (0: one per core)
+void setNumWorkerThreads(int n);
+
+// =======================================================================
+// WorkerPool class: process-wide set of persistent worker threads running
+// queued tasks. parallelFor hands its helper tasks to the pool, so that
+// concurrent callers (e.g. the three tile block loaders) share one set of
+// threads instead of each starting one thread per core.
+
+class WorkerPool
+{
+public:
+	static WorkerPool &instance();
+	// the shared pool, with one worker less than there are cores (the
+	// threads calling parallelFor do their share of the work)
+
+	void submit(std::function<void()> task);
+	int size() const { return (int)m_threads.size(); }
+
+private:
+	WorkerPool(int nthread);
+	~WorkerPool();
+	void run();
+
+	std::vector<std::thread> m_threads;
+	std::deque<std::function<void()> > m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stop;
+};
+
+// Call func(i) for i = 0 ... n-1, distributed over up to nthread threads
+// (0: one per core). Items are handed out dynamically, so uneven work per
+// item is balanced. The calling thread takes part in the work and the
+// function returns when all items are done. Helpers run on the shared
+// WorkerPool; a helper that only starts once all items are taken returns
+// at once, so the caller never waits for queued helpers to start.
+template<typename Func>
+void parallelFor(int n, Func func, int nthread = 0)
+{
+	if (nthread <= 0) nthread = numWorkerThreads();
+	if (nthread > n) nthread = n;
+	if (nthread <= 1) {
+		for (int i = 0; i < n; i++)
+			func(i);
+		return;
+	}
+
+	struct State {
+		std::atomic<int> next;
+		int running;   // helpers inside the work loop
+		bool done;     // caller has finished; later helpers must not start
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::function<void(int)> func;
+	};
+	std::shared_ptr<State> state = std::make_shared<State>();
+	state->next = 0;
+	state->running = 0;
+	state->done = false;
+	state->func = [&func](int i) { func(i); };
+
+	WorkerPool &pool = WorkerPool::instance();
+	int nhelper = (nthread - 1 < pool.size() ? nthread - 1 : pool.size());
+	for (int t = 0; t < nhelper; t++) {
+		pool.submit([state, n]() {
+			{
+				std::lock_guard<std::mutex> lock(state->mutex);
+				if (state->done) return;
+				state->running++;
+			}
+			for (int i = state->next++; i < n; i = state->next++)
+				state->func(i);
+			std::lock_guard<std::mutex> lock(state->mutex);
+			if (!--state->running)
+				state->cv.notify_all();
+		});
+	}
+
+	for (int i = state->next++; i < n; i = state->next++)
+		func(i);
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->done = true;
+	state->cv.wait(lock, [&]() { return state->running == 0; });
+}
+
+#endif // !PARALLEL_H
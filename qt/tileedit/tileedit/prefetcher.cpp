@@ -0,0 +1,69 @@
+#include "prefetcher.h"
+
+// =======================================================================
+// Prefetcher class
+
+Prefetcher::Prefetcher()
+{
+	m_busy = false;
+	m_quit = false;
+	m_thread = std::thread(&Prefetcher::run, this);
+	SetThreadPriority(m_thread.native_handle(), THREAD_PRIORITY_BELOW_NORMAL);
+}
+
+// -----------------------------------------------------------------------
+
+Prefetcher::~Prefetcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.clear();
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+// -----------------------------------------------------------------------
+
+void Prefetcher::request(const std::vector<Item> &items)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.assign(items.begin(), items.end());
+	}
+	m_wake.notify_one();
+}
+
+// -----------------------------------------------------------------------
+
+void Prefetcher::cancel(bool wait)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_queue.clear();
+	if (wait)
+		m_idle.wait(lock, [this] { return !m_busy; });
+}
+
+// -----------------------------------------------------------------------
+
+void Prefetcher::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		m_wake.wait(lock, [this] { return m_quit || m_queue.size(); });
+		if (m_quit)
+			break;
+
+		Item item = m_queue.front();
+		m_queue.pop_front();
+		m_busy = true;
+		lock.unlock();
+
+		item.mgr->Prefetch(item.lvl, item.ilat, item.ilng);
+
+		lock.lock();
+		m_busy = false;
+		m_idle.notify_all();
+	}
+}
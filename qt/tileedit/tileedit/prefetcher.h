@@ -0,0 +1,52 @@
+// =======================================================================
+// prefetcher.h
+// Background reading of tree archive nodes into the node cache.
+// =======================================================================
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include "ZTreeMgr.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// =======================================================================
+// Prefetcher class: warms the node cache for tiles the user is likely to
+// view next, on a single low-priority worker thread.
+// Each request replaces any pending work, so a read already in progress is
+// the only work that outlives a new request.
+
+class Prefetcher {
+public:
+	struct Item {
+		const ZTreeMgr *mgr;
+		int lvl, ilat, ilng;
+	};
+
+	Prefetcher();
+	~Prefetcher();
+
+	void request(const std::vector<Item> &items);
+	// replace the pending work with a new list of tiles, processed in order
+
+	void cancel(bool wait = false);
+	// drop all pending work. If wait is true, also wait for a read in
+	// progress to finish (required before a tree manager is deleted).
+
+protected:
+	void run();
+
+private:
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;  // signalled when work arrives or on shutdown
+	std::condition_variable m_idle;  // signalled when the worker finishes an item
+	std::deque<Item> m_queue;
+	bool m_busy;                     // worker is reading an item
+	bool m_quit;
+};
+
+#endif // !PREFETCHER_H
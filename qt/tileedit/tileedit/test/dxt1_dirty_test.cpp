@@ -0,0 +1,123 @@
+// =======================================================================
+// dxt1_dirty_test.cpp
+// Test of the dirty-block DXT1 re-encode used when saving Surf and Mask
+// tiles. Random images are compressed, random pixels are changed and their
+// blocks flagged dirty, and only the dirty blocks are re-encoded into the
+// existing blocks. The result must be byte-identical to compressing the
+// changed image from scratch, clean blocks must keep their bytes, and all
+// flags must be cleared. Done for each quality tier. Also checks the batch
+// compressor against single-image compression.
+//
+// Needs QtGui (for the QColor in imagetools.cpp). Build from this
+// directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\fastdxt /I..\..\extern\libpng\include
+//        /I%QTDIR%\include /I%QTDIR%\include\QtGui dxt1_dirty_test.cpp ..\dxt_io.cpp
+//        ..\imagetools.cpp ..\parallel.cpp ..\..\extern\fastdxt\*.cpp
+//        ..\..\extern\libpng\lib\libpng16.lib %QTDIR%\lib\Qt5Gui.lib %QTDIR%\lib\Qt5Core.lib
+// Returns 0 if all checks passed.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string.h>
+#include "dxt_io.h"
+
+#define NTEST 100
+#define MAXSIZE 520   // maximum image width and height
+
+static std::mt19937 s_rng(5);
+
+// image with smooth gradients and noise, so blocks are neither flat nor random
+static Image makeImage(DWORD w, DWORD h)
+{
+	Image img;
+	img.width = w;
+	img.height = h;
+	img.data.resize(w * h);
+	DWORD c0 = s_rng(), c1 = s_rng();
+	for (DWORD y = 0; y < h; y++)
+		for (DWORD x = 0; x < w; x++) {
+			DWORD r = (((c0 >> 16) & 0xff) * x / w + ((c1 >> 16) & 0xff) * y / h + s_rng() % 16) & 0xff;
+			DWORD g = (((c0 >> 8) & 0xff) * y / h + ((c1 >> 8) & 0xff) * x / w + s_rng() % 16) & 0xff;
+			DWORD b = ((c0 & 0xff) * (x + y) / (w + h) + s_rng() % 16) & 0xff;
+			img.data[y * w + x] = 0xff000000 | (r << 16) | (g << 8) | b;
+		}
+	return img;
+}
+
+int main()
+{
+	const DXT1Quality quality[3] = { DXT1_FAST, DXT1_NORMAL, DXT1_HIGH };
+	const char *qualityName[3] = { "fast", "normal", "high" };
+	int nbad = 0;
+	dxtUseWorkerPool();
+
+	for (int q = 0; q < 3; q++) {
+		int nbadq = 0;
+		size_t ndirty = 0, nblock = 0;
+		for (int t = 0; t < NTEST; t++) {
+			DWORD w = 4 * (1 + s_rng() % (MAXSIZE / 4)), h = 4 * (1 + s_rng() % (MAXSIZE / 4));
+			Image img = makeImage(w, h);
+			std::vector<BYTE> dxt1;
+			dxt1compress(img, dxt1, quality[q]);
+			std::vector<BYTE> orig(dxt1);
+
+			// change random pixels, in scattered blocks and in runs of blocks
+			DWORD nbx = w / 4, nby = h / 4;
+			std::vector<BYTE> dirty(nbx * nby, 0);
+			int nchange = s_rng() % 200;
+			for (int k = 0; k < nchange; k++) {
+				DWORD x = s_rng() % w, y = s_rng() % h;
+				DWORD len = (k % 4 ? 1 : 1 + s_rng() % 32);
+				for (DWORD i = 0; i < len && x + i < w; i++) {
+					img.data[y * w + x + i] = 0xff000000 | s_rng();
+					dirty[(y / 4) * nbx + (x + i) / 4] = 1;
+				}
+			}
+			std::vector<BYTE> isdirty(dirty);
+			dxt1compress(img, dxt1, dirty, quality[q]);
+
+			std::vector<BYTE> full;
+			dxt1compress(img, full, quality[q]);
+			if (dxt1 != full)
+				nbadq++;
+			for (DWORD i = 0; i < nbx * nby; i++) {
+				if (dirty[i])
+					nbadq++;  // flag not cleared
+				if (!isdirty[i] && memcmp(dxt1.data() + i * 8, orig.data() + i * 8, 8))
+					nbadq++;  // clean block changed
+				ndirty += isdirty[i];
+			}
+			nblock += nbx * nby;
+		}
+		std::cout << qualityName[q] << ": " << NTEST << " images, " << ndirty << " of " << nblock
+			<< " blocks re-encoded, " << nbadq << " errors" << std::endl;
+		nbad += nbadq;
+	}
+
+	// batch compression of images of mixed sizes
+	std::vector<Image> img;
+	for (int i = 0; i < 7; i++)
+		img.push_back(makeImage(i < 4 ? 256 : 512, i < 4 ? 256 : 512));
+	std::vector<const Image*> in;
+	std::vector<std::vector<BYTE> > out(img.size());
+	std::vector<std::vector<BYTE>*> outp;
+	for (size_t i = 0; i < img.size(); i++) {
+		in.push_back(&img[i]);
+		outp.push_back(&out[i]);
+	}
+	dxt1compress(in, outp);
+	int nbadb = 0;
+	for (size_t i = 0; i < img.size(); i++) {
+		std::vector<BYTE> ref;
+		dxt1compress(img[i], ref);
+		if (out[i] != ref)
+			nbadb++;
+	}
+	std::cout << "batch: " << img.size() << " images, " << nbadb << " errors" << std::endl;
+	nbad += nbadb;
+
+	std::cout << (nbad ? "FAILED" : "passed") << std::endl;
+	return (nbad ? 1 : 0);
+}
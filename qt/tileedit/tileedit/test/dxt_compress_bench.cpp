@@ -0,0 +1,115 @@
+// =======================================================================
+// dxt_compress_bench.cpp
+// DXT1 compression throughput benchmark for fastdxt's CompressDXT (one
+// image split into bands) and CompressDXTBatch (whole images per thread),
+// with threads started per call and on the shared WorkerPool, as tileedit
+// runs them. Checks that the output is byte-identical to a single-threaded
+// compression and reports Mpixels/s for tile-sized and block-sized images.
+//
+// Standalone (no Qt). Build from this directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\fastdxt dxt_compress_bench.cpp ..\parallel.cpp
+//        ..\..\extern\fastdxt\dxt.cpp ..\..\extern\fastdxt\libdxt.cpp
+//        ..\..\extern\fastdxt\util.cpp ..\..\extern\fastdxt\intrinsic.cpp
+// Usage:
+//     dxt_compress_bench [threads]
+// Returns 0 if all outputs matched.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include "libdxt.h"
+#include "parallel.h"
+
+#define NBATCH 16        // images per batch
+#define MINPIXELS 100e6  // pixels compressed per timed run
+
+static void poolParallelFor(int n, int numthreads, void (*func)(void *arg, int i), void *arg)
+{
+	// as dxtUseWorkerPool in dxt_io.cpp
+	parallelFor(n, [func, arg](int i) { func(arg, i); }, numthreads);
+}
+
+// RGBA image with smooth terrain-like colours and some noise
+static std::vector<byte> makeImage(int w, int h, std::mt19937 &rng)
+{
+	std::vector<byte> img((size_t)w * h * 4);
+	double ph = (rng() % 1000) * 0.01;
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			double v = 0.5 + 0.25 * sin(x * 0.013 + ph) * cos(y * 0.011) + 0.1 * sin(x * 0.07 + y * 0.05 + ph);
+			byte *p = &img[((size_t)y * w + x) * 4];
+			p[0] = (byte)(v * 200 + rng() % 12);
+			p[1] = (byte)(v * 170 + 30 + rng() % 6);
+			p[2] = (byte)(v * 120 + 20 + rng() % 8);
+			p[3] = 255;
+		}
+	return img;
+}
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+	int nthread = (argc > 1 ? atoi(argv[1]) : 0);
+	const int size[3] = { 256, 512, 2048 };
+	std::mt19937 rng(1);
+	int nbad = 0;
+
+	std::cout << "threads: " << (nthread ? nthread : numCores()) << ", Mpixels/s" << std::endl;
+	std::cout << "size\tsingle\tbands\tbands(pool)\tbatch\tbatch(pool)" << std::endl;
+	for (int s = 0; s < 3; s++) {
+		int w = size[s], h = size[s];
+		size_t npix = (size_t)w * h;
+		std::vector<std::vector<byte> > img(NBATCH);
+		std::vector<std::vector<byte> > ref(NBATCH), out(NBATCH);
+		std::vector<const byte*> in(NBATCH);
+		std::vector<byte*> outp(NBATCH);
+		for (int i = 0; i < NBATCH; i++) {
+			img[i] = makeImage(w, h, rng);
+			in[i] = img[i].data();
+			ref[i].resize(npix / 2);
+			out[i].resize(npix / 2);
+			outp[i] = out[i].data();
+			SetDXTParallelFor(NULL);
+			CompressDXT(in[i], ref[i].data(), w, h, FORMAT_DXT1, 1);
+		}
+		int nrep = (int)(MINPIXELS / (npix * NBATCH)) + 1;
+		double mpix = nrep * (double)npix * NBATCH * 1e-6;
+		double t[5];
+
+		// 0: single thread, 1/2: bands, 3/4: batch; odd: threads per call, even: pool
+		for (int m = 0; m < 5; m++) {
+			SetDXTParallelFor(m == 2 || m == 4 ? poolParallelFor : NULL);
+			for (auto &o : out)
+				memset(o.data(), 0, o.size());
+			auto t0 = std::chrono::steady_clock::now();
+			for (int r = 0; r < nrep; r++) {
+				if (m < 3) {
+					for (int i = 0; i < NBATCH; i++)
+						CompressDXT(in[i], outp[i], w, h, FORMAT_DXT1, m ? nthread : 1);
+				}
+				else
+					CompressDXTBatch(NBATCH, in.data(), outp.data(), w, h, FORMAT_DXT1, NULL, nthread);
+			}
+			t[m] = seconds(t0);
+			for (int i = 0; i < NBATCH; i++)
+				if (out[i] != ref[i])
+					nbad++;
+		}
+		SetDXTParallelFor(NULL);
+
+		std::cout << w << "x" << h;
+		for (int m = 0; m < 5; m++)
+			std::cout << "\t" << (int)(mpix / t[m]);
+		std::cout << std::endl;
+	}
+	std::cout << nbad << " mismatches" << std::endl;
+	return (nbad ? 1 : 0);
+}
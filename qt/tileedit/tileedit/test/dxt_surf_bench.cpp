@@ -0,0 +1,175 @@
+// =======================================================================
+// dxt_surf_bench.cpp
+// DXT1 compression benchmark on the Surf tiles of a planet. A sample of
+// the archive's tiles is decoded and recompressed on a single thread with
+// each of fastdxt's code paths (scalar, SSE2, AVX2) and with each quality
+// tier (fast, normal, high). Checks that all paths give the same bytes and
+// reports MB/s of RGBA input and the RMSE (ComputeError) against the
+// decoded tile per path and per tier.
+//
+// Standalone (no Qt). Build from this directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\zlib\include /I..\..\extern\fastdxt dxt_surf_bench.cpp
+//        ..\ZTreeMgr.cpp ..\nodecache.cpp ..\fastinflate.cpp ..\dxt1decode.cpp
+//        ..\..\extern\fastdxt\dxt.cpp ..\..\extern\fastdxt\libdxt.cpp ..\..\extern\fastdxt\util.cpp
+//        ..\..\extern\fastdxt\intrinsic.cpp ..\..\extern\zlib\lib\zdll.lib
+// Usage:
+//     dxt_surf_bench <planet dir> [max tiles]
+// Returns 0 if all paths gave the same output.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+#include "ZTreeMgr.h"
+#include "dxt1decode.h"
+#include "libdxt.h"
+
+#define MAXTILES 200     // default sample size
+#define MINBYTES 200e6   // RGBA bytes compressed per timed run (repeats the sample)
+#define DDS_HDRSIZE 128  // magic and DDS_HEADER
+
+struct SurfTile {
+	int w, h;
+	std::vector<byte> rgba;  // decoded tile, compressor input
+};
+
+// decode a DXT1 DDS node into RGBA; false if it isn't one
+static bool decodeNode(const BYTE *data, DWORD ndata, SurfTile &tile)
+{
+	if (ndata < DDS_HDRSIZE || strncmp((const char*)data, "DDS ", 4) || strncmp((const char*)data + 84, "DXT1", 4))
+		return false;
+	DWORD h = *(const DWORD*)(data + 12), w = *(const DWORD*)(data + 16);
+	if (!w || !h || w % 4 || h % 4 || ndata < DDS_HDRSIZE + w * h / 2)
+		return false;
+	std::vector<DWORD> argb(w * h);
+	DecodeDXT1((const WORD*)(data + DDS_HDRSIZE), w, h, argb.data());
+	tile.w = w;
+	tile.h = h;
+	tile.rgba.resize(w * h * 4);
+	for (DWORD i = 0; i < w * h; i++) {
+		tile.rgba[i * 4 + 0] = (byte)(argb[i] >> 16);
+		tile.rgba[i * 4 + 1] = (byte)(argb[i] >> 8);
+		tile.rgba[i * 4 + 2] = (byte)argb[i];
+		tile.rgba[i * 4 + 3] = 255;
+	}
+	return true;
+}
+
+// RMSE of compressed blocks against the compressor input
+static double rmse(const SurfTile &tile, const std::vector<byte> &dxt)
+{
+	// ComputeError expects the decoded image as bottom-up RGB
+	int w = tile.w, h = tile.h;
+	std::vector<DWORD> argb(w * h);
+	DecodeDXT1((const WORD*)dxt.data(), w, h, argb.data());
+	std::vector<byte> rgb(w * h * 3);
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			DWORD c = argb[y * w + x];
+			byte *p = &rgb[((h - 1 - y) * w + x) * 3];
+			p[0] = (byte)(c >> 16);
+			p[1] = (byte)(c >> 8);
+			p[2] = (byte)c;
+		}
+	return ComputeError(tile.rgba.data(), rgb.data(), w, h);
+}
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: dxt_surf_bench <planet dir> [max tiles]" << std::endl;
+		return 2;
+	}
+	size_t maxtiles = (argc > 2 ? (size_t)atoi(argv[2]) : MAXTILES);
+	ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(argv[1], ZTreeMgr::LAYER_SURF);
+	if (!mgr) {
+		std::cerr << "Could not open the Surf archive" << std::endl;
+		return 2;
+	}
+
+	// a random sample of the archive's DXT1 tiles
+	std::vector<ZTreeMgr::NodeRef> nodes;
+	mgr->Nodes(nodes);
+	std::mt19937 rng(1);
+	std::shuffle(nodes.begin(), nodes.end(), rng);
+	std::vector<SurfTile> tiles;
+	double nbytes = 0;
+	for (size_t i = 0; i < nodes.size() && tiles.size() < maxtiles; i++) {
+		BYTE *data;
+		DWORD ndata = mgr->ReadData(nodes[i].idx, &data);
+		SurfTile tile;
+		if (ndata && decodeNode(data, ndata, tile)) {
+			nbytes += tile.rgba.size();
+			tiles.push_back(tile);
+		}
+		if (ndata)
+			mgr->ReleaseData(data);
+	}
+	delete mgr;
+	if (!tiles.size()) {
+		std::cerr << "No DXT1 tiles found in the Surf archive" << std::endl;
+		return 2;
+	}
+	int nrep = (int)(MINBYTES / nbytes) + 1;
+
+	const int path[3] = { DXT_PATH_SCALAR, DXT_PATH_SSE2, DXT_PATH_AVX2 };
+	const char *pathName[3] = { "scalar", "SSE2", "AVX2" };
+	std::vector<std::vector<byte> > ref(tiles.size()), out(tiles.size());
+	for (size_t i = 0; i < tiles.size(); i++)
+		out[i].resize(tiles[i].rgba.size() / 8);
+	int nbad = 0;
+
+	std::cout << tiles.size() << " Surf tiles, single thread" << std::endl;
+	for (int p = 0; p < 3; p++) {
+		SetDXTPath(path[p]);
+		if (GetDXTPath() != path[p]) {
+			std::cout << pathName[p] << ": not supported by the CPU" << std::endl;
+			continue;
+		}
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < nrep; r++)
+			for (size_t i = 0; i < tiles.size(); i++)
+				CompressDXT(tiles[i].rgba.data(), out[i].data(), tiles[i].w, tiles[i].h, FORMAT_DXT1, 1);
+		double t = seconds(t0);
+
+		double err = 0;
+		for (size_t i = 0; i < tiles.size(); i++) {
+			err += rmse(tiles[i], out[i]);
+			if (!ref[i].size())
+				ref[i] = out[i];
+			else if (out[i] != ref[i])
+				nbad++;
+		}
+		std::cout << pathName[p] << ": " << (int)(nrep * nbytes * 1e-6 / t) << " MB/s, RMSE "
+			<< err / tiles.size() << std::endl;
+	}
+	SetDXTPath(DXT_PATH_AUTO);
+
+	// quality tiers, on the best path
+	const int quality[3] = { DXT_QUALITY_FAST, DXT_QUALITY_NORMAL, DXT_QUALITY_HIGH };
+	const char *qualityName[3] = { "fast", "normal", "high" };
+	for (int q = 0; q < 3; q++) {
+		int nrepq = (quality[q] == DXT_QUALITY_FAST ? nrep : 1); // the slower tiers run the sample once
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < nrepq; r++)
+			for (size_t i = 0; i < tiles.size(); i++)
+				CompressDXT(tiles[i].rgba.data(), out[i].data(), tiles[i].w, tiles[i].h, FORMAT_DXT1, 1, quality[q]);
+		double t = seconds(t0);
+
+		double err = 0;
+		for (size_t i = 0; i < tiles.size(); i++)
+			err += rmse(tiles[i], out[i]);
+		std::cout << qualityName[q] << ": " << (int)(nrepq * nbytes * 1e-6 / t) << " MB/s, RMSE "
+			<< err / tiles.size() << std::endl;
+	}
+	std::cout << nbad << " mismatches" << std::endl;
+	return (nbad ? 1 : 0);
+}
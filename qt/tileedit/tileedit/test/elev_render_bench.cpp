@@ -0,0 +1,142 @@
+// =======================================================================
+// elev_render_bench.cpp
+// Elevation colour map rendering benchmark for ElevTileBlock::ExtractImage
+// in elevation and modification mode, for blocks of 1x1 to 8x8 tiles with
+// synthetic terrain and a random set of modified nodes. Checks the images,
+// full and for random partial ranges, against a per-pixel reference
+// renderer and reports full-image frames per second.
+//
+// Needs QtGui (for the QColor in imagetools.cpp). Build from this
+// directory with the sources and libraries listed in
+// tileblock_load_bench.cpp, replacing tileblock_load_bench.cpp by
+// elev_render_bench.cpp.
+// Returns 0 if all images matched the reference.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <math.h>
+#include "tileblock.h"
+
+#define LEVEL 10       // tile level of the blocks
+#define MAXBLOCK 8     // largest block size (tiles per side)
+#define NPARTIAL 20    // partial ranges checked per block and mode
+#define MINTIME 1.0    // seconds per timed run
+#define MODFRAC 0.1    // fraction of nodes modified
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// per-pixel rendering of a node range, as ExtractImage/ExtractModImage
+// did before the row renderer (without water mask)
+static void reference(const ElevData &edata, const BYTE *modMask, bool modMode, const ElevDisplayParam &param,
+	Image &img, int exmin, int exmax, int eymin, int eymax)
+{
+	img.width = (edata.width - 2) * 2 - 2;
+	img.height = (edata.height - 2) * 2 - 2;
+	img.data.resize(img.width * img.height);
+	double dmin = (param.autoRange ? edata.dmin : param.rangeMin);
+	double dmax = (param.autoRange ? edata.dmax : param.rangeMax);
+	double dscale = (dmax > dmin ? 256.0 / (dmax - dmin) : 1.0);
+	int imin = (exmin < 0 ? 0 : max(0, (exmin - 1) * 2 - 1));
+	int imax = (exmax < 0 ? img.width : min((int)img.width, exmax * 2));
+	int jmin = (eymax < 0 ? 0 : max(0, (int)img.height - (eymax - 1) * 2));
+	int jmax = (eymin < 0 ? img.height : min((int)img.height, (int)img.height - (eymin - 1) * 2 + 1));
+	const Cmap &cm = cmap(param.cmName);
+
+	for (int j = jmin; j < jmax; j++)
+		for (int i = imin; i < imax; i++) {
+			int ex = (i + 1) / 2 + 1;
+			int ey = (img.height - j) / 2 + 1;
+			if (!modMode || (modMask && modMask[ex + ey * edata.width])) {
+				double d = edata.data[ex + ey * edata.width];
+				int v = max(min((int)((d - dmin) * dscale), 255), 0);
+				img.data[i + j * img.width] = (0xff000000 | cm[v]);
+			}
+			else {
+				bool b = (i / 8 + j / 8) & 1;
+				img.data[i + j * img.width] = (b ? 0xff808080 : 0xff909090);
+			}
+		}
+}
+
+// synthetic terrain, with a few nodes far outside the display range
+static ElevData makeTerrain(DWORD w, DWORD h, std::mt19937 &rng)
+{
+	ElevData edata;
+	edata.width = w;
+	edata.height = h;
+	edata.data.resize(w * h);
+	edata.dres = 0.5;
+	double ph = (rng() % 1000) * 0.01;
+	for (DWORD y = 0; y < h; y++)
+		for (DWORD x = 0; x < w; x++)
+			edata.data[y * w + x] = (elev_t)(floor(2000.0 * sin(x * 0.01 + ph) * cos(y * 0.013) + 300.0 * sin(x * 0.07 + y * 0.05)) + (rng() % 8) * 0.5);
+	for (int k = 0; k < 100; k++)
+		edata.data[rng() % (w * h)] = (elev_t)(k & 1 ? 1e30 : -1e30);
+	edata.RescanLimits();
+	return edata;
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	ElevDisplayParam param;
+	param.cmName = CMAP_TOPO1;
+	param.autoRange = false;
+	param.rangeMin = -2500.0;
+	param.rangeMax = 2500.0;
+	ElevTileBlock::setElevDisplayParam(&param);
+	int nbad = 0;
+
+	std::cout << "full-image frames per second" << std::endl;
+	std::cout << "block\televation\tmodification" << std::endl;
+	for (int bs = 1; bs <= MAXBLOCK; bs++) {
+		ElevTileBlock block(LEVEL, 0, bs, 0, bs);
+		ElevData &edata = block.getData();
+		edata = makeTerrain(edata.width, edata.height, rng);
+		block.getModData().clear();
+		ElevData moddata(edata);
+		for (DWORD k = 0; k < (DWORD)(moddata.data.size() * MODFRAC); k++)
+			moddata.data[rng() % moddata.data.size()] += 10.0f;
+		block.setData(moddata);
+
+		double fps[2];
+		for (int m = 0; m < 2; m++) {
+			TileMode mode = (m ? TILEMODE_ELEVMOD : TILEMODE_ELEVATION);
+			const BYTE *modMask = block.getModData().mask();
+			Image img, ref;
+
+			// full image and random partial ranges; partial ranges render into
+			// the image of the previous check, as the editor does after a stroke
+			block.ExtractImage(img, mode);
+			reference(moddata, modMask, m == 1, param, ref, -1, -1, -1, -1);
+			if (img.data != ref.data)
+				nbad++;
+			for (int p = 0; p < NPARTIAL; p++) {
+				int exmin = rng() % (moddata.width - 2) + 1, exmax = exmin + rng() % (moddata.width - exmin);
+				int eymin = rng() % (moddata.height - 2) + 1, eymax = eymin + rng() % (moddata.height - eymin);
+				block.ExtractImage(img, mode, exmin, exmax, eymin, eymax);
+				reference(moddata, modMask, m == 1, param, ref, exmin, exmax, eymin, eymax);
+				if (img.data != ref.data)
+					nbad++;
+			}
+
+			int nframe = 0;
+			auto t0 = std::chrono::steady_clock::now();
+			double t;
+			do {
+				block.ExtractImage(img, mode);
+				nframe++;
+			} while ((t = seconds(t0)) < MINTIME);
+			fps[m] = nframe / t;
+		}
+		std::cout << bs << "x" << bs << "\t" << fps[0] << "\t\t" << fps[1] << std::endl;
+	}
+	std::cout << nbad << " mismatches" << std::endl;
+	return (nbad ? 1 : 0);
+}
@@ -0,0 +1,144 @@
+// =======================================================================
+// elv_read_bench.cpp
+// Elevation tile read benchmark. A sample of the Elev archive's tiles of
+// a planet is read through the archive path (ZTreeMgr::ReadData and
+// elvscan) and, after being written to a scratch directory as cache
+// files, through the file path (elvread). Checks that both paths give the
+// same elevations and that a truncated file is rejected, and reports
+// tiles/s per path.
+//
+// Needs QtGui (for the QColor in imagetools.cpp). Build from this
+// directory with the sources and libraries listed in
+// tileblock_load_bench.cpp, replacing tileblock_load_bench.cpp by
+// elv_read_bench.cpp.
+// Usage:
+//     elv_read_bench <planet dir> <scratch dir> [max tiles]
+// The scratch directory must not exist yet. Returns 0 if all checks passed.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+#include <direct.h>
+#include "elv_io.h"
+
+#define MAXTILES 500  // default sample size
+#define NREP 5        // repetitions of each timed run
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static bool same(const ElevData &a, const ElevData &b)
+{
+	return a.data == b.data && a.dmin == b.dmin && a.dmax == b.dmax && a.dres == b.dres;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		std::cerr << "Usage: elv_read_bench <planet dir> <scratch dir> [max tiles]" << std::endl;
+		return 2;
+	}
+	std::string scratch(argv[2]);
+	size_t maxtiles = (argc > 3 ? (size_t)atoi(argv[3]) : MAXTILES);
+	ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(argv[1], ZTreeMgr::LAYER_ELEV);
+	if (!mgr) {
+		std::cerr << "Could not open the Elev archive" << std::endl;
+		return 2;
+	}
+	if (_mkdir(scratch.c_str())) {
+		std::cerr << "Could not create " << scratch << " (it must not exist yet)" << std::endl;
+		delete mgr;
+		return 2;
+	}
+
+	// a random sample of the archive's tiles, written to the scratch directory
+	std::vector<ZTreeMgr::NodeRef> nodes;
+	mgr->Nodes(nodes);
+	std::mt19937 rng(1);
+	std::shuffle(nodes.begin(), nodes.end(), rng);
+	if (nodes.size() > maxtiles)
+		nodes.resize(maxtiles);
+	std::vector<std::string> fnames;
+	std::vector<ElevData> ref;
+	char path[1024];
+	for (size_t i = 0; i < nodes.size(); i++) {
+		BYTE *buf;
+		DWORD ndata = mgr->ReadData(nodes[i].idx, &buf);
+		if (!ndata)
+			continue;
+		ElevData edata = elvscan(buf, ndata);
+		if (edata.data.size()) {
+			sprintf(path, "%s/%02d_%06d_%06d.elv", scratch.c_str(), nodes[i].lvl, nodes[i].ilat, nodes[i].ilng);
+			FILE *f = fopen(path, "wb");
+			fwrite(buf, 1, ndata, f);
+			fclose(f);
+			fnames.push_back(path);
+			ref.push_back(edata);
+		}
+		else
+			nodes[i].lvl = -1;
+		mgr->ReleaseData(buf);
+	}
+	nodes.erase(std::remove_if(nodes.begin(), nodes.end(), [](const ZTreeMgr::NodeRef &n) { return n.lvl < 0; }), nodes.end());
+	if (!nodes.size()) {
+		std::cerr << "No elevation tiles found in the Elev archive" << std::endl;
+		delete mgr;
+		return 2;
+	}
+
+	int nbad = 0;
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (!same(elvread(fnames[i].c_str()), ref[i]))
+			nbad++;
+
+	// a truncated file must not be read
+	{
+		FILE *f = fopen(fnames[0].c_str(), "rb");
+		std::vector<BYTE> data(1 << 20);
+		data.resize(fread(data.data(), 1, data.size(), f));
+		fclose(f);
+		std::string tname = scratch + "/truncated.elv";
+		f = fopen(tname.c_str(), "wb");
+		fwrite(data.data(), 1, data.size() - 1, f);
+		fclose(f);
+		if (elvread(tname.c_str()).data.size()) {
+			std::cout << "truncated file was read" << std::endl;
+			nbad++;
+		}
+	}
+
+	// archive path, as ElevTile::LoadData: lookup, inflate and decode
+	auto t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &n : nodes) {
+			BYTE *buf;
+			DWORD ndata = mgr->ReadData(n.lvl, n.ilat, n.ilng, &buf);
+			if (ndata) {
+				ElevData edata = elvscan(buf, ndata);
+				mgr->ReleaseData(buf);
+			}
+		}
+	double tArchive = seconds(t0);
+
+	// file path
+	t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &fname : fnames)
+			ElevData edata = elvread(fname.c_str());
+	double tFile = seconds(t0);
+
+	double n = (double)NREP * nodes.size();
+	std::cout << nodes.size() << " Elev tiles" << std::endl;
+	std::cout << "archive: " << (int)(n / tArchive) << " tiles/s" << std::endl;
+	std::cout << "file:    " << (int)(n / tFile) << " tiles/s" << std::endl;
+	std::cout << nbad << " mismatches" << std::endl;
+	delete mgr;
+	return (nbad ? 1 : 0);
+}
@@ -0,0 +1,154 @@
+// =======================================================================
+// elv_write_bench.cpp
+// Elevation tile write benchmark. A sample of the Elev archive's tiles of
+// a planet is written to a scratch directory with elvwrite, and with
+// elvmodwrite after modifying a random subset of nodes, as when saving an
+// edited block. Checks that the files read back (elvread, elvmodread) to
+// the written elevations and reports tiles/s per writer.
+//
+// Needs QtGui (for the QColor in imagetools.cpp). Build from this
+// directory with the sources and libraries listed in
+// tileblock_load_bench.cpp, replacing tileblock_load_bench.cpp by
+// elv_write_bench.cpp.
+// Usage:
+//     elv_write_bench <planet dir> <scratch dir> [max tiles]
+// The scratch directory must not exist yet. Returns 0 if all checks passed.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+#include <direct.h>
+#include "elv_io.h"
+
+#define MAXTILES 500  // default sample size
+#define NREP 5        // repetitions of each timed run
+#define MODFRAC 0.05  // fraction of nodes modified for elvmodwrite
+
+struct ElevSample {
+	int lvl, ilat, ilng;
+	ElevData base;    // tile as read from the archive
+	ElevData edata;   // modified tile
+	ElevModData mod;  // modification record of edata against base
+	std::string fname, modfname;
+};
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void tileRange(const ElevSample &s, double &latmin, double &latmax, double &lngmin, double &lngmax)
+{
+	int nlat = 1 << (s.lvl - 4), nlng = 1 << (s.lvl - 3);
+	latmax = 90.0 - 180.0 * s.ilat / nlat;
+	latmin = latmax - 180.0 / nlat;
+	lngmin = -180.0 + 360.0 * s.ilng / nlng;
+	lngmax = lngmin + 360.0 / nlng;
+}
+
+static void write(const ElevSample &s, bool modified)
+{
+	double latmin, latmax, lngmin, lngmax;
+	tileRange(s, latmin, latmax, lngmin, lngmax);
+	if (modified)
+		elvmodwrite(s.modfname.c_str(), s.edata, s.mod, latmin, latmax, lngmin, lngmax);
+	else
+		elvwrite(s.fname.c_str(), s.base, latmin, latmax, lngmin, lngmax);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		std::cerr << "Usage: elv_write_bench <planet dir> <scratch dir> [max tiles]" << std::endl;
+		return 2;
+	}
+	std::string scratch(argv[2]);
+	size_t maxtiles = (argc > 3 ? (size_t)atoi(argv[3]) : MAXTILES);
+	ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(argv[1], ZTreeMgr::LAYER_ELEV);
+	if (!mgr) {
+		std::cerr << "Could not open the Elev archive" << std::endl;
+		return 2;
+	}
+	if (_mkdir(scratch.c_str())) {
+		std::cerr << "Could not create " << scratch << " (it must not exist yet)" << std::endl;
+		delete mgr;
+		return 2;
+	}
+
+	// a random sample of the archive's tiles, each with a random set of
+	// nodes raised or lowered by whole multiples of the resolution
+	std::vector<ZTreeMgr::NodeRef> nodes;
+	mgr->Nodes(nodes);
+	std::mt19937 rng(1);
+	std::shuffle(nodes.begin(), nodes.end(), rng);
+	std::vector<ElevSample> samples;
+	char path[1024];
+	for (size_t i = 0; i < nodes.size() && samples.size() < maxtiles; i++) {
+		BYTE *buf;
+		DWORD ndata = mgr->ReadData(nodes[i].idx, &buf);
+		if (!ndata)
+			continue;
+		ElevSample s;
+		s.base = elvscan(buf, ndata);
+		mgr->ReleaseData(buf);
+		if (!s.base.data.size())
+			continue;
+		s.lvl = nodes[i].lvl;
+		s.ilat = nodes[i].ilat;
+		s.ilng = nodes[i].ilng;
+		s.edata = s.base;
+		DWORD n = (DWORD)s.edata.data.size();
+		for (DWORD k = 0; k < (DWORD)(n * MODFRAC); k++) {
+			DWORD idx = rng() % n;
+			elev_t v = s.edata.data[idx];
+			elev_t vnew = (elev_t)(v + s.edata.dres * ((int)(rng() % 41) - 20));
+			s.mod.update(idx, v, vnew, n);
+			s.edata.data[idx] = vnew;
+		}
+		s.edata.RescanLimits();
+		sprintf(path, "%s/%02d_%06d_%06d.elv", scratch.c_str(), s.lvl, s.ilat, s.ilng);
+		s.fname = path;
+		sprintf(path, "%s/%02d_%06d_%06d_mod.elv", scratch.c_str(), s.lvl, s.ilat, s.ilng);
+		s.modfname = path;
+		samples.push_back(s);
+	}
+	delete mgr;
+	if (!samples.size()) {
+		std::cerr << "No elevation tiles found in the Elev archive" << std::endl;
+		return 2;
+	}
+
+	double t[2];
+	for (int m = 0; m < 2; m++) {
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < NREP; r++)
+			for (auto &s : samples)
+				write(s, m == 1);
+		t[m] = seconds(t0);
+	}
+
+	// read back: the base tiles, and the base tiles with the modifications applied
+	int nbad = 0;
+	size_t nmod = 0;
+	for (auto &s : samples) {
+		ElevData edata = elvread(s.fname.c_str());
+		if (edata.data != s.base.data)
+			nbad++;
+		ElevModData mod;
+		if (!elvmodread(s.modfname.c_str(), edata, mod) || edata.data != s.edata.data)
+			nbad++;
+		nmod += s.mod.size();
+	}
+
+	double n = (double)NREP * samples.size();
+	std::cout << samples.size() << " Elev tiles, " << nmod / samples.size() << " modified nodes per tile" << std::endl;
+	std::cout << "elvwrite:    " << (int)(n / t[0]) << " tiles/s" << std::endl;
+	std::cout << "elvmodwrite: " << (int)(n / t[1]) << " tiles/s" << std::endl;
+	std::cout << nbad << " mismatches" << std::endl;
+	return (nbad ? 1 : 0);
+}
@@ -0,0 +1,135 @@
+// =======================================================================
+// inflate_bench.cpp
+// Inflate benchmark for the tree archives of a planet. For each layer
+// archive present, a random sample of nodes is inflated from memory with
+// zlib's uncompress and with FastInflate, and read through
+// ZTreeMgr::ReadData into a reused buffer with each backend. Checks that
+// all outputs match and reports MB/s of inflated data per layer.
+//
+// Standalone (no Qt). Build from this directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\zlib\include inflate_bench.cpp ..\ZTreeMgr.cpp
+//        ..\nodecache.cpp ..\fastinflate.cpp ..\..\extern\zlib\lib\zdll.lib
+// Usage:
+//     inflate_bench <planet dir> [max nodes per layer]
+// Returns 0 if all outputs matched.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+#include "zlib.h"
+#include "ZTreeMgr.h"
+#include "fastinflate.h"
+
+#define MAXNODES 2000   // default sample size per layer
+#define MINBYTES 200e6  // inflated bytes per timed run (repeats the sample)
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: inflate_bench <planet dir> [max nodes per layer]" << std::endl;
+		return 2;
+	}
+	size_t maxnodes = (argc > 2 ? (size_t)atoi(argv[2]) : MAXNODES);
+	ZTreeMgr::Layer layers[4] = { ZTreeMgr::LAYER_SURF, ZTreeMgr::LAYER_MASK, ZTreeMgr::LAYER_ELEV, ZTreeMgr::LAYER_ELEVMOD };
+	int nbad = 0, nlayer = 0;
+
+	for (int l = 0; l < 4; l++) {
+		ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(argv[1], layers[l]);
+		if (!mgr)
+			continue;
+		std::vector<ZTreeMgr::NodeRef> nodes;
+		mgr->Nodes(nodes);
+		if (!nodes.size()) {
+			delete mgr;
+			continue;
+		}
+		nlayer++;
+		std::mt19937 rng(1);
+		std::shuffle(nodes.begin(), nodes.end(), rng);
+		if (nodes.size() > maxnodes)
+			nodes.resize(maxnodes);
+
+		// compressed payloads in memory, and the zlib output as reference
+		std::vector<std::vector<BYTE> > zdata(nodes.size()), ref(nodes.size());
+		DWORD maxsize = 0;
+		double nin = 0, nout = 0;
+		for (size_t i = 0; i < nodes.size(); i++) {
+			DWORD idx = nodes[i].idx;
+			zdata[i].resize(mgr->NodeSizeDeflated(idx));
+			zdata[i].resize(mgr->ReadDeflated(idx, zdata[i].data(), (DWORD)zdata[i].size()));
+			ref[i].resize(mgr->NodeSizeInflated(idx));
+			uLongf n = (uLongf)ref[i].size();
+			if (uncompress(ref[i].data(), &n, zdata[i].data(), (uLong)zdata[i].size()) != Z_OK || n != ref[i].size())
+				nbad++;
+			maxsize = (ref[i].size() > maxsize ? (DWORD)ref[i].size() : maxsize);
+			nin += zdata[i].size();
+			nout += ref[i].size();
+		}
+		int nrep = (int)(MINBYTES / nout) + 1;
+		std::vector<BYTE> buf(maxsize);
+
+		// zlib uncompress, from memory
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < nrep; r++)
+			for (size_t i = 0; i < nodes.size(); i++) {
+				uLongf n = maxsize;
+				uncompress(buf.data(), &n, zdata[i].data(), (uLong)zdata[i].size());
+			}
+		double tZlib = seconds(t0);
+
+		// FastInflate, from memory
+		t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < nrep; r++)
+			for (size_t i = 0; i < nodes.size(); i++)
+				if (FastInflate(zdata[i].data(), (DWORD)zdata[i].size(), buf.data(), maxsize) != ref[i].size())
+					nbad++;
+		double tFast = seconds(t0);
+		for (size_t i = 0; i < nodes.size(); i++) {
+			DWORD n = FastInflate(zdata[i].data(), (DWORD)zdata[i].size(), buf.data(), maxsize);
+			if (n != ref[i].size() || memcmp(buf.data(), ref[i].data(), n))
+				nbad++;
+		}
+
+		// ZTreeMgr::ReadData into a reused buffer, with both backends
+		double tRead[2];
+		ZTreeMgr::InflateMethod method[2] = { ZTreeMgr::INFLATE_ZLIB, ZTreeMgr::INFLATE_FAST };
+		for (int m = 0; m < 2; m++) {
+			ZTreeMgr::SetInflateMethod(method[m]);
+			for (size_t i = 0; i < nodes.size(); i++) {
+				DWORD n = mgr->ReadData(nodes[i].idx, buf.data(), maxsize);
+				if (n != ref[i].size() || memcmp(buf.data(), ref[i].data(), n))
+					nbad++;
+			}
+			t0 = std::chrono::steady_clock::now();
+			for (int r = 0; r < nrep; r++)
+				for (size_t i = 0; i < nodes.size(); i++)
+					mgr->ReadData(nodes[i].idx, buf.data(), maxsize);
+			tRead[m] = seconds(t0);
+		}
+		ZTreeMgr::SetInflateMethod(ZTreeMgr::INFLATE_FAST);
+
+		double mb = nrep * nout * 1e-6;
+		std::cout << ZTreeMgr::LayerName(layers[l]) << ": " << nodes.size() << " nodes, " << (int)(nout / nodes.size())
+			<< " bytes/node, ratio " << nout / nin << std::endl;
+		std::cout << "  uncompress:            " << (int)(mb / tZlib) << " MB/s" << std::endl;
+		std::cout << "  FastInflate:           " << (int)(mb / tFast) << " MB/s" << std::endl;
+		std::cout << "  ReadData, zlib:        " << (int)(mb / tRead[0]) << " MB/s" << std::endl;
+		std::cout << "  ReadData, FastInflate: " << (int)(mb / tRead[1]) << " MB/s" << std::endl;
+		delete mgr;
+	}
+	if (!nlayer) {
+		std::cerr << "No layer archives with data found" << std::endl;
+		return 2;
+	}
+	std::cout << nbad << " mismatches" << std::endl;
+	return (nbad ? 1 : 0);
+}
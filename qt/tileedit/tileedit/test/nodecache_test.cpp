@@ -0,0 +1,168 @@
+// =======================================================================
+// nodecache_test.cpp
+// Tests of the NodeCache LRU order and budget eviction: lookups return the
+// stored payloads, the least recently used entries are evicted first, the
+// budget is never exceeded, tiles of the deepest level get distinct keys,
+// and concurrent puts and gets never return another node's payload.
+//
+// Standalone (no Qt). Build from this directory, e.g.
+//     cl /O2 /EHsc /I.. nodecache_test.cpp ..\nodecache.cpp
+// Returns 0 if all checks passed.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <string.h>
+#include "ZTreeMgr.h"
+#include "nodecache.h"
+
+#define NTHREAD 8
+#define NOP_PER_THREAD 20000
+
+static int nbad = 0;
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		std::cout << "FAILED: " << what << std::endl;
+		nbad++;
+	}
+}
+
+// payload of n bytes that identifies the node
+static std::vector<BYTE> payload(int layer, int lvl, int ilat, int ilng, DWORD n)
+{
+	std::vector<BYTE> data(n);
+	for (DWORD i = 0; i < n; i++)
+		data[i] = (BYTE)(layer * 7 + lvl * 13 + ilat * 31 + ilng * 17 + i);
+	return data;
+}
+
+static bool getMatches(NodeCache &cache, int layer, int lvl, int ilat, int ilng, DWORD n)
+{
+	BYTE *buf;
+	DWORD ndata;
+	if (!cache.get(layer, lvl, ilat, ilng, &buf, &ndata))
+		return false;
+	std::vector<BYTE> ref = payload(layer, lvl, ilat, ilng, n);
+	bool ok = (ndata == n && !memcmp(buf, ref.data(), n));
+	delete[] buf;
+	return ok;
+}
+
+static void put(NodeCache &cache, int layer, int lvl, int ilat, int ilng, DWORD n)
+{
+	std::vector<BYTE> data = payload(layer, lvl, ilat, ilng, n);
+	cache.put(layer, lvl, ilat, ilng, data.data(), n);
+}
+
+static void testLRU()
+{
+	// room for three 100-byte entries
+	NodeCache cache(300);
+	put(cache, 0, 10, 1, 1, 100);
+	put(cache, 0, 10, 1, 2, 100);
+	put(cache, 0, 10, 1, 3, 100);
+	check(cache.stats().bytes == 300 && cache.stats().entries == 3, "three entries fill the budget");
+	check(getMatches(cache, 0, 10, 1, 1, 100), "hit returns the stored payload");
+
+	// (1,2) is now the least recently used entry; contains() must not change that
+	check(cache.contains(0, 10, 1, 2), "contains finds an entry");
+	put(cache, 0, 10, 1, 4, 100);
+	check(!cache.contains(0, 10, 1, 2), "least recently used entry is evicted");
+	check(cache.contains(0, 10, 1, 1) && cache.contains(0, 10, 1, 3) && cache.contains(0, 10, 1, 4), "recently used entries are kept");
+	check(cache.stats().evictions == 1, "eviction is counted");
+
+	// replacing an entry updates its size and makes it most recently used
+	put(cache, 0, 10, 1, 3, 50);
+	check(cache.stats().bytes == 250, "replaced entry is accounted with its new size");
+	put(cache, 0, 10, 1, 5, 100);
+	check(!cache.contains(0, 10, 1, 1) && cache.contains(0, 10, 1, 3), "replaced entry moves to the front");
+	check(getMatches(cache, 0, 10, 1, 3, 50), "replaced entry returns the new payload");
+
+	// entries larger than the budget are not stored
+	put(cache, 0, 10, 1, 6, 301);
+	check(!cache.contains(0, 10, 1, 6), "entry larger than the budget is not stored");
+
+	// shrinking the budget evicts in LRU order
+	check(getMatches(cache, 0, 10, 1, 4, 100), "hit before shrinking");
+	cache.setBudget(150);
+	check(cache.stats().bytes <= 150, "shrunk budget is held");
+	check(cache.contains(0, 10, 1, 4) && !cache.contains(0, 10, 1, 5), "shrinking keeps the most recently used entry");
+
+	// statistics
+	NodeCache::Stats s = cache.stats();
+	check(s.hits == 3 && s.misses == 0, "hits and misses are counted");
+	BYTE *buf;
+	DWORD ndata;
+	check(!cache.get(0, 10, 1, 5, &buf, &ndata) && cache.stats().misses == 1, "miss is counted");
+	cache.clear();
+	check(cache.stats().bytes == 0 && cache.stats().entries == 0, "clear drops all entries");
+}
+
+static void testKeys()
+{
+	// tiles of the deepest level, and the same tile on different layers,
+	// must not share a cache entry
+	NodeCache cache(1 << 20);
+	int n = 1 << (TREE_MAXLVL - 3); // longitude tiles of the deepest level
+	int tiles[4][2] = { { 0, n / 2 }, { 1, 0 }, { n / 4 - 1, n - 1 }, { n / 4 - 1, n / 2 - 1 } };
+	for (int layer = 0; layer <= ZTreeMgr::LAYER_CLOUD; layer++)
+		for (int i = 0; i < 4; i++)
+			put(cache, layer, TREE_MAXLVL, tiles[i][0], tiles[i][1], 16 + i + layer);
+	check(cache.stats().entries == 4 * (ZTreeMgr::LAYER_CLOUD + 1), "deepest level tiles get distinct keys");
+	for (int layer = 0; layer <= ZTreeMgr::LAYER_CLOUD; layer++)
+		for (int i = 0; i < 4; i++)
+			check(getMatches(cache, layer, TREE_MAXLVL, tiles[i][0], tiles[i][1], 16 + i + layer), "deepest level tile returns its own payload");
+}
+
+static void testConcurrent()
+{
+	// threads put and get random nodes in a cache that holds a fraction of
+	// them; every hit must return the payload of the requested node, and
+	// the budget must hold throughout
+	const size_t budget = 64 * 1024;
+	NodeCache cache(budget);
+	std::atomic<int> nwrong(0), nover(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < NTHREAD; t++) {
+		threads.push_back(std::thread([&, t]() {
+			std::mt19937 rng(t + 1);
+			for (int i = 0; i < NOP_PER_THREAD; i++) {
+				int layer = rng() % 3, ilat = rng() % 16, ilng = rng() % 32;
+				DWORD n = 256 + (ilat * 32 + ilng) % 1024;
+				if (!cache.contains(layer, 12, ilat, ilng))
+					put(cache, layer, 12, ilat, ilng, n);
+				else {
+					BYTE *buf;
+					DWORD ndata;
+					if (cache.get(layer, 12, ilat, ilng, &buf, &ndata)) {
+						std::vector<BYTE> ref = payload(layer, 12, ilat, ilng, n);
+						if (ndata != n || memcmp(buf, ref.data(), n))
+							nwrong++;
+						delete[] buf;
+					}
+				}
+				if (cache.stats().bytes > budget)
+					nover++;
+			}
+		}));
+	}
+	for (auto &th : threads)
+		th.join();
+	check(!nwrong, "concurrent hits return the requested payload");
+	check(!nover, "concurrent puts hold the budget");
+	std::cout << NTHREAD << " threads: " << cache.stats().evictions << " evictions, " << nwrong << " wrong payloads" << std::endl;
+}
+
+int main()
+{
+	testLRU();
+	testKeys();
+	testConcurrent();
+	std::cout << (nbad ? "FAILED" : "passed") << std::endl;
+	return (nbad ? 1 : 0);
+}
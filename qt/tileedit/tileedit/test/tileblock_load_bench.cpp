@@ -0,0 +1,195 @@
+// =======================================================================
+// tileblock_load_bench.cpp
+// Block load latency benchmark. Loads Surf, Mask and Elev tile blocks of
+// a planet with SurfTileBlock::Load, MaskTileBlock::Load and
+// ElevTileBlock::Load, one layer at a time and all three at once (as the
+// editor's loaders do), limiting parallelFor to 1, 2, 4, ... threads.
+// Checks that the block data don't depend on the thread count and reports
+// the mean load time per block.
+//
+// Needs QtGui (for the QColor in imagetools.cpp). Build from this
+// directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\zlib\include /I..\..\extern\libpng\include
+//        /I..\..\extern\fastdxt /I%QTDIR%\include /I%QTDIR%\include\QtGui
+//        tileblock_load_bench.cpp ..\tileblock.cpp ..\tile.cpp ..\elevtile.cpp
+//        ..\elv_io.cpp ..\dxt_io.cpp ..\ddsread.cpp ..\dxt1decode.cpp ..\cmap.cpp
+//        ..\imagetools.cpp ..\parallel.cpp ..\ZTreeMgr.cpp ..\nodecache.cpp
+//        ..\fastinflate.cpp ..\..\extern\fastdxt\*.cpp ..\..\extern\zlib\lib\zdll.lib
+//        ..\..\extern\libpng\lib\libpng16.lib %QTDIR%\lib\Qt5Gui.lib %QTDIR%\lib\Qt5Core.lib
+// Usage:
+//     tileblock_load_bench <planet dir> [level] [block size]
+// Returns 0 if the blocks loaded with all thread counts matched.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stdlib.h>
+#include "tileblock.h"
+#include "parallel.h"
+
+#define LEVEL 10    // default tile level
+#define BLOCK 4     // default block size (tiles per side)
+#define NBLOCK 8    // number of blocks loaded per thread count and layer
+#define NREP 3      // repetitions of each load
+
+enum { SURF, MASK, ELEV, NLAYER };
+static const char *layerName[NLAYER] = { "Surf", "Mask", "Elev" };
+
+struct BlockPos {
+	int ilat0, ilat1, ilng0, ilng1;
+};
+
+static unsigned __int64 hash(const void *data, size_t n)
+{
+	// FNV-1a
+	const BYTE *p = (const BYTE*)data;
+	unsigned __int64 h = 14695981039346656037ull;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ p[i]) * 1099511628211ull;
+	return h;
+}
+
+// load a block of the layer; returns the hash of its data, or 0 if it failed
+static unsigned __int64 load(int layer, int lvl, const BlockPos &b)
+{
+	unsigned __int64 h = 0;
+	if (layer == ELEV) {
+		ElevTileBlock *block = ElevTileBlock::Load(lvl, b.ilat0, b.ilat1, b.ilng0, b.ilng1);
+		if (block) {
+			const std::vector<elev_t> &d = block->getData().data;
+			h = hash(d.data(), d.size() * sizeof(elev_t));
+			delete block;
+		}
+	}
+	else {
+		DXT1TileBlock *block = (layer == SURF ?
+			(DXT1TileBlock*)SurfTileBlock::Load(lvl, b.ilat0, b.ilat1, b.ilng0, b.ilng1) :
+			(DXT1TileBlock*)MaskTileBlock::Load(lvl, b.ilat0, b.ilat1, b.ilng0, b.ilng1));
+		if (block) {
+			const Image &im = block->getData();
+			h = hash(im.data.data(), im.data.size() * sizeof(DWORD));
+			delete block;
+		}
+	}
+	return h;
+}
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: tileblock_load_bench <planet dir> [level] [block size]" << std::endl;
+		return 2;
+	}
+	int lvl = (argc > 2 ? atoi(argv[2]) : LEVEL);
+	int bs = (argc > 3 ? atoi(argv[3]) : BLOCK);
+	if (lvl < 5 || lvl > 19 || bs < 1 || bs > 1 << (lvl - 4)) {
+		std::cerr << "Level must be 5-19, block size 1-" << (lvl < 5 ? 1 : 1 << (lvl - 4)) << std::endl;
+		return 2;
+	}
+
+	std::string root(argv[1]);
+	Tile::setRoot(root);
+	ZTreeMgr *mgrSurf = ZTreeMgr::CreateFromFile(root.c_str(), ZTreeMgr::LAYER_SURF);
+	ZTreeMgr *mgrMask = ZTreeMgr::CreateFromFile(root.c_str(), ZTreeMgr::LAYER_MASK);
+	ZTreeMgr *mgrElev = ZTreeMgr::CreateFromFile(root.c_str(), ZTreeMgr::LAYER_ELEV);
+	ZTreeMgr *mgrElevMod = ZTreeMgr::CreateFromFile(root.c_str(), ZTreeMgr::LAYER_ELEVMOD);
+	SurfTile::setTreeMgr(mgrSurf);
+	MaskTile::setTreeMgr(mgrMask);
+	ElevTile::setTreeMgr(mgrElev, mgrElevMod);
+	ElevDisplayParam elevParam;
+	ElevTileBlock::setElevDisplayParam(&elevParam);
+
+	// blocks at archive tiles of the level, spread over the archive, or at
+	// random positions if the Surf archive has none
+	int nlat = 1 << (lvl - 4), nlng = 1 << (lvl - 3);
+	std::vector<std::pair<int, int> > pos;
+	if (mgrSurf) {
+		std::vector<ZTreeMgr::NodeRef> nodes;
+		mgrSurf->Nodes(nodes);
+		for (auto &n : nodes)
+			if (n.lvl == lvl)
+				pos.push_back(std::make_pair(n.ilat, n.ilng));
+	}
+	std::vector<BlockPos> blocks;
+	srand(1);
+	for (int i = 0; i < NBLOCK; i++) {
+		std::pair<int, int> p = (pos.size() ? pos[i * pos.size() / NBLOCK] : std::make_pair(rand() % nlat, rand() % nlng));
+		BlockPos b;
+		b.ilat0 = (p.first + bs <= nlat ? p.first : nlat - bs);
+		b.ilat1 = b.ilat0 + bs;
+		b.ilng0 = (p.second + bs <= nlng ? p.second : nlng - bs);
+		b.ilng1 = b.ilng0 + bs;
+		blocks.push_back(b);
+	}
+
+	// reference: blocks loaded on one thread
+	setNumWorkerThreads(1);
+	std::vector<unsigned __int64> ref[NLAYER];
+	for (int l = 0; l < NLAYER; l++)
+		for (auto &b : blocks)
+			ref[l].push_back(load(l, lvl, b));
+
+	std::vector<int> nthreads;
+	for (int n = 1; n < numCores(); n *= 2)
+		nthreads.push_back(n);
+	nthreads.push_back(numCores());
+
+	int nbad = 0;
+	std::cout << NBLOCK << " blocks of " << bs << "x" << bs << " tiles at level " << lvl
+		<< ", mean load time [ms]" << std::endl;
+	std::cout << "threads\tSurf\tMask\tElev\tall" << std::endl;
+	for (int nthread : nthreads) {
+		setNumWorkerThreads(nthread);
+		double t[NLAYER + 1];
+		for (int l = 0; l < NLAYER; l++) {
+			auto t0 = std::chrono::steady_clock::now();
+			for (int r = 0; r < NREP; r++)
+				for (size_t i = 0; i < blocks.size(); i++)
+					if (load(l, lvl, blocks[i]) != ref[l][i])
+						nbad++;
+			t[l] = seconds(t0);
+		}
+
+		// the three layers at once, each on its own thread
+		auto t0 = std::chrono::steady_clock::now();
+		for (int r = 0; r < NREP; r++)
+			for (size_t i = 0; i < blocks.size(); i++) {
+				std::vector<std::thread> loaders;
+				unsigned __int64 h[NLAYER];
+				for (int l = 0; l < NLAYER; l++)
+					loaders.push_back(std::thread([&, l]() { h[l] = load(l, lvl, blocks[i]); }));
+				for (int l = 0; l < NLAYER; l++) {
+					loaders[l].join();
+					if (h[l] != ref[l][i])
+						nbad++;
+				}
+			}
+		t[NLAYER] = seconds(t0);
+
+		std::cout << nthread;
+		for (int l = 0; l <= NLAYER; l++)
+			std::cout << "\t" << t[l] * 1e3 / (NREP * NBLOCK);
+		std::cout << std::endl;
+	}
+	for (int l = 0; l < NLAYER; l++) {
+		int nfail = 0;
+		for (auto h : ref[l])
+			if (!h) nfail++;
+		if (nfail)
+			std::cout << layerName[l] << ": " << nfail << " blocks failed to load" << std::endl;
+	}
+	std::cout << nbad << " mismatches" << std::endl;
+
+	delete mgrSurf;
+	delete mgrMask;
+	delete mgrElev;
+	delete mgrElevMod;
+	return (nbad ? 1 : 0);
+}
@@ -0,0 +1,196 @@
+// =======================================================================
+// treewriter_roundtrip.cpp
+// Round-trip test of TreeWriter and ZTreeMgr. Writes random Surf cache
+// tiles, packs them into an archive, and reads every tile back by tile
+// coordinates. Then rebuilds the archive from a merge of new cache tiles
+// and the existing archive, appends new and changed tiles in place (twice,
+// with the old archive still open), and rebuilds it again. After each step
+// all tiles must read back with their latest contents, and the file format
+// version must be that of the writer used.
+//
+// Standalone (no Qt). Build from this directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\zlib\include treewriter_roundtrip.cpp ..\treewriter.cpp
+//        ..\ZTreeMgr.cpp ..\nodecache.cpp ..\fastinflate.cpp ..\parallel.cpp ..\..\extern\zlib\lib\zdll.lib
+// Usage:
+//     treewriter_roundtrip <scratch dir>
+// The scratch directory must not exist yet. Returns 0 if all checks passed.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <random>
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <direct.h>
+#include "ZTreeMgr.h"
+#include "treewriter.h"
+
+struct TileId {
+	int lvl, ilat, ilng;
+	bool operator<(const TileId &t) const
+	{ return ZTreeMgr::NodeKey(lvl, ilat, ilng) < ZTreeMgr::NodeKey(t.lvl, t.ilat, t.ilng); }
+};
+
+static std::string s_root;
+static std::mt19937 s_rng(5);
+static std::map<TileId, std::vector<BYTE> > s_truth; // latest contents of each tile
+
+static std::string archiveName()
+{
+	return s_root + "/Archive/Surf.tree";
+}
+
+static void putData(int lvl, int ilat, int ilng, const std::vector<BYTE> &data)
+{
+	// write a cache tile, creating its directories
+	char path[1024];
+	sprintf(path, "%s/Surf", s_root.c_str());
+	_mkdir(path);
+	sprintf(path, "%s/Surf/%02d", s_root.c_str(), lvl);
+	_mkdir(path);
+	sprintf(path, "%s/Surf/%02d/%06d", s_root.c_str(), lvl, ilat);
+	_mkdir(path);
+	sprintf(path, "%s/Surf/%02d/%06d/%06d.dds", s_root.c_str(), lvl, ilat, ilng);
+	FILE *f = fopen(path, "wb");
+	fwrite(data.data(), 1, data.size(), f);
+	fclose(f);
+	TileId t = { lvl, ilat, ilng };
+	s_truth[t] = data;
+}
+
+static void put(int lvl, int ilat, int ilng)
+{
+	// cache tile with random, compressible contents
+	std::vector<BYTE> data(1000 + s_rng() % 5000);
+	for (auto &b : data)
+		b = (BYTE)(s_rng() % 16);
+	putData(lvl, ilat, ilng, data);
+}
+
+static int check(const char *step, BYTE version)
+{
+	// read all tiles back from the archive
+	int nbad = 0;
+	FILE *f = fopen(archiveName().c_str(), "rb");
+	TreeFileHeader tfh;
+	if (!f || !tfh.fread(f) || tfh.version() != version) {
+		std::cout << step << ": archive version " << (f ? (int)tfh.version() : -1) << ", expected " << (int)version << std::endl;
+		nbad++;
+	}
+	if (f)
+		fclose(f);
+
+	ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(s_root.c_str(), ZTreeMgr::LAYER_SURF);
+	if (!mgr) {
+		std::cout << step << ": could not open the archive" << std::endl;
+		return nbad + 1;
+	}
+	for (auto &t : s_truth) {
+		BYTE *buf;
+		DWORD ndata = mgr->ReadData(t.first.lvl, t.first.ilat, t.first.ilng, &buf);
+		if (ndata != t.second.size() || memcmp(buf, t.second.data(), ndata)) {
+			std::cout << step << ": tile " << t.first.lvl << "/" << t.first.ilat << "/" << t.first.ilng << " read back wrong" << std::endl;
+			nbad++;
+		}
+		if (ndata)
+			mgr->ReleaseData(buf);
+	}
+	std::vector<ZTreeMgr::NodeRef> nodes;
+	mgr->Nodes(nodes);
+	if (nodes.size() != s_truth.size()) {
+		std::cout << step << ": " << nodes.size() << " nodes with data, expected " << s_truth.size() << std::endl;
+		nbad++;
+	}
+	std::cout << step << ": " << mgr->TOC().size() << " nodes, " << s_truth.size() << " tiles, " << nbad << " errors" << std::endl;
+	delete mgr;
+	return nbad;
+}
+
+static bool rebuild(const char *step)
+{
+	// write a new archive from the cache merged with the current archive,
+	// then replace the current one (as DlgBuildArchive does)
+	ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(s_root.c_str(), ZTreeMgr::LAYER_SURF);
+	TreeWriter writer(s_root.c_str(), ZTreeMgr::LAYER_SURF);
+	writer.setMergeSource(mgr);
+	std::string tmpname = archiveName() + ".tmp";
+	bool ok = writer.Write(tmpname.c_str());
+	delete mgr;
+	if (ok)
+		ok = (MoveFileExA(tmpname.c_str(), archiveName().c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE);
+	const TreeWriter::Stats &s = writer.stats();
+	std::cout << step << ": " << s.cacheTiles << " cache tiles, " << s.archiveTiles << " archive tiles, "
+		<< s.seconds << " s" << (ok ? "" : " FAILED") << std::endl;
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: treewriter_roundtrip <scratch dir>" << std::endl;
+		return 2;
+	}
+	s_root = argv[1];
+	if (_mkdir(s_root.c_str()) || _mkdir((s_root + "/Archive").c_str())) {
+		std::cerr << "Could not create " << s_root << " (it must not exist yet)" << std::endl;
+		return 2;
+	}
+	int nbad = 0;
+
+	// the three low-resolution roots, both level-4 trees, random tiles down
+	// to level 13 with the intermediate nodes left empty, and tiles of the
+	// deepest levels, whose indices exceed 20 bits and the %06d name width
+	put(1, 0, 0); put(3, 0, 0); put(4, 0, 1); put(5, 1, 2);
+	put(9, 20, 63); put(9, 21, 63); put(12, 100, 500);
+	put(TREE_MAXLVL, 5, (1 << 20) + 3); put(TREE_MAXLVL, (1 << 20) - 1, (1 << 21) - 1);
+	put(TREE_MAXLVL - 1, 100, (1 << 20) - 1);
+	for (int i = 0; i < 500; i++) {
+		int lvl = 6 + s_rng() % 8;
+		put(lvl, s_rng() % (1 << (lvl - 4)), s_rng() % (1 << (lvl - 3)));
+	}
+	{
+		TreeWriter writer(s_root.c_str(), ZTreeMgr::LAYER_SURF);
+		if (!writer.Write(archiveName().c_str()))
+			nbad++;
+		nbad += check("write", TREEFILE_VERSION);
+	}
+
+	// merge: the previous cache is gone, one archived tile is replaced and
+	// new ones are added
+	MoveFileExA((s_root + "/Surf").c_str(), (s_root + "/Surf.1").c_str(), 0);
+	put(9, 20, 63); put(15, 2000, 100); put(2, 0, 0);
+	if (!rebuild("merge"))
+		nbad++;
+	nbad += check("merge", TREEFILE_VERSION);
+	ZTreeMgr::SetInflateMethod(ZTreeMgr::INFLATE_ZLIB);
+	nbad += check("merge (zlib)", TREEFILE_VERSION);
+	ZTreeMgr::SetInflateMethod(ZTreeMgr::INFLATE_FAST);
+
+	// append: one tile changed, new ones added, and an identical copy of an
+	// archived tile, which must be kept rather than appended
+	put(10, 40, 127); put(9, 20, 63); put(16, 4000, 200);
+	TileId same = { 12, 100, 500 };
+	putData(same.lvl, same.ilat, same.ilng, s_truth[same]);
+	for (int r = 0; r < 2; r++) {
+		ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(s_root.c_str(), ZTreeMgr::LAYER_SURF);
+		TreeWriter writer(s_root.c_str(), ZTreeMgr::LAYER_SURF);
+		if (!writer.Append(mgr))
+			nbad++;
+		const TreeWriter::Stats &s = writer.stats();
+		std::cout << "append " << r + 1 << ": " << s.cacheTiles << " appended, " << s.archiveTiles << " kept, "
+			<< s.garbageBytes << " bytes unused" << std::endl;
+		nbad += check("append (old archive open)", TREEFILE_VERSION_APPEND);
+		delete mgr;
+		nbad += check("append", TREEFILE_VERSION_APPEND);
+	}
+
+	// a rebuild compacts the archive and returns to the base format
+	if (!rebuild("rebuild"))
+		nbad++;
+	nbad += check("rebuild", TREEFILE_VERSION);
+
+	std::cout << (nbad ? "FAILED" : "passed") << std::endl;
+	return (nbad ? 1 : 0);
+}
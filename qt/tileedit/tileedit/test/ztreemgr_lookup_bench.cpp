@@ -0,0 +1,189 @@
+// =======================================================================
+// ztreemgr_lookup_bench.cpp
+// Node lookup benchmark for ZTreeMgr. Resolves the tiles of a layer
+// archive, plus as many tiles that are not in the archive, by recursive
+// descent through the TOC child pointers from the level-4 roots (the
+// lookup ZTreeMgr::Idx used before the node index), by Idx, and by the
+// batch Idx per level. The same is done for blocks of neighbouring tiles
+// around archive tiles. Checks that all methods agree and reports lookups/s.
+//
+// Standalone (no Qt). Build from this directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\zlib\include ztreemgr_lookup_bench.cpp ..\ZTreeMgr.cpp
+//        ..\nodecache.cpp ..\fastinflate.cpp ..\..\extern\zlib\lib\zdll.lib
+// Usage:
+//     ztreemgr_lookup_bench <planet dir> [Surf|Mask|Elev|Elev_mod]
+// Returns 0 if all lookups agreed.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+#include "ZTreeMgr.h"
+
+#define NREP 20
+#define NBLOCK 2000 // number of tile blocks looked up
+#define BLOCK 8     // tile block size
+
+static ZTreeMgr::Layer layerFromName(const char *name)
+{
+	if (!strcmp(name, "Mask")) return ZTreeMgr::LAYER_MASK;
+	if (!strcmp(name, "Elev")) return ZTreeMgr::LAYER_ELEV;
+	if (!strcmp(name, "Elev_mod")) return ZTreeMgr::LAYER_ELEVMOD;
+	return ZTreeMgr::LAYER_SURF;
+}
+
+static DWORD idxRecursive(const ZTreeMgr *mgr, int lvl, int ilat, int ilng)
+{
+	// one dependent child pointer per level below 4
+	const TreeTOC &toc = mgr->TOC();
+	DWORD idx = mgr->Idx(4, 0, ilng >> (lvl - 4));
+	for (int l = 5; l <= lvl && idx < toc.size(); l++) {
+		int sh = lvl - l;
+		idx = toc[idx].child[((ilat >> sh) & 1) * 2 + ((ilng >> sh) & 1)];
+	}
+	return (idx < toc.size() ? idx : (DWORD)-1);
+}
+
+static double seconds(std::chrono::steady_clock::time_point t0)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: ztreemgr_lookup_bench <planet dir> [Surf|Mask|Elev|Elev_mod]" << std::endl;
+		return 2;
+	}
+	ZTreeMgr::Layer layer = (argc > 2 ? layerFromName(argv[2]) : ZTreeMgr::LAYER_SURF);
+	ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(argv[1], layer);
+	if (!mgr) {
+		std::cerr << "Could not open the " << ZTreeMgr::LayerName(layer) << " archive" << std::endl;
+		return 2;
+	}
+
+	// the archive's tiles of level >= 5 and as many random tiles at the same
+	// levels (mostly absent), in random order
+	std::vector<ZTreeMgr::NodeRef> nodes;
+	mgr->Nodes(nodes);
+	std::vector<ZTreeMgr::NodeRef> query;
+	std::mt19937 rng(1);
+	for (auto &n : nodes) {
+		if (n.lvl < 5)
+			continue;
+		query.push_back(n);
+		ZTreeMgr::NodeRef r = { n.lvl, (int)(rng() % (1u << (n.lvl - 4))), (int)(rng() % (1u << (n.lvl - 3))), 0 };
+		query.push_back(r);
+	}
+	if (!query.size()) {
+		std::cerr << "Archive has no tiles below level 4" << std::endl;
+		delete mgr;
+		return 2;
+	}
+	std::shuffle(query.begin(), query.end(), rng);
+	int maxlvl = 0;
+	for (auto &q : query)
+		maxlvl = (q.lvl > maxlvl ? q.lvl : maxlvl);
+
+	// reference and agreement
+	int nbad = 0;
+	std::vector<DWORD> ref(query.size());
+	for (size_t i = 0; i < query.size(); i++) {
+		ref[i] = idxRecursive(mgr, query[i].lvl, query[i].ilat, query[i].ilng);
+		if (mgr->Idx(query[i].lvl, query[i].ilat, query[i].ilng) != ref[i])
+			nbad++;
+	}
+	std::map<int, std::vector<std::pair<int, int> > > perLvl;
+	std::map<int, std::vector<DWORD> > perLvlRef;
+	for (size_t i = 0; i < query.size(); i++) {
+		perLvl[query[i].lvl].push_back(std::make_pair(query[i].ilat, query[i].ilng));
+		perLvlRef[query[i].lvl].push_back(ref[i]);
+	}
+	std::vector<DWORD> idx;
+	for (auto &l : perLvl) {
+		mgr->Idx(l.first, l.second, idx);
+		if (idx != perLvlRef[l.first])
+			nbad++;
+	}
+
+	// blocks of BLOCK x BLOCK neighbouring tiles around archive tiles, as
+	// loaded by the tile blocks of the editor
+	std::vector<std::pair<int, std::vector<std::pair<int, int> > > > blocks;
+	for (size_t i = 0; i < query.size() && blocks.size() < NBLOCK; i += 2) {
+		const ZTreeMgr::NodeRef &q = query[i];
+		std::vector<std::pair<int, int> > tiles;
+		int nlat = 1 << (q.lvl - 4), nlng = 1 << (q.lvl - 3);
+		for (int y = 0; y < BLOCK; y++)
+			for (int x = 0; x < BLOCK; x++)
+				tiles.push_back(std::make_pair((q.ilat + y) % nlat, (q.ilng + x) % nlng));
+		blocks.push_back(std::make_pair(q.lvl, tiles));
+	}
+	for (auto &b : blocks) {
+		mgr->Idx(b.first, b.second, idx);
+		for (size_t i = 0; i < b.second.size(); i++)
+			if (idx[i] != idxRecursive(mgr, b.first, b.second[i].first, b.second[i].second))
+				nbad++;
+	}
+
+	// timing
+	DWORD sum = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &q : query)
+			sum += idxRecursive(mgr, q.lvl, q.ilat, q.ilng);
+	double tRec = seconds(t0);
+	t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &q : query)
+			sum += mgr->Idx(q.lvl, q.ilat, q.ilng);
+	double tIdx = seconds(t0);
+	t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &l : perLvl) {
+			mgr->Idx(l.first, l.second, idx);
+			sum += idx[0];
+		}
+	double tBatch = seconds(t0);
+
+	size_t nblk = 0;
+	for (auto &b : blocks)
+		nblk += b.second.size();
+	t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &b : blocks)
+			for (auto &t : b.second)
+				sum += idxRecursive(mgr, b.first, t.first, t.second);
+	double tBlkRec = seconds(t0);
+	t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &b : blocks)
+			for (auto &t : b.second)
+				sum += mgr->Idx(b.first, t.first, t.second);
+	double tBlkIdx = seconds(t0);
+	t0 = std::chrono::steady_clock::now();
+	for (int r = 0; r < NREP; r++)
+		for (auto &b : blocks) {
+			mgr->Idx(b.first, b.second, idx);
+			sum += idx[0];
+		}
+	double tBlkBatch = seconds(t0);
+
+	double n = (double)NREP * query.size();
+	std::cout << ZTreeMgr::LayerName(layer) << ": " << mgr->TOC().size() << " nodes, " << query.size()
+		<< " lookups at levels 5-" << maxlvl << " (checksum " << sum << ")" << std::endl;
+	std::cout << "recursive descent: " << n / tRec * 1e-6 << " M lookups/s" << std::endl;
+	std::cout << "Idx:               " << n / tIdx * 1e-6 << " M lookups/s" << std::endl;
+	std::cout << "batch Idx:         " << n / tBatch * 1e-6 << " M lookups/s" << std::endl;
+	n = (double)NREP * nblk;
+	std::cout << blocks.size() << " blocks of " << BLOCK << "x" << BLOCK << " tiles:" << std::endl;
+	std::cout << "recursive descent: " << n / tBlkRec * 1e-6 << " M lookups/s" << std::endl;
+	std::cout << "Idx:               " << n / tBlkIdx * 1e-6 << " M lookups/s" << std::endl;
+	std::cout << "batch Idx:         " << n / tBlkBatch * 1e-6 << " M lookups/s" << std::endl;
+	std::cout << nbad << " mismatches" << std::endl;
+	delete mgr;
+	return (nbad ? 1 : 0);
+}
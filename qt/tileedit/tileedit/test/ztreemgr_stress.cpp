@@ -0,0 +1,113 @@
+// =======================================================================
+// ztreemgr_stress.cpp
+// Concurrent read stress test for ZTreeMgr. Reads every node with data of
+// a layer archive once on a single thread, then reads random nodes from
+// many threads at once, in both read modes and with and without the node
+// cache, and checks each result against the single-threaded read.
+//
+// Standalone (no Qt). Build from this directory, e.g.
+//     cl /O2 /EHsc /I.. /I..\..\extern\zlib\include ztreemgr_stress.cpp ..\ZTreeMgr.cpp
+//        ..\nodecache.cpp ..\fastinflate.cpp ..\..\extern\zlib\lib\zdll.lib
+// Usage:
+//     ztreemgr_stress <planet dir> [Surf|Mask|Elev|Elev_mod] [threads]
+// Returns 0 if all reads matched.
+// =======================================================================
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <string.h>
+#include "ZTreeMgr.h"
+#include "nodecache.h"
+
+#define NREAD_PER_THREAD 2000
+
+static ZTreeMgr::Layer layerFromName(const char *name)
+{
+	if (!strcmp(name, "Mask")) return ZTreeMgr::LAYER_MASK;
+	if (!strcmp(name, "Elev")) return ZTreeMgr::LAYER_ELEV;
+	if (!strcmp(name, "Elev_mod")) return ZTreeMgr::LAYER_ELEVMOD;
+	return ZTreeMgr::LAYER_SURF;
+}
+
+static int stress(const ZTreeMgr *mgr, const std::vector<ZTreeMgr::NodeRef> &nodes,
+	const std::vector<std::vector<BYTE> > &ref, int nthread, bool byTile)
+{
+	// Threads read random nodes, by TOC index or (through the node cache, if
+	// set) by tile coordinates, and count mismatches.
+	std::atomic<int> nbad(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < nthread; t++) {
+		threads.push_back(std::thread([&, t]() {
+			std::mt19937 rng(t + 1);
+			for (int i = 0; i < NREAD_PER_THREAD; i++) {
+				size_t k = rng() % nodes.size();
+				const ZTreeMgr::NodeRef &node = nodes[k];
+				BYTE *buf;
+				DWORD ndata = (byTile ? mgr->ReadData(node.lvl, node.ilat, node.ilng, &buf) : mgr->ReadData(node.idx, &buf));
+				if (ndata != ref[k].size() || (ndata && memcmp(buf, ref[k].data(), ndata)))
+					nbad++;
+				if (ndata)
+					mgr->ReleaseData(buf);
+			}
+		}));
+	}
+	for (auto &th : threads)
+		th.join();
+	return nbad;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: ztreemgr_stress <planet dir> [Surf|Mask|Elev|Elev_mod] [threads]" << std::endl;
+		return 2;
+	}
+	ZTreeMgr::Layer layer = (argc > 2 ? layerFromName(argv[2]) : ZTreeMgr::LAYER_SURF);
+	int nthread = (argc > 3 ? atoi(argv[3]) : 0);
+	if (nthread <= 0)
+		nthread = 2 * std::max(1u, std::thread::hardware_concurrency());
+
+	int nbad = 0;
+	NodeCache cache((size_t)16 << 20); // small, so entries are evicted while reading
+	ZTreeMgr::ReadMode modes[2] = { ZTreeMgr::READMODE_FILE, ZTreeMgr::READMODE_MAPPED };
+	for (int m = 0; m < 2; m++) {
+		ZTreeMgr *mgr = ZTreeMgr::CreateFromFile(argv[1], layer, modes[m]);
+		if (!mgr) {
+			std::cerr << "Could not open the " << ZTreeMgr::LayerName(layer) << " archive" << std::endl;
+			return 2;
+		}
+
+		std::vector<ZTreeMgr::NodeRef> nodes;
+		mgr->Nodes(nodes);
+		if (!nodes.size()) {
+			std::cerr << "Archive has no nodes with data" << std::endl;
+			delete mgr;
+			return 2;
+		}
+		std::vector<std::vector<BYTE> > ref(nodes.size());
+		for (size_t k = 0; k < nodes.size(); k++) {
+			BYTE *buf;
+			DWORD ndata = mgr->ReadData(nodes[k].idx, &buf);
+			if (ndata) {
+				ref[k].assign(buf, buf + ndata);
+				mgr->ReleaseData(buf);
+			}
+		}
+
+		for (int c = 0; c < 2; c++) {
+			ZTreeMgr::SetNodeCache(c ? &cache : 0);
+			int nb = stress(mgr, nodes, ref, nthread, false) + stress(mgr, nodes, ref, nthread, true);
+			std::cout << (modes[m] == ZTreeMgr::READMODE_FILE ? "file" : "mapped") << " reads, "
+				<< (c ? "with" : "without") << " node cache: " << nodes.size() << " nodes, "
+				<< nthread << " threads, " << nb << " mismatches" << std::endl;
+			nbad += nb;
+			cache.clear();
+		}
+		ZTreeMgr::SetNodeCache(0);
+		delete mgr;
+	}
+	return (nbad ? 1 : 0);
+}
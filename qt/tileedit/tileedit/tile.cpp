@@ -5,10 +5,12 @@
 #include <algorithm>
 #include <direct.h>
 #include <dxt_io.h>
+#include "parallel.h"
 
 int Tile::s_openMode = 0x3;
 TileLoadMode Tile::s_globalLoadMode = TILELOADMODE_ANCESTORSUBSECTION;
 std::string Tile::s_root;
+DXT1Quality DXT1Tile::s_saveQuality = DXT1_FAST;
 
 // ==================================================================================
 
@@ -98,14 +100,19 @@ DXT1Tile::DXT1Tile(const DXT1Tile &tile)
 	: Tile(tile)
 {
 	m_idata = tile.m_idata;
+	m_dxt1 = tile.m_dxt1;
+	m_dirty = tile.m_dirty;
 }
 
 void DXT1Tile::set(const Tile *tile)
 {
 	Tile::set(tile);
 	const DXT1Tile *dxt1tile = dynamic_cast<const DXT1Tile*>(tile);
-	if (dxt1tile)
+	if (dxt1tile) {
 		m_idata = dxt1tile->m_idata;
+		m_dxt1 = dxt1tile->m_dxt1;
+		m_dirty = dxt1tile->m_dirty;
+	}
 }
 
 int DXT1Tile::TileSize() const
@@ -113,12 +120,62 @@ int DXT1Tile::TileSize() const
 	return (m_lvl == 1 ? 128 : m_lvl == 2 ? 256 : TILE_SURFSTRIDE);
 }
 
+void DXT1Tile::resetDirty()
+{
+	size_t nblock = (m_idata.width / 4) * (m_idata.height / 4);
+	if (nblock && m_dxt1.size() == nblock * 8) {
+		m_dirty.assign(nblock, 0);
+	}
+	else {
+		m_dxt1.clear();
+		m_dirty.clear();
+	}
+}
+
+void DXT1Tile::setSaveQuality(DXT1Quality quality)
+{
+	s_saveQuality = quality;
+}
+
 void DXT1Tile::SaveDXT1()
 {
+	SaveDXT1(std::vector<DXT1Tile*>(1, this));
+}
+
+void DXT1Tile::SaveDXT1(const std::vector<DXT1Tile*> &tiles)
+{
+	// Tiles with a valid compressed copy only re-encode their dirty blocks.
+	// The others are compressed from scratch, concurrently.
+	std::vector<const Image*> images;
+	std::vector<std::vector<BYTE>*> dxt1;
+	std::vector<DXT1Tile*> partial;
+	for (size_t i = 0; i < tiles.size(); i++) {
+		DXT1Tile *tile = tiles[i];
+		const Image &im = tile->m_idata;
+		size_t nblock = (im.width / 4) * (im.height / 4);
+		bool valid = tile->m_dxt1.size() == nblock * 8 && tile->m_dirty.size() == nblock;
+		if (valid && std::find(tile->m_dirty.begin(), tile->m_dirty.end(), 0) != tile->m_dirty.end()) {
+			partial.push_back(tile);
+		}
+		else {
+			images.push_back(&im);
+			dxt1.push_back(&tile->m_dxt1);
+		}
+	}
+	if (images.size())
+		dxt1compress(images, dxt1, s_saveQuality);
+	parallelFor((int)partial.size(), [&](int i) {
+		dxt1compress(partial[i]->m_idata, partial[i]->m_dxt1, partial[i]->m_dirty, s_saveQuality);
+	});
+
 	char path[1024];
-	sprintf(path, "%s/%s/%02d/%06d/%06d.dds", s_root.c_str(), Layer().c_str(), m_lvl, m_ilat, m_ilng);
-	ensureLayerDir();
-	dxt1write(path, m_idata);
+	for (size_t i = 0; i < tiles.size(); i++) {
+		DXT1Tile *tile = tiles[i];
+		sprintf(path, "%s/%s/%02d/%06d/%06d.dds", s_root.c_str(), tile->Layer().c_str(), tile->m_lvl, tile->m_ilat, tile->m_ilng);
+		tile->ensureLayerDir();
+		dxt1write(path, tile->m_idata, tile->m_dxt1);
+		tile->resetDirty();
+	}
 }
 
 void DXT1Tile::SavePNGtmp()
@@ -131,7 +188,9 @@ void DXT1Tile::SavePNGtmp()
 
 bool DXT1Tile::LoadDXT1(const ZTreeMgr *mgr, TileLoadMode mode)
 {
-	LoadData(m_idata, m_lvl, m_ilat, m_ilng, mgr);
+	m_dxt1.clear();
+	LoadData(m_idata, m_lvl, m_ilat, m_ilng, mgr, DDS_FULLRANGE, DDS_FULLRANGE, &m_dxt1);
+	resetDirty();
 	if (!m_idata.data.size()) {
 		if (mode == TILELOADMODE_USEGLOBALSETTING)
 			mode = s_globalLoadMode;
@@ -148,6 +207,13 @@ bool DXT1Tile::LoadPNGtmp()
 	bool ok = pngread_tmp(path, m_idata);
 	if (ok && (m_idata.width != TileSize() || m_idata.height != TileSize()))
 		ok = false;
+	m_dxt1.clear();
+	if (ok) {
+		// the cached DDS file is written together with the PNG copy
+		sprintf(path, "%s/%s/%02d/%06d/%06d.dds", s_root.c_str(), Layer().c_str(), m_lvl, m_ilat, m_ilng);
+		ddsread(path, std::pair<DWORD, DWORD>(0, 0), std::pair<DWORD, DWORD>(0, 0), &m_dxt1);
+	}
+	resetDirty();
 	return ok;
 }
 
@@ -170,28 +236,26 @@ void DXT1Tile::LoadSubset(const ZTreeMgr *mgr)
 		m_subilat /= 2;
 		m_subilng /= 2;
 
-		LoadData(m_idata, m_sublvl, m_subilat, m_subilng, mgr);
+		LoadData(m_idata, m_sublvl, m_subilat, m_subilng, mgr, lng_subrange, lat_subrange);
 		if (m_idata.data.size() == 0) {
 			LoadSubset(mgr);
 		}
-		else {
-			m_idata = m_idata.SubImage(lng_subrange, lat_subrange);
-		}
 	}
 }
 
-void DXT1Tile::LoadData(Image &im, int lvl, int ilat, int ilng, const ZTreeMgr *mgr)
+void DXT1Tile::LoadData(Image &im, int lvl, int ilat, int ilng, const ZTreeMgr *mgr,
+	const std::pair<DWORD, DWORD> &xrange, const std::pair<DWORD, DWORD> &yrange, std::vector<BYTE> *dxt1)
 {
 	if (s_openMode & 0x1) { // try cache
 		char path[1024];
 		sprintf(path, "%s/%s/%02d/%06d/%06d.dds", s_root.c_str(), Layer().c_str(), lvl, ilat, ilng);
-		im = ddsread(path);
+		im = ddsread(path, xrange, yrange, dxt1);
 	}
 	if (im.data.size() == 0 && s_openMode & 0x2 && mgr) { // try archive
 		BYTE *buf;
 		DWORD ndata = mgr->ReadData(lvl, ilat, ilng, &buf);
 		if (ndata) {
-			im = ddsscan(buf, ndata);
+			im = ddsscan(buf, ndata, xrange, yrange, dxt1);
 			mgr->ReleaseData(buf);
 		}
 	}
@@ -262,6 +326,14 @@ void SurfTile::Save()
 	SaveDXT1();
 }
 
+void SurfTile::Save(const std::vector<SurfTile*> &tiles)
+{
+	parallelFor((int)tiles.size(), [&](int i) {
+		tiles[i]->SavePNGtmp();
+	});
+	SaveDXT1(std::vector<DXT1Tile*>(tiles.begin(), tiles.end()));
+}
+
 bool SurfTile::InterpolateFromAncestor()
 {
 	if (m_lvl <= 4) return false;
@@ -317,6 +389,7 @@ bool SurfTile::mapToAncestors(int minlvl) const
 			DWORD v = 0xff000000 | c1 | (c2 << 8) | (c3 << 16);
 			if (v != idata.data[xofs + x + (yofs + y) * TILE_SURFSTRIDE]) {
 				idata.data[xofs + x + (yofs + y)*TILE_SURFSTRIDE] = v;
+				stile->markDirty(xofs + x, yofs + y);
 				isModified = true;
 			}
 		}
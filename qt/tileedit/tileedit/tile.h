@@ -24,6 +24,12 @@ enum TileLoadMode {
 	TILELOADMODE_ANCESTORINTERPOLATE
 };
 
+enum DXT1Quality {
+	DXT1_FAST,   // bounding box end points (SIMD, for interactive saves)
+	DXT1_NORMAL, // best of bounding box and luminance end points, exact indices
+	DXT1_HIGH    // principal axis end points with least squares refinement
+};
+
 inline int nLat(int lvl) { return (lvl < 4 ? 1 : 1 << (lvl - 4)); }
 inline int nLng(int lvl) { return (lvl < 4 ? 1 : 1 << (lvl - 3)); }
 
@@ -90,17 +96,31 @@ public:
 	Image &getData() { return m_idata; }
 	const Image &getData() const { return m_idata; }
 	int TileSize() const;
+	void markDirty(int x, int y)
+	{ if (m_dirty.size()) m_dirty[(y / 4) * (m_idata.width / 4) + x / 4] = 1; }
+	// flag the 4x4 block containing pixel (x,y) for re-encoding on save
+
+	static void setSaveQuality(DXT1Quality quality);
+	// DXT1 encoder tier used when tiles are saved
 
 protected:
 	void SaveDXT1();
+	static void SaveDXT1(const std::vector<DXT1Tile*> &tiles);
 	void SavePNGtmp();
 	bool LoadDXT1(const ZTreeMgr *mgr = 0, TileLoadMode mode = TILELOADMODE_USEGLOBALSETTING);
 	bool LoadPNGtmp();
 	void LoadSubset(const ZTreeMgr *mgr = 0);
-	void LoadData(Image &im, int lvl, int ilat, int ilng, const ZTreeMgr *mgr);
+	void LoadData(Image &im, int lvl, int ilat, int ilng, const ZTreeMgr *mgr,
+		const std::pair<DWORD, DWORD> &xrange = DDS_FULLRANGE, const std::pair<DWORD, DWORD> &yrange = DDS_FULLRANGE,
+		std::vector<BYTE> *dxt1 = 0);
 	TileBlock *ProlongToChildren() const;
+	void resetDirty();
 
 	Image m_idata;
+	std::vector<BYTE> m_dxt1;  // compressed blocks of m_idata as loaded, if available
+	std::vector<BYTE> m_dirty; // per 4x4 block: modified since load or last save
+
+	static DXT1Quality s_saveQuality;
 };
 
 class SurfTile: public DXT1Tile
@@ -110,6 +130,8 @@ public:
 	static SurfTile *Load(int lvl, int ilat, int ilng, TileLoadMode mode = TILELOADMODE_USEGLOBALSETTING);
 	static SurfTile *InterpolateFromAncestor(int lvl, int ilat, int ilng);
 	void Save();
+	static void Save(const std::vector<SurfTile*> &tiles);
+	// save several tiles, compressing them concurrently
 	static void setTreeMgr(const ZTreeMgr *mgr);
 	const std::string Layer() const { return std::string("Surf"); }
 	bool mapToAncestors(int minlvl) const;
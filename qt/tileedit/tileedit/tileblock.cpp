@@ -1,8 +1,11 @@
 #include "tileblock.h"
 #include "elv_io.h"
+#include "parallel.h"
 #include <algorithm>
+#include <atomic>
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <emmintrin.h>
 
 TileBlock::TileBlock(int lvl, int ilat0, int ilat1, int ilng0, int ilng1)
 {
@@ -109,6 +112,29 @@ DXT1TileBlock::DXT1TileBlock(int lvl, int ilat0, int ilat1, int ilng0, int ilng1
 	m_idata.data.resize(m_idata.width * m_idata.height);
 }
 
+void DXT1TileBlock::stitchImage(int ilat, int ilng, const Image &im, int tilesize)
+{
+	int yrep = tilesize / im.height;
+	int xrep = tilesize / im.width;
+	DWORD *dst = m_idata.data.data() + (ilat - m_ilat0) * tilesize * m_idata.width + (ilng - m_ilng0) * tilesize;
+	const DWORD *src = im.data.data();
+
+	for (int i = 0; i < im.height; i++, src += im.width) {
+		DWORD *row = dst;
+		if (xrep == 1) {
+			memcpy(row, src, im.width * sizeof(DWORD));
+		}
+		else {
+			for (int j = 0; j < im.width; j++)
+				for (int jj = 0; jj < xrep; jj++)
+					row[j*xrep + jj] = src[j];
+		}
+		dst += m_idata.width;
+		for (int ii = 1; ii < yrep; ii++, dst += m_idata.width)
+			memcpy(dst, row, tilesize * sizeof(DWORD));
+	}
+}
+
 
 SurfTileBlock::SurfTileBlock(int lvl, int ilat0, int ilat1, int ilng0, int ilng1)
 	: DXT1TileBlock(lvl, ilat0, ilat1, ilng0, ilng1)
@@ -175,8 +201,11 @@ void SurfTileBlock::syncTile(int ilat, int ilng)
 
 	for (int y = 0; y < tilesize; y++) {
 		for (int x = 0; x < tilesize; x++) {
-			stile->getData().data[y*tilesize + x] =
-				m_idata.data[(block_y0 + y) * m_idata.width + (block_x0 + x)];
+			DWORD v = m_idata.data[(block_y0 + y) * m_idata.width + (block_x0 + x)];
+			if (idata.data[y*tilesize + x] != v) {
+				idata.data[y*tilesize + x] = v;
+				stile->markDirty(x, y);
+			}
 		}
 	}
 }
@@ -191,34 +220,25 @@ SurfTileBlock *SurfTileBlock::Load(int lvl, int ilat0, int ilat1, int ilng0, int
 	stileblock->m_idata.height = tilesize*stileblock->m_nblocklat;
 	stileblock->m_idata.data.resize(stileblock->m_idata.width * stileblock->m_idata.height);
 
-	for (int ilat = ilat0; ilat < ilat1; ilat++) {
-		for (int ilng = ilng0; ilng < ilng1; ilng++) {
-			int idx = (ilat - ilat0)*stileblock->m_nblocklng + (ilng - ilng0);
-			SurfTile *stile = SurfTile::Load(lvl, ilat, ilng, TILELOADMODE_ANCESTORSUBSECTION);
-			if (!stile) {
-				delete stileblock;
-				return 0;
-			}
-			stileblock->m_tile[idx] = stile;
-			const Image &im = stile->getData();
-			int yrep = tilesize / im.height;
-			int xrep = tilesize / im.width;
-			int yofs = (ilat - ilat0) * tilesize;
-			int xofs = (ilng - ilng0) * tilesize;
-
-			for (int i = 0; i < im.height; i++) {
-				for (int ii = 0; ii < yrep; ii++) {
-					for (int j = 0; j < im.width; j++) {
-						for (int jj = 0; jj < xrep; jj++) {
-							DWORD v = im.data[i*im.width + j];
-							int idx = yofs * stileblock->m_idata.width + xofs + j*xrep + jj;
-							stileblock->m_idata.data[idx] = v;
-						}
-					}
-					yofs++;
-				}
-			}
+	// The tiles are independent and are stitched into disjoint regions of
+	// m_idata, so they can be loaded in parallel without locking.
+	std::atomic<bool> ok(true);
+	parallelFor(stileblock->nBlock(), [&](int idx) {
+		if (!ok)
+			return;
+		int ilat = ilat0 + idx / stileblock->m_nblocklng;
+		int ilng = ilng0 + idx % stileblock->m_nblocklng;
+		SurfTile *stile = SurfTile::Load(lvl, ilat, ilng, TILELOADMODE_ANCESTORSUBSECTION);
+		if (!stile) {
+			ok = false;
+			return;
 		}
+		stileblock->m_tile[idx] = stile;
+		stileblock->stitchImage(ilat, ilng, stile->getData(), tilesize);
+	});
+	if (!ok) {
+		delete stileblock;
+		return 0;
 	}
 	return stileblock;
 }
@@ -279,34 +299,25 @@ MaskTileBlock *MaskTileBlock::Load(int lvl, int ilat0, int ilat1, int ilng0, int
 	mtileblock->m_idata.height = tilesize*mtileblock->m_nblocklat;
 	mtileblock->m_idata.data.resize(mtileblock->m_idata.width * mtileblock->m_idata.height);
 
-	for (int ilat = ilat0; ilat < ilat1; ilat++) {
-		for (int ilng = ilng0; ilng < ilng1; ilng++) {
-			int idx = (ilat - ilat0)*mtileblock->m_nblocklng + (ilng - ilng0);
-			MaskTile *mtile = MaskTile::Load(lvl, ilat, ilng);
-			if (!mtile) {
-				delete mtileblock;
-				return 0;
-			}
-			mtileblock->m_tile[idx] = mtile;
-			const Image &im = mtile->getData();
-			int yrep = tilesize / im.height;
-			int xrep = tilesize / im.width;
-			int yofs = (ilat - ilat0) * tilesize;
-			int xofs = (ilng - ilng0) * tilesize;
-
-			for (int i = 0; i < im.height; i++) {
-				for (int ii = 0; ii < yrep; ii++) {
-					for (int j = 0; j < im.width; j++) {
-						for (int jj = 0; jj < xrep; jj++) {
-							DWORD v = im.data[i*im.width + j];
-							int idx = yofs * mtileblock->m_idata.width + xofs + j*xrep + jj;
-							mtileblock->m_idata.data[idx] = v;
-						}
-					}
-					yofs++;
-				}
-			}
+	// The tiles are independent and are stitched into disjoint regions of
+	// m_idata, so they can be loaded in parallel without locking.
+	std::atomic<bool> ok(true);
+	parallelFor(mtileblock->nBlock(), [&](int idx) {
+		if (!ok)
+			return;
+		int ilat = ilat0 + idx / mtileblock->m_nblocklng;
+		int ilng = ilng0 + idx % mtileblock->m_nblocklng;
+		MaskTile *mtile = MaskTile::Load(lvl, ilat, ilng);
+		if (!mtile) {
+			ok = false;
+			return;
 		}
+		mtileblock->m_tile[idx] = mtile;
+		mtileblock->stitchImage(ilat, ilng, mtile->getData(), tilesize);
+	});
+	if (!ok) {
+		delete mtileblock;
+		return 0;
 	}
 	return mtileblock;
 }
@@ -321,10 +332,6 @@ ElevTileBlock::ElevTileBlock(int lvl, int ilat0, int ilat1, int ilng0, int ilng1
 	m_edata.height = (ilat1 - ilat0) * TILE_FILERES + 3;
 	m_edata.data.resize(m_edata.width * m_edata.height);
 
-	m_edataBase.width = (ilng1 - ilng0) * TILE_FILERES + 3;
-	m_edataBase.height = (ilat1 - ilat0) * TILE_FILERES + 3;
-	m_edataBase.data.resize(m_edataBase.width * m_edataBase.height);
-
 	m_isModified = false;
 }
 
@@ -338,7 +345,8 @@ ElevTileBlock::ElevTileBlock(const ElevTileBlock &etileblock)
 		}
 
 	m_edata = etileblock.m_edata;
-	m_edataBase = etileblock.m_edataBase;
+	m_mod = etileblock.m_mod;
+	m_limits = etileblock.m_limits;
 	m_isModified = etileblock.m_isModified;
 }
 
@@ -347,24 +355,41 @@ ElevTileBlock *ElevTileBlock::Load(int lvl, int ilat0, int ilat1, int ilng0, int
 	ElevTileBlock *tileblock = new ElevTileBlock(lvl, ilat0, ilat1, ilng0, ilng1);
 	int nlat = tileblock->nLat();
 	int nlng = tileblock->nLng();
-	for (int ilat = ilat0; ilat < ilat1; ilat++) {
-		if (ilat < 0 || ilat >= nlat) continue;
-		for (int ilng = ilng0; ilng < ilng1; ilng++) {
-			int idx = (ilat - ilat0)*tileblock->m_nblocklng + (ilng - ilng0);
-			int ilngn = ilng;
-			while (ilngn < 0) ilngn += nlng;
-			while (ilngn >= nlng) ilngn -= nlng;
-			ElevTile *tile = ElevTile::Load(lvl, ilat, ilngn);
-			if (!tile) {
-				delete tileblock;
-				return 0;
-			}
-			if (tile->m_edata.width < TILE_ELEVSTRIDE)
-				tile->InterpolateFromAncestor();
-			tileblock->setTile(ilat, ilng, tile);
-			tileblock->m_tile[idx] = tile;
+
+	// load the tiles in parallel ...
+	std::atomic<bool> ok(true);
+	parallelFor(tileblock->nBlock(), [&](int idx) {
+		int ilat = ilat0 + idx / tileblock->m_nblocklng;
+		int ilng = ilng0 + idx % tileblock->m_nblocklng;
+		if (!ok || ilat < 0 || ilat >= nlat)
+			return;
+		int ilngn = ilng;
+		while (ilngn < 0) ilngn += nlng;
+		while (ilngn >= nlng) ilngn -= nlng;
+		ElevTile *tile = ElevTile::Load(lvl, ilat, ilngn);
+		if (!tile) {
+			ok = false;
+			return;
 		}
+		if (tile->m_edata.width < TILE_ELEVSTRIDE)
+			tile->InterpolateFromAncestor();
+		tileblock->m_tile[idx] = tile;
+	});
+	if (!ok) {
+		delete tileblock;
+		return 0;
 	}
+
+	// ... and stitch them serially, since neighbouring tiles share their boundary nodes
+	tileblock->m_mod.beginBatch(); // the tiles' nodes interleave in the block
+	for (int idx = 0; idx < tileblock->nBlock(); idx++) {
+		int ilat = ilat0 + idx / tileblock->m_nblocklng;
+		int ilng = ilng0 + idx % tileblock->m_nblocklng;
+		if (tileblock->m_tile[idx])
+			tileblock->stitchTile(ilat, ilng, (ElevTile*)tileblock->m_tile[idx]);
+	}
+	tileblock->m_mod.endBatch();
+	tileblock->dataChanged();
 	tileblock->m_isModified = false;
 
 	return tileblock;
@@ -409,7 +434,23 @@ bool ElevTileBlock::setTile(int ilat, int ilng, const Tile *tile)
 	if (ilat < m_ilat0 || ilat >= m_ilat1) return false;
 	if (ilng < m_ilng0 || ilng >= m_ilng1) return false;
 
-	const ElevTile *etile = static_cast<const ElevTile*>(tile);
+	m_mod.beginBatch();
+	stitchTile(ilat, ilng, static_cast<const ElevTile*>(tile));
+	m_mod.endBatch();
+	dataChanged();
+	return true;
+}
+
+void ElevTileBlock::setData(const ElevData &edata)
+{
+	for (DWORD i = 0; i < edata.data.size(); i++)
+		if (edata.data[i] != m_edata.data[i])
+			m_mod.update(i, m_edata.data[i], edata.data[i], edata.data.size());
+	m_edata = edata;
+}
+
+void ElevTileBlock::stitchTile(int ilat, int ilng, const ElevTile *etile)
+{
 
 	int nlat = nLat();
 	int nlng = nLng();
@@ -425,16 +466,19 @@ bool ElevTileBlock::setTile(int ilat, int ilng, const Tile *tile)
 	int y0 = (yblock == 0 || ilat == nlat - 1 ? 0 : 1);
 	int y1 = (yblock == m_ilat1 - m_ilat0 - 1 || ilat == 0 ? TILE_ELEVSTRIDE : TILE_ELEVSTRIDE - 1);
 
+	// the modification state only needs transferring if either side has any
+	const ElevModData &emod = etile->getModData();
+	bool hasMod = !emod.empty() || !m_mod.empty();
+
 	for (int y = y0; y < y1; y++) {
 		for (int x = x0; x < x1; x++) {
-			m_edata.data[(block_y0 + y) * m_edata.width + (block_x0 + x)] =
-				etile->getData().data[y*TILE_ELEVSTRIDE + x];
-			m_edataBase.data[(block_y0 + y) * m_edataBase.width + (block_x0 + x)] =
-				etile->getBaseData().data[y*TILE_ELEVSTRIDE + x];
+			int idx = (block_y0 + y) * m_edata.width + (block_x0 + x);
+			elev_t v = etile->getData().data[y*TILE_ELEVSTRIDE + x];
+			m_edata.data[idx] = v;
+			if (hasMod)
+				m_mod.setNode(idx, emod.baseValue(y*TILE_ELEVSTRIDE + x, v), v, m_edata.data.size());
 		}
 	}
-	dataChanged();
-	return true;
 }
 
 void ElevTileBlock::Save()
@@ -518,14 +562,13 @@ void ElevTileBlock::syncTile(int ilat, int ilng)
 		m_tile[idx] = etile;
 	}
 	ElevData &edata = etile->getData();
+	ElevModData &emod = etile->getModData();
+	bool isNew = false;
 	if (edata.width < TILE_ELEVSTRIDE || edata.height < TILE_ELEVSTRIDE) {
 		edata.width = edata.height = TILE_ELEVSTRIDE;
 		edata.data.resize(edata.width * edata.height);
-	}
-	ElevData &ebdata = etile->getBaseData();
-	if (ebdata.width < TILE_ELEVSTRIDE || ebdata.height < TILE_ELEVSTRIDE) {
-		ebdata.width = ebdata.height = TILE_ELEVSTRIDE;
-		ebdata.data.resize(ebdata.width * ebdata.height);
+		emod.clear();
+		isNew = true; // no base of its own: take over the block's
 	}
 
 	int xblock = ilng - m_ilng0;
@@ -536,10 +579,18 @@ void ElevTileBlock::syncTile(int ilat, int ilng)
 
 	for (int y = 0; y < TILE_ELEVSTRIDE; y++) {
 		for (int x = 0; x < TILE_ELEVSTRIDE; x++) {
-			double v_old = etile->getData().data[y*TILE_ELEVSTRIDE + x];
-			double v_new = m_edata.data[(block_y0 + y) * m_edata.width + (block_x0 + x)];
+			int idx = y*TILE_ELEVSTRIDE + x;
+			int bidx = (block_y0 + y) * m_edata.width + (block_x0 + x);
+			elev_t v_old = edata.data[idx];
+			elev_t v_new = m_edata.data[bidx];
+			if (isNew) {
+				if (!m_mod.empty())
+					emod.setNode(idx, m_mod.baseValue(bidx, v_new), v_new, edata.data.size());
+			}
+			else if (v_old != v_new)
+				emod.update(idx, v_old, v_new, edata.data.size());
 			if (v_old != v_new) {
-				etile->getData().data[y*TILE_ELEVSTRIDE + x] = v_new;
+				edata.data[idx] = v_new;
 				etile->m_modified = true;
 			}
 		}
@@ -642,17 +693,19 @@ double ElevTileBlock::nodeElevation(int ndx, int ndy) const
 double ElevTileBlock::nodeModElevation(int ndx, int ndy) const
 {
 	int idx = (ndy + 1)*m_edata.width + (ndx + 1);
-	double v = m_edata.data[idx];
-	double v0 = m_edataBase.data[idx];
-	return (v != v0 ? v : DBL_MAX);
+	return (m_mod.isModified(idx) ? m_edata.data[idx] : DBL_MAX);
 }
 
 void ElevTileBlock::dataChanged(int exmin, int exmax, int eymin, int eymax)
 {
 	m_isModified = true;
-	auto minmax = std::minmax_element(m_edata.data.begin(), m_edata.data.end());
-	m_edata.dmin = *minmax.first;
-	m_edata.dmax = *minmax.second;
+
+	if (exmin < 0 && exmax < 0 && eymin < 0 && eymax < 0)
+		m_limits.build(m_edata);
+	else
+		m_limits.update(m_edata, exmin < 0 ? 0 : exmin, exmax < 0 ? INT_MAX : exmax, eymin < 0 ? 0 : eymin, eymax < 0 ? INT_MAX : eymax);
+	m_edata.dmin = m_limits.dmin();
+	m_edata.dmax = m_limits.dmax();
 }
 
 void ElevTileBlock::RescanLimits()
@@ -660,6 +713,119 @@ void ElevTileBlock::RescanLimits()
 	m_edata.RescanLimits();
 }
 
+// ==================================================================================
+// Colour map rendering. The image shows the node grid without its padding,
+// upsampled 2x: pixel i of row j shows node ((i+1)/2+1, (height-j)/2+1). Each
+// node row is coloured once and expanded to pixel pairs in a row buffer, which
+// is copied to both image rows showing it.
+
+static void colourNodes(const elev_t *e, int n, double dmin, double dscale, const Cmap &cm, DWORD *col)
+{
+	// v = max(min((int)((e - dmin) * dscale), 255), 0), four nodes at a time.
+	// The clamp is applied after saturating to 16 bit, which gives the same result.
+	const __m128d m = _mm_set1_pd(dmin);
+	const __m128d s = _mm_set1_pd(dscale);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i vmax = _mm_set1_epi16(255);
+	int v[4];
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128 e4 = _mm_loadu_ps(e + i);
+		__m128i v0 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(e4), m), s));
+		__m128i v1 = _mm_cvttpd_epi32(_mm_mul_pd(_mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(e4, e4)), m), s));
+		__m128i v4 = _mm_packs_epi32(_mm_unpacklo_epi64(v0, v1), zero);
+		v4 = _mm_min_epi16(_mm_max_epi16(v4, zero), vmax);
+		_mm_storeu_si128((__m128i*)v, _mm_unpacklo_epi16(v4, zero));
+		col[i] = 0xff000000 | cm[v[0]];
+		col[i + 1] = 0xff000000 | cm[v[1]];
+		col[i + 2] = 0xff000000 | cm[v[2]];
+		col[i + 3] = 0xff000000 | cm[v[3]];
+	}
+	for (; i < n; i++) {
+		int vi = max(min((int)((e[i] - dmin) * dscale), 255), 0);
+		col[i] = 0xff000000 | cm[vi];
+	}
+}
+
+static void expandNodes(const DWORD *col, int n, DWORD *pix)
+{
+	int i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i c = _mm_loadu_si128((const __m128i*)(col + i));
+		_mm_storeu_si128((__m128i*)(pix + i * 2), _mm_unpacklo_epi32(c, c));
+		_mm_storeu_si128((__m128i*)(pix + i * 2 + 4), _mm_unpackhi_epi32(c, c));
+	}
+	for (; i < n; i++)
+		pix[i * 2] = pix[i * 2 + 1] = col[i];
+}
+
+static void renderElevation(const ElevData &edata, const BYTE *modMask, bool modOnly, double dmin, double dscale,
+	const Cmap &cm, Image &img, int imin, int imax, int jmin, int jmax)
+{
+	// If modOnly is set, only the nodes flagged in modMask are coloured and the
+	// others show a checkerboard background.
+	if (imin >= imax)
+		return;
+
+	// node columns k+1 (k = k0..k1) cover pixels imin..imax-1, and pixel i is
+	// stored at pix[i+1]
+	int k0 = (imin + 1) / 2;
+	int k1 = imax / 2;
+	int nk = k1 - k0 + 1;
+	std::vector<DWORD> col(nk);
+	std::vector<DWORD> pix(edata.width * 2);
+	const DWORD *src = pix.data() + imin + 1;
+	int n = imax - imin;
+
+	std::vector<DWORD> checker[2];
+	if (modOnly) {
+		for (int p = 0; p < 2; p++) {
+			checker[p].resize(n);
+			for (int i = imin; i < imax; i++)
+				checker[p][i - imin] = ((i / 8 + p) & 1 ? 0xff808080 : 0xff909090);
+		}
+	}
+
+	int eyprev = -1;
+	for (int j = jmin; j < jmax; j++) {
+		int ey = (img.height - j) / 2 + 1;
+		if (ey != eyprev) {
+			const elev_t *e = edata.data.data() + ey * edata.width + k0 + 1;
+			if (modOnly && !modMask)
+				std::fill(col.begin(), col.end(), 0);
+			else {
+				colourNodes(e, nk, dmin, dscale, cm, col.data());
+				if (modOnly) {
+					const BYTE *m = modMask + ey * edata.width + k0 + 1;
+					for (int k = 0; k < nk; k++)
+						if (!m[k]) col[k] = 0; // 0 = background (colours are opaque)
+				}
+			}
+			expandNodes(col.data(), nk, pix.data() + k0 * 2);
+			eyprev = ey;
+		}
+
+		DWORD *dst = img.data.data() + j * img.width + imin;
+		if (!modOnly) {
+			memcpy(dst, src, n * sizeof(DWORD));
+		}
+		else {
+			const DWORD *bg = checker[(j / 8) & 1].data();
+			const __m128i zero = _mm_setzero_si128();
+			int i;
+			for (i = 0; i + 4 <= n; i += 4) {
+				__m128i c = _mm_loadu_si128((const __m128i*)(src + i));
+				__m128i z = _mm_cmpeq_epi32(c, zero);
+				c = _mm_or_si128(_mm_andnot_si128(z, c), _mm_and_si128(z, _mm_loadu_si128((const __m128i*)(bg + i))));
+				_mm_storeu_si128((__m128i*)(dst + i), c);
+			}
+			for (; i < n; i++)
+				dst[i] = (src[i] ? src[i] : bg[i]);
+		}
+	}
+}
+
 void ElevTileBlock::ExtractImage(Image &img, TileMode mode, int exmin, int exmax, int eymin, int eymax) const
 {
 	if (mode == TILEMODE_ELEVMOD) {
@@ -691,17 +857,13 @@ void ElevTileBlock::ExtractImage(Image &img, TileMode mode, int exmin, int exmax
 	const Cmap &cm = cmap(s_elevDisplayParam->cmName);
 	bool useMask = s_elevDisplayParam->useWaterMask && m_waterMask.size();
 
-	for (int j = jmin; j < jmax; j++)
-		for (int i = imin; i < imax; i++) {
-			int ex = (i + 1) / 2 + 1;
-			int ey = (img.height - j) / 2 + 1;
-			double d = m_edata.data[ex + ey * m_edata.width];
-			int v = max(min((int)((d - dmin) * dscale), 255), 0);
-			img.data[i + j * img.width] = (0xff000000 | cm[v]);
+	renderElevation(m_edata, 0, false, dmin, dscale, cm, img, imin, imax, jmin, jmax);
 
-			if (useMask && m_waterMask[i + j * img.width])
-				img.data[i + j * img.width] = 0xffB9E3FF;
-		}
+	if (useMask)
+		for (int j = jmin; j < jmax; j++)
+			for (int i = imin; i < imax; i++)
+				if (m_waterMask[i + j * img.width])
+					img.data[i + j * img.width] = 0xffB9E3FF;
 }
 
 void ElevTileBlock::ExtractModImage(Image &img, TileMode mode, int exmin, int exmax, int eymin, int eymax) const
@@ -728,23 +890,8 @@ void ElevTileBlock::ExtractModImage(Image &img, TileMode mode, int exmin, int ex
 	int jmax = (eymin < 0 ? img.height : min((int)img.height, (int)img.height - (eymin - 1) * 2 + 1));
 
 	const Cmap &cm = cmap(s_elevDisplayParam->cmName);
-	bool useMask = s_elevDisplayParam->useWaterMask && m_waterMask.size();
 
-	for (int j = jmin; j < jmax; j++)
-		for (int i = imin; i < imax; i++) {
-			int ex = (i + 1) / 2 + 1;
-			int ey = (img.height - j) / 2 + 1;
-			double d = m_edata.data[ex + ey * m_edata.width];
-			double db = m_edataBase.data[ex + ey * m_edata.width];
-			if (d != db) {
-				int v = max(min((int)((d - dmin) * dscale), 255), 0);
-				img.data[i + j * img.width] = (0xff000000 | cm[v]);
-			}
-			else {
-				bool b = (i / 8 + j / 8) & 1;
-				img.data[i + j * img.width] = (b ? 0xff808080 : 0xff909090);
-			}
-		}
+	renderElevation(m_edata, m_mod.mask(), true, dmin, dscale, cm, img, imin, imax, jmin, jmax);
 }
 
 #ifdef UNDEF
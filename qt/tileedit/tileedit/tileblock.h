@@ -95,6 +95,9 @@ public:
 	Image &getData() { return m_idata; }
 
 protected:
+	void stitchImage(int ilat, int ilng, const Image &im, int tilesize);
+	// copy a tile image into the block image, replicating pixels if the image is smaller than tilesize
+
 	Image m_idata;
 };
 
@@ -132,7 +135,9 @@ public:
 	static void setElevDisplayParam(const ElevDisplayParam *elevDisplayParam);
 	bool setTile(int ilat, int ilng, const Tile *tile);
 	ElevData &getData() { return m_edata; }
-	ElevData &getBaseData() { return m_edataBase; }
+	ElevModData &getModData() { return m_mod; }
+	const ElevModData &getModData() const { return m_mod; }
+	void setData(const ElevData &edata);
 	virtual Tile *copyTile(int ilat, int ilng) const;
 	virtual bool copyTile(int ilat, int ilng, Tile *tile) const;
 	void Save();
@@ -158,11 +163,15 @@ public:
 	void ExtractImage(Image &img, TileMode mode, int exmin = -1, int exmax = -1, int eymin = -1, int eymax = -1) const;
 
 protected:
+	void stitchTile(int ilat, int ilng, const ElevTile *etile);
+	// copy the data of a tile into the block arrays, without updating the block limits
+
 	void ExtractModImage(Image &img, TileMode mode, int exmin = -1, int exmax = -1, int eymin = -1, int eymax = -1) const;
 
 private:
 	ElevData m_edata;
-	ElevData m_edataBase;
+	ElevModData m_mod;
+	ElevLimits m_limits;
 	std::vector<bool> m_waterMask;
 	bool m_isModified;
 	static const ElevDisplayParam *s_elevDisplayParam;
@@ -14,6 +14,7 @@ TileCanvas::TileCanvas(QWidget *parent)
     m_tileBlock = 0;
 	m_tileMode = TILEMODE_NONE;
 	m_glyphMode = GLYPHMODE_NAVIGATE;
+	m_scaledValid = false;
     overlay = new TileCanvasOverlay(this);
 	overlay->setCanvas(this);
     overlay->hide();
@@ -28,20 +29,42 @@ TileCanvas::~TileCanvas()
 void TileCanvas::resizeEvent(QResizeEvent *event)
 {
     overlay->resize(event->size());
+	m_scaledValid = false;
 }
 
 void TileCanvas::paintEvent(QPaintEvent *event)
 {
     QPainter painter(this);
-    QBrush brush(QColor(0,0,0));
-    painter.setBrush(brush);
-    painter.drawRect(rect());
-
-    if (m_tileBlock) {
-        const BYTE *data = (const BYTE*)m_img.data.data();
-        QImage qimg(data, m_img.width, m_img.height, QImage::Format_ARGB32);
-        painter.drawImage(rect(), qimg);
-    }
+
+	if ((m_tileBlock || !m_placeholder.isNull()) && m_img.width && m_img.height) {
+		// Scaling is done once into the render cache. Repaints, e.g. under the
+		// overlay when the glyph or crosshair moves, only copy from it.
+		if (!m_scaledValid || m_scaled.size() != size()) {
+			if (m_scaled.size() != size())
+				m_scaled = QImage(size(), QImage::Format_ARGB32_Premultiplied);
+			renderScaled(rect());
+			m_scaledValid = true;
+		}
+		painter.drawImage(event->rect(), m_scaled, event->rect());
+	}
+	else {
+		QBrush brush(QColor(0, 0, 0));
+		painter.setBrush(brush);
+		painter.drawRect(rect());
+	}
+}
+
+void TileCanvas::renderScaled(const QRect &r)
+{
+	QRectF src = (m_tileBlock ? QRectF(0, 0, m_img.width, m_img.height) : QRectF(m_placeholder));
+	double sx = src.width() / (double)width();
+	double sy = src.height() / (double)height();
+
+	const BYTE *data = (const BYTE*)m_img.data.data();
+	QImage qimg(data, m_img.width, m_img.height, QImage::Format_ARGB32);
+	QPainter painter(&m_scaled);
+	painter.fillRect(r, QColor(0, 0, 0)); // the image may have transparent pixels (e.g. the water mask)
+	painter.drawImage(QRectF(r), qimg, QRectF(src.x() + r.x() * sx, src.y() + r.y() * sy, r.width() * sx, r.height() * sy));
 }
 
 void TileCanvas::enterEvent(QEvent *event)
@@ -68,82 +91,125 @@ void TileCanvas::mousePressEvent(QMouseEvent *event)
 void TileCanvas::mouseReleaseEvent(QMouseEvent *event)
 {
 	if (m_lvl) {
-		int lvl = m_lvl;
-		int ilat0 = m_ilat0;
-		int ilat1 = m_ilat1;
-		int ilng0 = m_ilng0;
-		int ilng1 = m_ilng1;
-		int nlat = nLat(m_lvl);
-		int nlng = nLng(m_lvl);
-
-		TileCanvasOverlay::Glyph glyph = overlay->glyph();
-		switch (glyph) {
-		case TileCanvasOverlay::GLYPH_RECTFULL:
-			lvl++;
-			ilat0 = 0;
-			ilng0 = 0;
-			break;
-		case TileCanvasOverlay::GLYPH_RECTLEFT:
-			lvl++;
-			ilat0 = 0;
-			ilng0 = 0;
-			break;
-		case TileCanvasOverlay::GLYPH_RECTRIGHT:
-			lvl++;
-			ilat0 = 0;
-			ilng0 = m_tileedit->m_blocksize;
-			break;
-		case TileCanvasOverlay::GLYPH_RECTNW:
-			lvl++;
-			ilat0 = ilat0 * 2;
-			ilng0 = ilng0 * 2;
-			break;
-		case TileCanvasOverlay::GLYPH_RECTNE:
-			lvl++;
-			ilat0 = ilat0 * 2;
-			ilng0 = ilng0 * 2 + m_tileedit->m_blocksize;
-			break;
-		case TileCanvasOverlay::GLYPH_RECTSW:
-			lvl++;
-			ilat0 = ilat0 * 2 + m_tileedit->m_blocksize;
-			ilng0 = ilng0 * 2;
-			break;
-		case TileCanvasOverlay::GLYPH_RECTSE:
-			lvl++;
-			ilat0 = ilat0 * 2 + m_tileedit->m_blocksize;
-			ilng0 = ilng0 * 2 + m_tileedit->m_blocksize;
-			break;
-		case TileCanvasOverlay::GLYPH_ARROWLEFT:
-			ilng0 = (ilng0 > 0 ? ilng0 - 1 : 0);
-			break;
-		case TileCanvasOverlay::GLYPH_ARROWRIGHT:
-			ilng0 = (ilng1 < nlng ? ilng0 + 1 : nlng - 1);
-			break;
-		case TileCanvasOverlay::GLYPH_ARROWTOP:
-			ilat0 = (ilat0 > 0 ? ilat0 - 1 : 0);
-			break;
-		case TileCanvasOverlay::GLYPH_ARROWBOTTOM:
-			ilat0 = (ilat1 < nlat ? ilat0 + 1 : nlat - 1);
-			break;
-		case TileCanvasOverlay::GLYPH_CROSSCENTER:
-			lvl = (lvl > 1 ? lvl - 1 : 1);
-			ilat0 /= 2;
-			ilng0 /= 2;
-			ilng1 = ilng0 + m_tileedit->m_blocksize;
-			if (ilng1 > nLng(lvl) && ilng0)
-				ilng0--;
-			break;
-		}
-
-		if (lvl != m_lvl ||
-			ilat0 != m_ilat0 ||
-			ilng0 != m_ilng0) {
+		int lvl, ilat0, ilng0;
+		if (navigationTarget(overlay->glyph(), lvl, ilat0, ilng0))
 			emit tileChanged(lvl, ilat0, ilng0);
-		}
 	}
 	emit mouseReleasedInCanvas(m_canvasIdx, event);
 }
 
+bool TileCanvas::navigationTarget(TileCanvasOverlay::Glyph glyph, int &lvl, int &ilat0, int &ilng0) const
+{
+	if (!m_lvl)
+		return false;
+
+	lvl = m_lvl;
+	ilat0 = m_ilat0;
+	ilng0 = m_ilng0;
+	int ilat1 = m_ilat1;
+	int ilng1 = m_ilng1;
+	int nlat = nLat(m_lvl);
+	int nlng = nLng(m_lvl);
+
+	switch (glyph) {
+	case TileCanvasOverlay::GLYPH_RECTFULL:
+		lvl++;
+		ilat0 = 0;
+		ilng0 = 0;
+		break;
+	case TileCanvasOverlay::GLYPH_RECTLEFT:
+		lvl++;
+		ilat0 = 0;
+		ilng0 = 0;
+		break;
+	case TileCanvasOverlay::GLYPH_RECTRIGHT:
+		lvl++;
+		ilat0 = 0;
+		ilng0 = m_tileedit->m_blocksize;
+		break;
+	case TileCanvasOverlay::GLYPH_RECTNW:
+		lvl++;
+		ilat0 = ilat0 * 2;
+		ilng0 = ilng0 * 2;
+		break;
+	case TileCanvasOverlay::GLYPH_RECTNE:
+		lvl++;
+		ilat0 = ilat0 * 2;
+		ilng0 = ilng0 * 2 + m_tileedit->m_blocksize;
+		break;
+	case TileCanvasOverlay::GLYPH_RECTSW:
+		lvl++;
+		ilat0 = ilat0 * 2 + m_tileedit->m_blocksize;
+		ilng0 = ilng0 * 2;
+		break;
+	case TileCanvasOverlay::GLYPH_RECTSE:
+		lvl++;
+		ilat0 = ilat0 * 2 + m_tileedit->m_blocksize;
+		ilng0 = ilng0 * 2 + m_tileedit->m_blocksize;
+		break;
+	case TileCanvasOverlay::GLYPH_ARROWLEFT:
+		ilng0 = (ilng0 > 0 ? ilng0 - 1 : 0);
+		break;
+	case TileCanvasOverlay::GLYPH_ARROWRIGHT:
+		ilng0 = (ilng1 < nlng ? ilng0 + 1 : nlng - 1);
+		break;
+	case TileCanvasOverlay::GLYPH_ARROWTOP:
+		ilat0 = (ilat0 > 0 ? ilat0 - 1 : 0);
+		break;
+	case TileCanvasOverlay::GLYPH_ARROWBOTTOM:
+		ilat0 = (ilat1 < nlat ? ilat0 + 1 : nlat - 1);
+		break;
+	case TileCanvasOverlay::GLYPH_CROSSCENTER:
+		lvl = (lvl > 1 ? lvl - 1 : 1);
+		ilat0 /= 2;
+		ilng0 /= 2;
+		ilng1 = ilng0 + m_tileedit->m_blocksize;
+		if (ilng1 > nLng(lvl) && ilng0)
+			ilng0--;
+		break;
+	}
+
+	return (lvl != m_lvl || ilat0 != m_ilat0 || ilng0 != m_ilng0);
+}
+
+void TileCanvas::navigationGlyphs(std::vector<TileCanvasOverlay::Glyph> &glyphs) const
+{
+	// same conditions as in updateGlyph
+	glyphs.clear();
+	if (!m_lvl || m_glyphMode != GLYPHMODE_NAVIGATE)
+		return;
+
+	if (m_lvl > 1)
+		glyphs.push_back(TileCanvasOverlay::GLYPH_CROSSCENTER);
+	if (m_ilng0 > 0)
+		glyphs.push_back(TileCanvasOverlay::GLYPH_ARROWLEFT);
+	if (m_ilng1 < nLng(m_lvl))
+		glyphs.push_back(TileCanvasOverlay::GLYPH_ARROWRIGHT);
+	if (m_ilat0 > 0)
+		glyphs.push_back(TileCanvasOverlay::GLYPH_ARROWTOP);
+	if (m_ilat1 < nLat(m_lvl))
+		glyphs.push_back(TileCanvasOverlay::GLYPH_ARROWBOTTOM);
+
+	if (nLng(m_lvl + 1) <= m_tileedit->m_blocksize) {
+		glyphs.push_back(TileCanvasOverlay::GLYPH_RECTFULL);
+	}
+	else if (nLat(m_lvl + 1) <= m_tileedit->m_blocksize) {
+		glyphs.push_back(TileCanvasOverlay::GLYPH_RECTLEFT);
+		glyphs.push_back(TileCanvasOverlay::GLYPH_RECTRIGHT);
+	}
+	else if (m_lvl < 19) {
+		glyphs.push_back(TileCanvasOverlay::GLYPH_RECTNW);
+		glyphs.push_back(TileCanvasOverlay::GLYPH_RECTNE);
+		glyphs.push_back(TileCanvasOverlay::GLYPH_RECTSW);
+		glyphs.push_back(TileCanvasOverlay::GLYPH_RECTSE);
+	}
+}
+
+void TileCanvas::notifyGlyphChanged()
+{
+	emit glyphChanged(this);
+}
+
 void TileCanvas::updateGlyph(int x, int y)
 {
 	if (m_lvl) {
@@ -213,6 +279,8 @@ void TileCanvas::setTileBlock(const TileBlock *tileBlock, TileMode mode)
 {
 	m_tileBlock = tileBlock;
 	m_tileMode = mode;
+	m_placeholder = QRect();
+	m_scaledValid = false;
 	if (m_tileBlock) {
 		m_lvl = m_tileBlock->Level();
 		m_ilat0 = m_tileBlock->iLat0();
@@ -237,11 +305,59 @@ void TileCanvas::setTileBlock(const TileBlock *tileBlock, TileMode mode)
 	update();
 }
 
-void TileCanvas::updateImage()
+void TileCanvas::setPlaceholder(int lvl, int ilat0, int ilat1, int ilng0, int ilng1)
+{
+	// If the new block lies within the current one (e.g. when zooming in),
+	// show the corresponding section of the current image, stretched to the
+	// canvas, until the new block has been loaded.
+	QRect src;
+	if (m_tileBlock && m_img.width && m_img.height) {
+		double lat0 = (double)ilat0 / nLat(lvl), lat1 = (double)ilat1 / nLat(lvl);
+		double lng0 = (double)ilng0 / nLng(lvl), lng1 = (double)ilng1 / nLng(lvl);
+		double clat0 = (double)m_ilat0 / nLat(m_lvl), clat1 = (double)m_ilat1 / nLat(m_lvl);
+		double clng0 = (double)m_ilng0 / nLng(m_lvl), clng1 = (double)m_ilng1 / nLng(m_lvl);
+		if (lat0 >= clat0 && lat1 <= clat1 && lng0 >= clng0 && lng1 <= clng1) {
+			double sx = m_img.width / (clng1 - clng0);
+			double sy = m_img.height / (clat1 - clat0);
+			int x0 = (int)((lng0 - clng0) * sx + 0.5), x1 = (int)((lng1 - clng0) * sx + 0.5);
+			int y0 = (int)((lat0 - clat0) * sy + 0.5), y1 = (int)((lat1 - clat0) * sy + 0.5);
+			src = QRect(x0, y0, max(1, x1 - x0), max(1, y1 - y0));
+		}
+	}
+	setTileBlock(0, m_tileMode);
+	m_placeholder = src;
+	m_scaledValid = false;
+}
+
+void TileCanvas::updateImage(int exmin, int exmax, int eymin, int eymax)
 {
 	if (m_tileBlock) {
-		m_tileBlock->ExtractImage(m_img, m_tileMode);
-		update();
+		m_tileBlock->ExtractImage(m_img, m_tileMode, exmin, exmax, eymin, eymax);
+		if ((exmin < 0 && exmax < 0 && eymin < 0 && eymax < 0) || !m_img.width || !m_img.height) {
+			m_scaledValid = false;
+			update();
+			return;
+		}
+
+		// pixel range of the node range, as in ElevTileBlock::ExtractImage ...
+		int iw = m_img.width, ih = m_img.height;
+		int imin = (exmin < 0 ? 0 : max(0, (exmin - 1) * 2 - 1));
+		int imax = (exmax < 0 ? iw : min(iw, exmax * 2));
+		int jmin = (eymax < 0 ? 0 : max(0, ih - (eymax - 1) * 2));
+		int jmax = (eymin < 0 ? ih : min(ih, ih - (eymin - 1) * 2 + 1));
+
+		// ... mapped to the widget, rounded outwards
+		int w = width(), h = height();
+		int x0 = imin * w / iw - 1;
+		int x1 = (imax * w + iw - 1) / iw + 1;
+		int y0 = jmin * h / ih - 1;
+		int y1 = (jmax * h + ih - 1) / ih + 1;
+		QRect r = QRect(x0, y0, x1 - x0, y1 - y0) & rect();
+		if (r.isEmpty())
+			return;
+		if (m_scaledValid && m_scaled.size() == size())
+			renderScaled(r);
+		update(r);
 	}
 }
 
@@ -298,6 +414,8 @@ void TileCanvasOverlay::setGlyph(Glyph glyph)
     if (glyph != m_glyph) {
         m_glyph = glyph;
         update();
+		if (m_canvas)
+			m_canvas->notifyGlyphChanged();
     }
 }
 
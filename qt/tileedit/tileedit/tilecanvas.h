@@ -5,12 +5,57 @@
 #include "QWidget"
 #include "QBoxLayout"
 #include "QPen"
+#include "QImage"
 #include "tile.h"
 #include "tileblock.h"
 
-class TileCanvasOverlay;
+class TileCanvas;
 class tileedit;
 
+class TileCanvasOverlay: public QWidget
+{
+    Q_OBJECT
+
+public:
+    enum Glyph {
+        GLYPH_NONE,
+        GLYPH_RECTFULL,
+        GLYPH_RECTLEFT,
+        GLYPH_RECTRIGHT,
+        GLYPH_RECTNW,
+        GLYPH_RECTNE,
+        GLYPH_RECTSW,
+        GLYPH_RECTSE,
+        GLYPH_ARROWTOP,
+        GLYPH_ARROWBOTTOM,
+        GLYPH_ARROWLEFT,
+        GLYPH_ARROWRIGHT,
+        GLYPH_CROSSCENTER,
+		GLYPH_CROSSHAIR
+    };
+
+    explicit TileCanvasOverlay(QWidget *parent = 0);
+	void setCanvas(TileCanvas *canvas);
+    Glyph glyph() const { return m_glyph; }
+    void setGlyph(Glyph glyph);
+	void setCrosshair(double x, double y, double rad);
+    void paintEvent(QPaintEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+	void mousePressEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+	void setTileBlock(const TileBlock *tileBlock) { m_tileBlock = tileBlock; }
+
+private:
+    Glyph m_glyph;
+    QPen m_penGlyph;
+	QPen m_penCrosshair;
+	double m_crosshairX, m_crosshairY;
+	double m_crosshairR;
+	TileCanvas *m_canvas;
+	const TileBlock *m_tileBlock;
+	static QFont s_font;
+};
+
 class TileCanvas: public QWidget
 {
     Q_OBJECT
@@ -39,13 +84,29 @@ public:
 	void mousePressEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
     void setTileBlock(const TileBlock *tileBlock, TileMode mode);
-	void updateImage();
+	void setPlaceholder(int lvl, int ilat0, int ilat1, int ilng0, int ilng1);
+	void updateImage(int exmin = -1, int exmax = -1, int eymin = -1, int eymax = -1);
+	// re-extract the image from the tile block and repaint. If an elevation
+	// node range is given, only the pixels showing it are updated.
 	void setGlyphMode(GlyphMode mode);
 	void setCrosshair(double x, double y, double rad);
 	void showOverlay(bool show);
 
+	TileCanvasOverlay::Glyph glyph() const { return overlay->glyph(); }
+
+	bool navigationTarget(TileCanvasOverlay::Glyph glyph, int &lvl, int &ilat, int &ilng) const;
+	// block selected by clicking on a navigation glyph. Returns false if the
+	// glyph doesn't lead to a different block.
+
+	void navigationGlyphs(std::vector<TileCanvasOverlay::Glyph> &glyphs) const;
+	// navigation glyphs offered for the current block
+
 protected:
     void updateGlyph(int mx, int my);
+	void notifyGlyphChanged();
+	// called by the overlay when its glyph changes
+	void renderScaled(const QRect &r);
+	// scale the part of the image shown in canvas rectangle r into the render cache
     TileCanvasOverlay *overlay;
 
 private:
@@ -56,9 +117,13 @@ private:
 	GlyphMode m_glyphMode;
 	tileedit *m_tileedit;
 	Image m_img;
+	QRect m_placeholder; // section of m_img shown while a new tile block is loading
+	QImage m_scaled;     // render cache: m_img scaled to the canvas size
+	bool m_scaledValid;
 
 signals:
     void tileChanged(int lvl, int ilat, int ilng);
+	void glyphChanged(TileCanvas *canvas);
 	void tileEntered(TileCanvas *canvas);
 	void tileLeft(TileCanvas *canvas);
 	void mouseMovedInCanvas(int canvasIdx, QMouseEvent *event);
@@ -66,49 +131,5 @@ signals:
 	void mouseReleasedInCanvas(int canvasIdx, QMouseEvent *event);
 };
 
-class TileCanvasOverlay: public QWidget
-{
-    Q_OBJECT
-
-public:
-    enum Glyph {
-        GLYPH_NONE,
-        GLYPH_RECTFULL,
-        GLYPH_RECTLEFT,
-        GLYPH_RECTRIGHT,
-        GLYPH_RECTNW,
-        GLYPH_RECTNE,
-        GLYPH_RECTSW,
-        GLYPH_RECTSE,
-        GLYPH_ARROWTOP,
-        GLYPH_ARROWBOTTOM,
-        GLYPH_ARROWLEFT,
-        GLYPH_ARROWRIGHT,
-        GLYPH_CROSSCENTER,
-		GLYPH_CROSSHAIR
-    };
-
-    explicit TileCanvasOverlay(QWidget *parent = 0);
-	void setCanvas(TileCanvas *canvas);
-    Glyph glyph() const { return m_glyph; }
-    void setGlyph(Glyph glyph);
-	void setCrosshair(double x, double y, double rad);
-    void paintEvent(QPaintEvent *event);
-    void mouseMoveEvent(QMouseEvent *event);
-	void mousePressEvent(QMouseEvent *event);
-    void mouseReleaseEvent(QMouseEvent *event);
-	void setTileBlock(const TileBlock *tileBlock) { m_tileBlock = tileBlock; }
-
-private:
-    Glyph m_glyph;
-    QPen m_penGlyph;
-	QPen m_penCrosshair;
-	double m_crosshairX, m_crosshairY;
-	double m_crosshairR;
-	TileCanvas *m_canvas;
-	const TileBlock *m_tileBlock;
-	static QFont s_font;
-};
-
 #endif // TILECANVAS_H
 
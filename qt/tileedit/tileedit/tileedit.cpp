@@ -5,15 +5,22 @@
 #include "tileblock.h"
 #include "dlgsurfimport.h"
 #include "dlgconfig.h"
+#include "dlgbuildarchive.h"
 #include "dlgelevconfig.h"
 #include "dlgelevexport.h"
 #include "dlgelevimport.h"
+#include "dlgoverview.h"
+#include "prefetcher.h"
+#include "tileloader.h"
+#include "dxt_io.h"
 #include <random>
+#include <algorithm>
 
 #include "QFileDialog"
 #include "QResizeEvent"
 #include "QMessageBox"
 #include "QSettings"
+#include "QThreadPool"
 
 static std::vector<std::pair<int, int> > paintStencil1 = { {0,0} };
 static std::vector<std::pair<int, int> > paintStencil2 = { {0,0}, {1,0}, {0,1}, {1,1} };
@@ -42,6 +49,9 @@ tileedit::tileedit(QWidget *parent)
 	m_openMode = m_settings->value("config/openmode", TILESEARCH_CACHE | TILESEARCH_ARCHIVE).toUInt();
 	m_globalLoadMode = (TileLoadMode)m_settings->value("config/queryancestor", (int)TILELOADMODE_ANCESTORSUBSECTION).toInt();
 	m_blocksize = m_settings->value("config/blocksize", 1).toInt();
+	m_cachesize = m_settings->value("config/cachesize", 256).toInt();
+	int dxtquality = m_settings->value("config/dxtquality", (int)DXT1_FAST).toInt();
+	m_dxtquality = (dxtquality >= DXT1_FAST && dxtquality <= DXT1_HIGH ? (DXT1Quality)dxtquality : DXT1_FAST);
 
 	m_sTileBlock = 0;
 	m_mTileBlock = 0;
@@ -53,14 +63,27 @@ tileedit::tileedit(QWidget *parent)
 	m_mgrElev = 0;
 	m_mgrElevMod = 0;
 
+	m_nodeCache = new NodeCache((size_t)m_cachesize << 20);
+	ZTreeMgr::SetNodeCache(m_nodeCache);
+	m_prefetcher = new Prefetcher;
+	dxtUseWorkerPool();
+
+	qRegisterMetaType<TileBlock*>("TileBlock*");
+	m_loadPool = new QThreadPool(this);
+	m_loadPool->setMaxThreadCount(3); // one per layer
+	m_loadId = 0;
+	m_loadPending = 0;
+
 	Tile::setOpenMode(m_openMode);
 	Tile::setGlobalLoadMode(m_globalLoadMode);
+	DXT1Tile::setSaveQuality(m_dxtquality);
 	ElevTileBlock::setElevDisplayParam(&m_elevDisplayParam);
 
 	m_mouseDown = false;
 	m_rndn = 0;
 
 	m_dlgElevConfig = 0;
+	m_dlgOverview = 0;
 
     ui->setupUi(this);
 
@@ -112,6 +135,7 @@ tileedit::tileedit(QWidget *parent)
 		int layer = m_settings->value("layer", i).toInt();
 		m_panel[i].layerType->setCurrentIndex(layer);
 		connect(m_panel[i].canvas, SIGNAL(tileChanged(int, int, int)), this, SLOT(OnTileChangedFromPanel(int, int, int)));
+		connect(m_panel[i].canvas, SIGNAL(glyphChanged(TileCanvas*)), this, SLOT(OnGlyphChanged(TileCanvas*)));
 		connect(m_panel[i].canvas, SIGNAL(tileEntered(TileCanvas*)), this, SLOT(OnTileEntered(TileCanvas*)));
 		connect(m_panel[i].canvas, SIGNAL(tileLeft(TileCanvas*)), this, SLOT(OnTileLeft(TileCanvas*)));
 		connect(m_panel[i].canvas, SIGNAL(mouseMovedInCanvas(int, QMouseEvent*)), this, SLOT(OnMouseMovedInCanvas(int, QMouseEvent*)));
@@ -129,6 +153,8 @@ tileedit::tileedit(QWidget *parent)
 
 tileedit::~tileedit()
 {
+	m_loadPool->clear();
+	m_loadPool->waitForDone();
     delete ui;
     if (m_sTileBlock)
         delete m_sTileBlock;
@@ -138,6 +164,10 @@ tileedit::~tileedit()
 		delete m_eTileBlock;
 
 	releaseTreeManagers();
+	delete m_prefetcher;
+	m_prefetcher = 0;
+	ZTreeMgr::SetNodeCache(0);
+	delete m_nodeCache;
 
 	delete m_settings;
 }
@@ -150,9 +180,13 @@ void tileedit::createMenus()
     fileMenu->addAction(openAct);
 	fileMenu->addSeparator();
 	fileMenu->addAction(actionConfig);
+	fileMenu->addAction(actionBuildArchive);
 	fileMenu->addSeparator();
 	fileMenu->addAction(actionExit);
 
+	menu = ui->menuBar->addMenu(tr("&View"));
+	menu->addAction(actionOverview);
+
 	menu = ui->menuBar->addMenu(tr("&Surface"));
 	menu->addAction(actionSurfImport);
 
@@ -171,9 +205,16 @@ void tileedit::createActions()
 	actionConfig = new QAction(tr("&Configure"), this);
 	connect(actionConfig, &QAction::triggered, this, &tileedit::on_actionConfig_triggered);
 
+	actionBuildArchive = new QAction(tr("&Build archives"), this);
+	connect(actionBuildArchive, &QAction::triggered, this, &tileedit::onBuildArchive);
+
 	actionExit = new QAction(tr("E&xit"), this);
 	connect(actionExit, &QAction::triggered, this, &tileedit::on_actionExit_triggered);
 
+	actionOverview = new QAction(tr("&Overview"), this);
+	actionOverview->setCheckable(true);
+	connect(actionOverview, &QAction::triggered, this, &tileedit::onOverview);
+
 	actionSurfImport = new QAction(tr("&Import from image"), this);
 	connect(actionSurfImport, &QAction::triggered, this, &tileedit::onSurfImportImage);
 
@@ -209,6 +250,9 @@ void tileedit::elevDisplayParamChanged()
 		}
 	}
 
+	if (m_dlgOverview)
+		m_dlgOverview->elevDisplayParamChanged();
+
 	m_settings->setValue("elevdisp/cmap", (int)m_elevDisplayParam.cmName);
 	m_settings->setValue("elevdisp/wmask", m_elevDisplayParam.useWaterMask);
 	m_settings->setValue("elevdisp/autorange", m_elevDisplayParam.autoRange);
@@ -257,6 +301,24 @@ void tileedit::setBlockSize(int bsize)
 	}
 }
 
+void tileedit::setCacheSize(int mbytes)
+{
+	if (mbytes != m_cachesize) {
+		m_cachesize = mbytes;
+		m_nodeCache->setBudget((size_t)m_cachesize << 20);
+		m_settings->setValue("config/cachesize", m_cachesize);
+	}
+}
+
+void tileedit::setDXTQuality(DXT1Quality quality)
+{
+	if (quality != m_dxtquality) {
+		m_dxtquality = quality;
+		DXT1Tile::setSaveQuality(m_dxtquality);
+		m_settings->setValue("config/dxtquality", (int)m_dxtquality);
+	}
+}
+
 void tileedit::openDir()
 {
 	QString rootDir;
@@ -286,6 +348,18 @@ void tileedit::on_actionConfig_triggered()
 	dlg.exec();
 }
 
+void tileedit::onBuildArchive()
+{
+	if (!Tile::root().size()) {
+		QMessageBox mbox(QMessageBox::Warning, "tileedit", "No planet directory open.", QMessageBox::Close);
+		mbox.exec();
+		return;
+	}
+
+	DlgBuildArchive dlg(this);
+	dlg.exec();
+}
+
 void tileedit::on_actionExit_triggered()
 {
 	QApplication::quit();
@@ -303,6 +377,18 @@ void tileedit::onElevConfig()
 		onElevConfigDestroyed(0);
 }
 
+void tileedit::onOverview()
+{
+	if (!m_dlgOverview) {
+		m_dlgOverview = new DlgOverview(this);
+		connect(m_dlgOverview, SIGNAL(finished(int)), this, SLOT(onOverviewDestroyed(int)));
+		m_dlgOverview->show();
+		actionOverview->setChecked(true);
+	}
+	else
+		onOverviewDestroyed(0);
+}
+
 void tileedit::onElevExportImage()
 {
 	if (!m_eTileBlock) {
@@ -340,27 +426,87 @@ void tileedit::onElevConfigDestroyed(int r)
 	}
 }
 
+void tileedit::onOverviewDestroyed(int r)
+{
+	if (m_dlgOverview) {
+		delete m_dlgOverview;
+		m_dlgOverview = 0;
+		actionOverview->setChecked(false);
+	}
+}
+
 void tileedit::loadTile(int lvl, int ilat, int ilng)
 {
 	int ilat1 = min(nLat(lvl), ilat + m_blocksize);
 	int ilng1 = min(nLng(lvl), ilng + m_blocksize);
 
-    if (m_sTileBlock)
-        delete m_sTileBlock;
-    m_sTileBlock = SurfTileBlock::Load(lvl, ilat, ilat1, ilng, ilng1);
+	// The layers are loaded concurrently on the worker pool and delivered to
+	// onTileBlockLoaded. Until then the panels show a section of the previous
+	// image, where possible. Loads of superseded requests that haven't started
+	// yet are dropped, and the results of running ones are discarded on arrival.
+	m_loadPool->clear();
+	m_loadId++;
 
-	if (m_mTileBlock)
-		delete m_mTileBlock;
-	m_mTileBlock = MaskTileBlock::Load(lvl, ilat, ilat1, ilng, ilng1);
+	for (int i = 0; i < 3; i++)
+		m_panel[i].canvas->setPlaceholder(lvl, ilat, ilat1, ilng, ilng1);
 
-	if (m_eTileBlock)
+	if (m_sTileBlock) {
+		delete m_sTileBlock;
+		m_sTileBlock = 0;
+	}
+	if (m_mTileBlock) {
+		delete m_mTileBlock;
+		m_mTileBlock = 0;
+	}
+	if (m_eTileBlock) {
 		delete m_eTileBlock;
-	m_eTileBlock = ElevTileBlock::Load(lvl, ilat, ilat1, ilng, ilng1);
-	if (m_eTileBlock && m_mTileBlock)
+		m_eTileBlock = 0;
+	}
+
+	m_loadPending = 0;
+	TileLoader::Layer layers[3] = { TileLoader::LAYER_SURF, TileLoader::LAYER_MASK, TileLoader::LAYER_ELEV };
+	for (int i = 0; i < 3; i++) {
+		m_loadPending |= 1 << layers[i];
+		m_loadPool->start(new TileLoader(this, m_loadId, layers[i], lvl, ilat, ilat1, ilng, ilng1));
+	}
+}
+
+void tileedit::onTileBlockLoaded(int requestId, int layer, TileBlock *block)
+{
+	if (requestId != m_loadId) { // superseded by a later request
+		if (block)
+			delete block;
+		return;
+	}
+	m_loadPending &= ~(1 << layer);
+
+	switch (layer) {
+	case TileLoader::LAYER_SURF:
+		m_sTileBlock = (SurfTileBlock*)block;
+		break;
+	case TileLoader::LAYER_MASK:
+		m_mTileBlock = (MaskTileBlock*)block;
+		break;
+	case TileLoader::LAYER_ELEV:
+		m_eTileBlock = (ElevTileBlock*)block;
+		break;
+	}
+	bool maskChanged = false;
+	if (layer != TileLoader::LAYER_SURF && m_eTileBlock && m_mTileBlock) {
 		m_eTileBlock->setWaterMask(m_mTileBlock);
+		maskChanged = true;
+	}
+
+	// refresh the panels displaying this layer, and the elevation panels if the water mask was applied
+	for (int i = 0; i < 3; i++) {
+		int type = m_panel[i].layerType->currentIndex();
+		int panelLayer = (type == 0 ? TileLoader::LAYER_SURF : type <= 2 ? TileLoader::LAYER_MASK : TileLoader::LAYER_ELEV);
+		if (type < 5 && (panelLayer == layer || (maskChanged && panelLayer == TileLoader::LAYER_ELEV)))
+			refreshPanel(i);
+	}
 
-    for (int i = 0; i < 3; i++)
-        refreshPanel(i);
+	if (!m_loadPending)
+		prefetch(m_panel[0].canvas);
 }
 
 void tileedit::refreshPanel(int panelIdx)
@@ -396,6 +542,32 @@ void tileedit::refreshPanel(int panelIdx)
     }
 }
 
+void tileedit::elevEdited(int exmin, int exmax, int eymin, int eymax)
+{
+	// update the block limits over the edited node range, and re-render only
+	// that range unless the limits (and with them the colour scale) changed
+	const ElevData &edata = m_eTileBlock->getData();
+	double dmin = edata.dmin, dmax = edata.dmax;
+	m_eTileBlock->dataChanged(exmin, exmax, eymin, eymax);
+	if (edata.dmin != dmin || edata.dmax != dmax)
+		refreshElevPanels();
+	else
+		refreshElevPanels(exmin, exmax, eymin, eymax);
+}
+
+void tileedit::refreshElevPanels(int exmin, int exmax, int eymin, int eymax)
+{
+	bool full = (exmin < 0 && exmax < 0 && eymin < 0 && eymax < 0);
+	if (full && m_elevDisplayParam.autoRange) {
+		// the colour scale follows the data range: re-render everything
+		elevDisplayParamChanged();
+		return;
+	}
+	for (int i = 0; i < 3; i++)
+		if (m_panel[i].layerType->currentIndex() >= 3) // elevation
+			m_panel[i].canvas->updateImage(exmin, exmax, eymin, eymax);
+}
+
 void tileedit::onResolutionChanged(int lvl)
 {
 	while (lvl > m_lvl) {
@@ -528,6 +700,11 @@ void tileedit::OnTileChangedFromPanel(int lvl, int ilat, int ilng)
 	setTile(lvl, ilat, ilng);
 }
 
+void tileedit::OnGlyphChanged(TileCanvas *canvas)
+{
+	prefetch(canvas);
+}
+
 void tileedit::OnTileEntered(TileCanvas *canvas)
 {
 	for (int i = 0; i < 3; i++) {
@@ -731,6 +908,7 @@ void tileedit::editElevation(int canvasIdx, int x, int y)
 		{
 			int v = ui->spinElevPaintValue->value();
 			ElevData &edata = m_eTileBlock->getData();
+			ElevModData &emod = m_eTileBlock->getModData();
 			int sz = (m_elevEditMode == ELEVEDIT_PAINT ?
 				ui->spinElevPaintSize->value() :
 				ui->spinElevRandomSize->value()
@@ -742,14 +920,14 @@ void tileedit::editElevation(int canvasIdx, int x, int y)
 				);
 			std::vector<std::pair<int, int>> *stencil = paintStencil[sz - 1];
 			bool ismod = false;
-			bool boundsChanged = false;
-			bool rescanBounds = false;
 			for (int i = 0; i < stencil->size(); i++) {
 				if (m_elevEditMode == ELEVEDIT_RANDOM)
 					v = (int)(*m_rndn)(generator);
-				int idx = (ny + pady + (*stencil)[i].second)*edata.width + (nx + padx + (*stencil)[i].first);
-				if (idx >= 0 && idx < edata.data.size()) {
-					INT16 vold = edata.data[idx];
+				int ex = nx + padx + (*stencil)[i].first;
+				int ey = ny + pady + (*stencil)[i].second;
+				if (ex >= 0 && ex < edata.width && ey >= 0 && ey < edata.height) { // don't wrap into the neighbouring row
+					int idx = ey * edata.width + ex;
+					elev_t vprev = edata.data[idx];
 					switch (mode) {
 					case 0:
 						edata.data[idx] = (INT16)v;
@@ -766,40 +944,14 @@ void tileedit::editElevation(int canvasIdx, int x, int y)
 							edata.data[idx] = (INT16)v;
 						break;
 					}
-					if (edata.data[idx] != vold) {
-						if (vold == edata.dmin && edata.data[idx] > vold ||
-							vold == edata.dmax && edata.data[idx] < vold) {
-							rescanBounds = true;
-						}
-						else {
-							if (edata.data[idx] < edata.dmin) {
-								edata.dmin = edata.data[idx];
-								boundsChanged = true;
-							}
-							if (edata.data[idx] > edata.dmax) {
-								edata.dmax = edata.data[idx];
-								boundsChanged = true;
-							}
-						}
+					if (edata.data[idx] != vprev) {
+						emod.update(idx, vprev, edata.data[idx], edata.data.size());
 						ismod = true;
 					}
 				}
 			}
-			if (ismod) {
-				if (rescanBounds) {
-					edata.dmin = *std::min_element(edata.data.begin(), edata.data.end());
-					edata.dmax = *std::max_element(edata.data.begin(), edata.data.end());
-					boundsChanged = true;
-				}
-				if (boundsChanged)
-					m_eTileBlock->dataChanged();
-				else
-					m_eTileBlock->dataChanged(nx + padx - (sz / 2 + 1), nx + padx + (sz / 2 + 1), ny + pady - (sz / 2 + 1), ny + pady + (sz / 2 + 1));
-				for (int i = 0; i < 3; i++)
-					if (m_panel[i].layerType->currentIndex() >= 3) { // elevation
-						refreshPanel(i);
-					}
-			}
+			if (ismod)
+				elevEdited(nx + padx - (sz / 2 + 1), nx + padx + (sz / 2 + 1), ny + pady - (sz / 2 + 1), ny + pady + (sz / 2 + 1));
 		}
 		break;
 	case ELEVEDIT_ERASE:
@@ -808,30 +960,21 @@ void tileedit::editElevation(int canvasIdx, int x, int y)
 			sz = min(sz, 5);
 			std::vector<std::pair<int, int>> *stencil = paintStencil[sz - 1];
 			ElevData &edata = m_eTileBlock->getData();
-			ElevData &edataBase = m_eTileBlock->getBaseData();
+			ElevModData &emod = m_eTileBlock->getModData();
 			bool ismod = false;
-			bool boundsChanged = false;
 			for (int i = 0; i < stencil->size(); i++) {
-				int idx = (ny + pady + (*stencil)[i].second)*edata.width + (nx + padx + (*stencil)[i].first);
-				if (idx >= 0 && idx < edata.data.size() && edata.data[idx] != edataBase.data[idx]) {
-					if (edata.data[idx] == edata.dmin || edata.data[idx] == edata.dmax)
-						boundsChanged = true;
-					edata.data[idx] = edataBase.data[idx];
+				int ex = nx + padx + (*stencil)[i].first;
+				int ey = ny + pady + (*stencil)[i].second;
+				int idx = ey * edata.width + ex;
+				if (ex >= 0 && ex < edata.width && ey >= 0 && ey < edata.height && emod.isModified(idx)) {
+					elev_t vbase = emod.baseValue(idx, edata.data[idx]);
+					emod.setNode(idx, vbase, vbase, edata.data.size());
+					edata.data[idx] = vbase;
 					ismod = true;
 				}
 			}
-			if (ismod) {
-				if (boundsChanged) {
-					edata.dmin = *std::min_element(edata.data.begin(), edata.data.end());
-					edata.dmax = *std::max_element(edata.data.begin(), edata.data.end());
-					m_eTileBlock->dataChanged();
-				} else
-					m_eTileBlock->dataChanged(nx + padx - (sz / 2 + 1), nx + padx + (sz / 2 + 1), ny + pady - (sz / 2 + 1), ny + pady + (sz / 2 + 1));
-				for (int i = 0; i < 3; i++)
-					if (m_panel[i].layerType->currentIndex() >= 3) { // elevation
-						refreshPanel(i);
-					}
-			}
+			if (ismod)
+				elevEdited(nx + padx - (sz / 2 + 1), nx + padx + (sz / 2 + 1), ny + pady - (sz / 2 + 1), ny + pady + (sz / 2 + 1));
 		}
 		break;
 	}
@@ -864,6 +1007,7 @@ void tileedit::setTile(int lvl, int ilat, int ilng)
 		m_eTileBlock->mapToAncestors(m_eTileBlock->Level() - 5);
 	}
 
+	m_prefetcher->cancel(); // don't compete with the loaders
 	m_lvl = lvl;
 	m_ilat = ilat;
 	m_ilng = ilng;
@@ -918,10 +1062,60 @@ void tileedit::setupTreeManagers(std::string &root)
 	m_mgrElev = ZTreeMgr::CreateFromFile(root.c_str(), ZTreeMgr::LAYER_ELEV);
 	m_mgrElevMod = ZTreeMgr::CreateFromFile(root.c_str(), ZTreeMgr::LAYER_ELEVMOD);
 	ElevTile::setTreeMgr(m_mgrElev, m_mgrElevMod);
+
+	if (m_dlgOverview)
+		m_dlgOverview->setTreeMgr(m_mgrSurf, m_mgrElev, m_mgrElevMod);
+}
+
+void tileedit::prefetch(TileCanvas *canvas)
+{
+	// Warm the node cache for the blocks reachable from the navigation glyphs
+	// of the current block: first the one under the mouse cursor, then the
+	// others from low to high resolution.
+	if (!m_prefetcher || m_loadPending || !(m_openMode & TILESEARCH_ARCHIVE))
+		return;
+
+	struct Target {
+		int lvl, ilat, ilng;
+	};
+	std::vector<Target> targets;
+	std::vector<TileCanvasOverlay::Glyph> glyphs;
+	TileCanvasOverlay::Glyph hover = canvas->glyph();
+	canvas->navigationGlyphs(glyphs);
+	for (auto glyph : glyphs) {
+		Target t;
+		if (canvas->navigationTarget(glyph, t.lvl, t.ilat, t.ilng)) {
+			if (glyph == hover) targets.insert(targets.begin(), t);
+			else targets.push_back(t);
+		}
+	}
+	if (targets.size() > 1)
+		std::stable_sort(targets.begin() + 1, targets.end(), [](const Target &a, const Target &b) { return a.lvl < b.lvl; });
+
+	const ZTreeMgr *mgr[4] = { m_mgrSurf, m_mgrMask, m_mgrElev, m_mgrElevMod };
+	std::vector<Prefetcher::Item> items;
+	for (auto &t : targets) {
+		int ilat1 = min(nLat(t.lvl), t.ilat + m_blocksize);
+		int ilng1 = min(nLng(t.lvl), t.ilng + m_blocksize);
+		for (int ilat = t.ilat; ilat < ilat1; ilat++)
+			for (int ilng = t.ilng; ilng < ilng1; ilng++)
+				for (int i = 0; i < 4; i++)
+					if (mgr[i]) {
+						Prefetcher::Item item = { mgr[i], t.lvl, ilat, ilng };
+						items.push_back(item);
+					}
+	}
+	m_prefetcher->request(items);
 }
 
 void tileedit::releaseTreeManagers()
 {
+	// the loaders, the prefetcher and the overview may be reading from the archives
+	m_loadPool->waitForDone();
+	m_prefetcher->cancel(true);
+	if (m_dlgOverview)
+		m_dlgOverview->setTreeMgr(0, 0, 0);
+
 	if (m_mgrSurf) {
 		delete m_mgrSurf;
 		m_mgrSurf = 0;
@@ -938,4 +1132,7 @@ void tileedit::releaseTreeManagers()
 		delete m_mgrElevMod;
 		m_mgrElevMod = 0;
 	}
+
+	// cached nodes refer to the archives just closed
+	m_nodeCache->clear();
 }
@@ -11,6 +11,7 @@
 
 #include "elevtile.h"
 #include "ZTreeMgr.h"
+#include "nodecache.h"
 #include "colorbar.h"
 
 #define TILESEARCH_CACHE 0x1
@@ -26,15 +27,21 @@ class NightlightTileBlock;
 class ElevTileBlock;
 class TileCanvas;
 class DlgElevConfig;
+class DlgOverview;
+class Prefetcher;
+class TileBlock;
+class QThreadPool;
 
 class tileedit : public QMainWindow
 {
 	Q_OBJECT
 
 	friend class DlgConfig;
+	friend class DlgBuildArchive;
 	friend class DlgElevConfig;
 	friend class DlgElevExport;
 	friend class DlgElevImport;
+	friend class DlgOverview;
 	friend class TileCanvas;
 
 public:
@@ -46,6 +53,8 @@ public:
 	void setAncestorMode(TileLoadMode mode);
 
 	void setBlockSize(int bsize);
+	void setCacheSize(int mbytes);
+	void setDXTQuality(DXT1Quality quality);
 	QSettings *settings() { return m_settings; }
 
 protected:
@@ -55,6 +64,8 @@ protected:
     void ensureSquareCanvas(int winw, int winh);
     void loadTile(int lvl, int ilat, int ilng);
     void refreshPanel(int panelIdx);
+	void refreshElevPanels(int exmin = -1, int exmax = -1, int eymin = -1, int eymax = -1);
+	void elevEdited(int exmin, int exmax, int eymin, int eymax);
 	void setTile(int lvl, int ilat, int ilng);
 
 private:
@@ -64,16 +75,20 @@ private:
 	void editElevation(int canvasIdx, int x, int y);
 	void setupTreeManagers(std::string &root);
 	void releaseTreeManagers();
+	void prefetch(TileCanvas *canvas);
 
 private slots:
     void openDir();
 	void on_actionExit_triggered();
 	void on_actionConfig_triggered();
+	void onBuildArchive();
 	void onSurfImportImage();
 	void onElevConfig();
 	void onElevExportImage();
 	void onElevImportImage();
 	void onElevConfigDestroyed(int r);
+	void onOverview();
+	void onOverviewDestroyed(int r);
     void onResolutionChanged(int val);
     void onLatidxChanged(int val);
     void onLngidxChanged(int val);
@@ -83,11 +98,13 @@ private slots:
     void onLayerType1(int);
     void onLayerType2(int);
     void OnTileChangedFromPanel(int lvl, int ilat, int ilng);
+	void OnGlyphChanged(TileCanvas *canvas);
 	void OnTileEntered(TileCanvas *canvas);
 	void OnTileLeft(TileCanvas *canvas);
 	void OnMouseMovedInCanvas(int canvasIdx, QMouseEvent *event);
 	void OnMousePressedInCanvas(int canvasIdx, QMouseEvent *event);
 	void OnMouseReleasedInCanvas(int canvasIdx, QMouseEvent *event);
+	void onTileBlockLoaded(int requestId, int layer, TileBlock *block);
 
 private:
     Ui::tileedit *ui;
@@ -95,7 +112,9 @@ private:
     QMenu *fileMenu;
     QAction *openAct;
 	QAction *actionConfig;
+	QAction *actionBuildArchive;
 	QAction *actionExit;
+	QAction *actionOverview;
 	QAction *actionSurfImport;
 	QAction *actionElevConfig;
 	QAction *actionElevExport;
@@ -129,6 +148,8 @@ private:
 	DWORD m_openMode;
 	TileLoadMode m_globalLoadMode;
 	int m_blocksize;
+	int m_cachesize; // node cache budget [MB]
+	DXT1Quality m_dxtquality; // DXT1 encoder tier for tile saves
 
 	ElevDisplayParam m_elevDisplayParam;
 
@@ -145,7 +166,19 @@ private:
 	ZTreeMgr *m_mgrElev;
 	ZTreeMgr *m_mgrElevMod;
 
+	// Cache of inflated archive nodes, shared by all tree managers
+	NodeCache *m_nodeCache;
+
+	// Background reader warming the node cache for the likely next blocks
+	Prefetcher *m_prefetcher;
+
+	// Worker pool for asynchronous tile block loading
+	QThreadPool *m_loadPool;
+	int m_loadId;        // id of the most recent load request
+	DWORD m_loadPending; // bit flags of layers still loading for the current request
+
 	DlgElevConfig *m_dlgElevConfig;
+	DlgOverview *m_dlgOverview;
 
 	std::normal_distribution<double> *m_rndn;
 };
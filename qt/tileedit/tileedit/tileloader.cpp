@@ -0,0 +1,33 @@
+#include "tileloader.h"
+
+TileLoader::TileLoader(QObject *receiver, int requestId, Layer layer, int lvl, int ilat0, int ilat1, int ilng0, int ilng1)
+	: QRunnable()
+{
+	m_receiver = receiver;
+	m_requestId = requestId;
+	m_layer = layer;
+	m_lvl = lvl;
+	m_ilat0 = ilat0;
+	m_ilat1 = ilat1;
+	m_ilng0 = ilng0;
+	m_ilng1 = ilng1;
+	setAutoDelete(true);
+}
+
+void TileLoader::run()
+{
+	TileBlock *block = 0;
+	switch (m_layer) {
+	case LAYER_SURF:
+		block = SurfTileBlock::Load(m_lvl, m_ilat0, m_ilat1, m_ilng0, m_ilng1);
+		break;
+	case LAYER_MASK:
+		block = MaskTileBlock::Load(m_lvl, m_ilat0, m_ilat1, m_ilng0, m_ilng1);
+		break;
+	case LAYER_ELEV:
+		block = ElevTileBlock::Load(m_lvl, m_ilat0, m_ilat1, m_ilng0, m_ilng1);
+		break;
+	}
+	QMetaObject::invokeMethod(m_receiver, "onTileBlockLoaded", Qt::QueuedConnection,
+		Q_ARG(int, m_requestId), Q_ARG(int, (int)m_layer), Q_ARG(TileBlock*, block));
+}
@@ -0,0 +1,40 @@
+#ifndef TILELOADER_H
+#define TILELOADER_H
+
+#include <QRunnable>
+#include <QObject>
+#include <QMetaType>
+#include "tileblock.h"
+
+Q_DECLARE_METATYPE(TileBlock*)
+
+// =======================================================================
+// TileLoader class: builds the tile block of one layer on a worker thread.
+// The block is passed to the receiver's slot
+//     onTileBlockLoaded(int requestId, int layer, TileBlock *block)
+// through a queued connection, so it arrives on the receiver's thread. The
+// receiver takes ownership of the block (which is 0 if loading failed) and
+// uses the request id to discard results of superseded requests.
+
+class TileLoader : public QRunnable
+{
+public:
+	enum Layer {
+		LAYER_SURF,
+		LAYER_MASK,
+		LAYER_ELEV
+	};
+
+	TileLoader(QObject *receiver, int requestId, Layer layer, int lvl, int ilat0, int ilat1, int ilng0, int ilng1);
+	void run();
+
+private:
+	QObject *m_receiver;
+	int m_requestId;
+	Layer m_layer;
+	int m_lvl;
+	int m_ilat0, m_ilat1;
+	int m_ilng0, m_ilng1;
+};
+
+#endif // !TILELOADER_H
@@ -0,0 +1,463 @@
+#include "treewriter.h"
+#include "parallel.h"
+#include "tile.h"
+#include "zlib.h"
+#include <chrono>
+
+static const int WRITE_BATCH = 256;  // number of nodes compressed in parallel before writing
+
+// -----------------------------------------------------------------------
+
+static void ListDir(const std::string &pattern, bool dirs, std::vector<std::string> &names)
+{
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA(pattern.c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		bool isdir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		if (isdir == dirs && fd.cFileName[0] != '.')
+			names.push_back(fd.cFileName);
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+}
+
+// -----------------------------------------------------------------------
+
+static bool ParseIndex(const std::string &name, size_t ndigit, const char *ext, int &val)
+{
+	// accept names of at least ndigit decimal digits (the width of the printf
+	// format, exceeded by the longitude indices of levels >= 23), plus the
+	// extension, if provided
+	size_t extlen = (ext ? strlen(ext) + 1 : 0);
+	if (name.size() < ndigit + extlen || name.size() - extlen > 9)
+		return false;
+	size_t n = name.size() - extlen;
+	for (size_t i = 0; i < n; i++)
+		if (name[i] < '0' || name[i] > '9') return false;
+	if (ext && (name[n] != '.' || _stricmp(name.c_str() + n + 1, ext)))
+		return false;
+	val = atoi(name.substr(0, n).c_str());
+	return true;
+}
+
+// =======================================================================
+// TreeWriter class
+
+TreeWriter::TreeWriter(const char *root, ZTreeMgr::Layer layer)
+{
+	m_root.assign(root);
+	m_layer = layer;
+	m_merge = 0;
+	m_zlevel = Z_DEFAULT_COMPRESSION;
+	memset(&m_stats, 0, sizeof(Stats));
+}
+
+// -----------------------------------------------------------------------
+
+const char *TreeWriter::TileExt(ZTreeMgr::Layer layer)
+{
+	switch (layer) {
+	case ZTreeMgr::LAYER_ELEV:
+	case ZTreeMgr::LAYER_ELEVMOD:
+		return "elv";
+	case ZTreeMgr::LAYER_LABEL:
+		return "lab";
+	default:
+		return "dds";
+	}
+}
+
+// -----------------------------------------------------------------------
+
+std::string TreeWriter::TilePath(int lvl, int ilat, int ilng) const
+{
+	char path[1024];
+	sprintf(path, "%s/%s/%02d/%06d/%06d.%s", m_root.c_str(), ZTreeMgr::LayerName(m_layer), lvl, ilat, ilng, TileExt(m_layer));
+	return std::string(path);
+}
+
+// -----------------------------------------------------------------------
+
+void TreeWriter::ScanCache()
+{
+	std::string layerDir = m_root + "/" + ZTreeMgr::LayerName(m_layer);
+	const char *ext = TileExt(m_layer);
+	std::vector<std::string> lvlDirs, latDirs, files;
+	int lvl, ilat, ilng;
+
+	ListDir(layerDir + "/*", true, lvlDirs);
+	for (auto &lvlDir : lvlDirs) {
+		if (!ParseIndex(lvlDir, 2, 0, lvl) || lvl < 1 || lvl > TREE_MAXLVL)
+			continue;
+		latDirs.clear();
+		ListDir(layerDir + "/" + lvlDir + "/*", true, latDirs);
+		for (auto &latDir : latDirs) {
+			if (!ParseIndex(latDir, 6, 0, ilat) || ilat >= nLat(lvl))
+				continue;
+			files.clear();
+			ListDir(layerDir + "/" + lvlDir + "/" + latDir + "/*." + ext, false, files);
+			for (auto &file : files) {
+				if (!ParseIndex(file, 6, ext, ilng) || ilng >= nLng(lvl))
+					continue;
+				// supersedes the archive node, but remember it for comparison when appending
+				unsigned __int64 key = ZTreeMgr::NodeKey(lvl, ilat, ilng);
+				auto it = m_sources.find(key);
+				Source src = { true, it != m_sources.end() ? it->second.archiveIdx : (DWORD)-1 };
+				m_sources[key] = src;
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------
+
+void TreeWriter::ScanArchive()
+{
+	std::vector<ZTreeMgr::NodeRef> nodes;
+	m_merge->Nodes(nodes);
+	for (auto &node : nodes) {
+		Source src = { false, node.idx };
+		m_sources[ZTreeMgr::NodeKey(node.lvl, node.ilat, node.ilng)] = src;
+	}
+}
+
+// -----------------------------------------------------------------------
+
+DWORD TreeWriter::AddSubtree(int lvl, int ilat, int ilng)
+{
+	// depth-first, so that the data of neighbouring tiles are stored close together
+	DWORD idx = (DWORD)m_nodes.size();
+	auto it = m_sources.find(ZTreeMgr::NodeKey(lvl, ilat, ilng));
+	Node node = { lvl, ilat, ilng, it != m_sources.end() ? &it->second : 0, { (DWORD)-1, (DWORD)-1, (DWORD)-1, (DWORD)-1 } };
+	m_nodes.push_back(node);
+
+	for (int c = 0; c < 4; c++) {
+		int clat = ilat * 2 + (c >> 1);
+		int clng = ilng * 2 + (c & 1);
+		if (m_present.count(ZTreeMgr::NodeKey(lvl + 1, clat, clng))) {
+			DWORD cidx = AddSubtree(lvl + 1, clat, clng);
+			m_nodes[idx].child[c] = cidx;
+		}
+	}
+	return idx;
+}
+
+// -----------------------------------------------------------------------
+
+void TreeWriter::BuildNodeList(TreeFileHeader &tfh)
+{
+	m_present.clear();
+	m_nodes.clear();
+
+	// the three low-resolution levels are stored as separate roots
+	DWORD *rootPos[3] = { &tfh.rootPos1, &tfh.rootPos2, &tfh.rootPos3 };
+	for (int lvl = 1; lvl <= 3; lvl++) {
+		auto it = m_sources.find(ZTreeMgr::NodeKey(lvl, 0, 0));
+		if (it != m_sources.end()) {
+			*rootPos[lvl - 1] = (DWORD)m_nodes.size();
+			Node node = { lvl, 0, 0, &it->second, { (DWORD)-1, (DWORD)-1, (DWORD)-1, (DWORD)-1 } };
+			m_nodes.push_back(node);
+		}
+	}
+
+	// levels >= 4 form two quadtrees; add the ancestors of all tiles so that each is reachable from a root
+	for (auto &it : m_sources) {
+		const unsigned __int64 mask = (1ull << NODEKEY_BITS) - 1;
+		int lvl = (int)(it.first >> (2 * NODEKEY_BITS));
+		int ilat = (int)((it.first >> NODEKEY_BITS) & mask);
+		int ilng = (int)(it.first & mask);
+		for (; lvl >= 4 && m_present.insert(ZTreeMgr::NodeKey(lvl, ilat, ilng)).second; lvl--) {
+			ilat /= 2;
+			ilng /= 2;
+		}
+	}
+	for (int i = 0; i < 2; i++)
+		if (m_present.count(ZTreeMgr::NodeKey(4, 0, i)))
+			tfh.rootPos4[i] = AddSubtree(4, 0, i);
+}
+
+// -----------------------------------------------------------------------
+
+bool TreeWriter::ReadCacheFile(const Node &node, std::vector<BYTE> &data) const
+{
+	FILE *f = fopen(TilePath(node.lvl, node.ilat, node.ilng).c_str(), "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data.resize(size > 0 ? size : 0);
+	bool ok = (size >= 0 && ::fread(data.data(), 1, data.size(), f) == data.size());
+	fclose(f);
+	return ok;
+}
+
+// -----------------------------------------------------------------------
+
+bool TreeWriter::Compress(const std::vector<BYTE> &data, std::vector<BYTE> &zdata) const
+{
+	uLongf zsize = compressBound((uLong)data.size());
+	zdata.resize(zsize);
+	if (compress2(zdata.data(), &zsize, data.data(), (uLong)data.size(), m_zlevel) != Z_OK)
+		return false;
+	zdata.resize(zsize);
+	return true;
+}
+
+// -----------------------------------------------------------------------
+
+bool TreeWriter::MatchesArchive(DWORD idx, const std::vector<BYTE> &data) const
+{
+	if (idx == (DWORD)-1 || m_merge->NodeSizeInflated(idx) != data.size())
+		return false;
+
+	// quick rejection by the Adler-32 checksum at the end of the zlib stream
+	DWORD zsize = m_merge->NodeSizeDeflated(idx);
+	std::vector<BYTE> zdata(zsize);
+	if (zsize < 4 || m_merge->ReadDeflated(idx, zdata.data(), zsize) != zsize)
+		return false;
+	const BYTE *p = zdata.data() + zsize - 4;
+	uLong check = ((uLong)p[0] << 24) | ((uLong)p[1] << 16) | ((uLong)p[2] << 8) | (uLong)p[3];
+	if (adler32(adler32(0L, Z_NULL, 0), data.data(), (uInt)data.size()) != check)
+		return false;
+
+	// confirm by comparing the contents
+	std::vector<BYTE> edata(data.size());
+	return m_merge->ReadData(idx, edata.data(), (DWORD)edata.size()) == data.size() &&
+		!memcmp(edata.data(), data.data(), data.size());
+}
+
+// -----------------------------------------------------------------------
+
+bool TreeWriter::ReadTile(const Node &node, std::vector<BYTE> &zdata, DWORD &esize) const
+{
+	zdata.clear();
+	esize = 0;
+	if (!node.src) // intermediate node without data
+		return true;
+
+	if (node.src->cached) {
+		std::vector<BYTE> data;
+		if (!ReadCacheFile(node, data))
+			return false;
+		if (!data.size()) // treat empty files as missing data
+			return true;
+		if (!Compress(data, zdata))
+			return false;
+		esize = (DWORD)data.size();
+	}
+	else {
+		DWORD idx = node.src->archiveIdx;
+		DWORD zsize = m_merge->NodeSizeDeflated(idx);
+		zdata.resize(zsize);
+		if (m_merge->ReadDeflated(idx, zdata.data(), zsize) != zsize)
+			return false;
+		esize = m_merge->NodeSizeInflated(idx);
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------
+
+bool TreeWriter::Write(const char *fname)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	memset(&m_stats, 0, sizeof(Stats));
+	m_sources.clear();
+
+	// collect tiles; cache tiles take precedence over archive nodes
+	if (m_merge)
+		ScanArchive();
+	ScanCache();
+
+	TreeFileHeader tfh;
+	BuildNodeList(tfh);
+	DWORD nnode = (DWORD)m_nodes.size();
+	if (!nnode)
+		return false;
+
+	FILE *f = fopen(fname, "wb");
+	if (!f)
+		return false;
+	setvbuf(f, NULL, _IOFBF, 1 << 20);
+
+	// reserve space for header and TOC; both are rewritten once all node positions are known
+	std::vector<TreeNode> toc(nnode);
+	memset(toc.data(), 0, nnode * sizeof(TreeNode));
+	tfh.nodeCount = nnode;
+	tfh.dataOfs = (DWORD)(sizeof(TreeFileHeader) + nnode * sizeof(TreeNode));
+	bool ok = (tfh.fwrite(f) == 1 && ::fwrite(toc.data(), sizeof(TreeNode), nnode, f) == nnode);
+
+	std::vector<std::vector<BYTE> > zdata(WRITE_BATCH);
+	std::vector<DWORD> esize(WRITE_BATCH);
+	std::vector<char> valid(WRITE_BATCH);
+	__int64 pos = 0;
+
+	for (DWORD i0 = 0; ok && i0 < nnode; i0 += WRITE_BATCH) {
+		int n = (int)min((DWORD)WRITE_BATCH, nnode - i0);
+
+		// read and compress in parallel ...
+		parallelFor(n, [&](int i) {
+			valid[i] = ReadTile(m_nodes[i0 + i], zdata[i], esize[i]);
+		});
+
+		// ... and write sequentially in TOC order
+		for (int i = 0; i < n && ok; i++) {
+			const Node &node = m_nodes[i0 + i];
+			if (!valid[i]) {
+				ok = false;
+				break;
+			}
+			TreeNode &tn = toc[i0 + i];
+			tn.pos = pos;
+			tn.size = esize[i];
+			for (int c = 0; c < 4; c++)
+				tn.child[c] = node.child[c];
+			if (zdata[i].size()) {
+				ok = (::fwrite(zdata[i].data(), zdata[i].size(), 1, f) == 1);
+				pos += zdata[i].size();
+				if (node.src->cached) m_stats.cacheTiles++;
+				else m_stats.archiveTiles++;
+				m_stats.inflatedBytes += esize[i];
+				m_stats.deflatedBytes += zdata[i].size();
+			}
+		}
+		if (m_progress)
+			m_progress(i0 + n, nnode);
+	}
+
+	if (ok) {
+		tfh.dataLength = pos;
+		ok = (fseek(f, 0, SEEK_SET) == 0 && tfh.fwrite(f) == 1 &&
+			::fwrite(toc.data(), sizeof(TreeNode), nnode, f) == nnode);
+	}
+	if (fclose(f))
+		ok = false;
+	if (!ok)
+		remove(fname);
+
+	m_stats.nodeCount = nnode;
+	m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return ok;
+}
+
+// -----------------------------------------------------------------------
+
+bool TreeWriter::Append(const ZTreeMgr *mgr)
+{
+	auto t0 = std::chrono::steady_clock::now();
+	memset(&m_stats, 0, sizeof(Stats));
+	m_sources.clear();
+
+	m_merge = mgr;
+	ScanArchive();
+	ScanCache();
+
+	TreeFileHeader tfh;
+	BuildNodeList(tfh);
+	DWORD nnode = (DWORD)m_nodes.size();
+	if (!nnode)
+		return false;
+
+	std::string fname = m_root + "/Archive/" + ZTreeMgr::LayerName(m_layer) + ".tree";
+	FILE *f = fopen(fname.c_str(), "r+b");
+	if (!f)
+		return false;
+	TreeFileHeader ofh;
+	if (!ofh.fread(f)) {
+		fclose(f);
+		return false;
+	}
+
+	// new node data go to the end of the file, behind everything the current TOC refers to
+	bool ok = (_fseeki64(f, 0, SEEK_END) == 0);
+	__int64 pos = _ftelli64(f) - (__int64)ofh.dataOfs;
+
+	std::vector<TreeNode> toc(nnode);
+	std::vector<DWORD> zsize(nnode);
+	memset(toc.data(), 0, nnode * sizeof(TreeNode));
+
+	std::vector<std::vector<BYTE> > zdata(WRITE_BATCH);
+	std::vector<DWORD> esize(WRITE_BATCH);
+	std::vector<char> valid(WRITE_BATCH), keep(WRITE_BATCH);
+	__int64 live = 0;
+
+	for (DWORD i0 = 0; ok && i0 < nnode; i0 += WRITE_BATCH) {
+		int n = (int)min((DWORD)WRITE_BATCH, nnode - i0);
+
+		// compress the cache tiles that differ from their archive nodes, in parallel ...
+		parallelFor(n, [&](int i) {
+			const Node &node = m_nodes[i0 + i];
+			zdata[i].clear();
+			esize[i] = 0;
+			valid[i] = keep[i] = true;
+			if (node.src && node.src->cached) {
+				std::vector<BYTE> data;
+				valid[i] = ReadCacheFile(node, data);
+				keep[i] = valid[i] && data.size() && MatchesArchive(node.src->archiveIdx, data);
+				if (valid[i] && !keep[i] && data.size()) {
+					valid[i] = Compress(data, zdata[i]);
+					esize[i] = (DWORD)data.size();
+				}
+			}
+		});
+
+		// ... and append them sequentially
+		for (int i = 0; i < n && ok; i++) {
+			const Node &node = m_nodes[i0 + i];
+			if (!valid[i]) {
+				ok = false;
+				break;
+			}
+			TreeNode &tn = toc[i0 + i];
+			for (int c = 0; c < 4; c++)
+				tn.child[c] = node.child[c];
+			if (keep[i]) {
+				if (node.src) { // unchanged node: refer to the existing data
+					DWORD aidx = node.src->archiveIdx;
+					tn.pos = mgr->TOC()[aidx].pos;
+					tn.size = mgr->NodeSizeInflated(aidx);
+					zsize[i0 + i] = mgr->NodeSizeDeflated(aidx);
+					m_stats.archiveTiles++;
+				}
+			}
+			else if (zdata[i].size()) {
+				ok = (::fwrite(zdata[i].data(), zdata[i].size(), 1, f) == 1);
+				tn.pos = pos;
+				tn.size = esize[i];
+				zsize[i0 + i] = (DWORD)zdata[i].size();
+				pos += zdata[i].size();
+				m_stats.cacheTiles++;
+				m_stats.inflatedBytes += esize[i];
+				m_stats.deflatedBytes += zdata[i].size();
+			}
+			live += zsize[i0 + i];
+		}
+		if (m_progress)
+			m_progress(i0 + n, nnode);
+	}
+
+	if (ok && m_stats.cacheTiles) {
+		// The new TOC and node sizes follow the data block. The header is
+		// rewritten last, so that readers see either the old or the new TOC.
+		// The layout gets its own version, so that readers which expect the
+		// TOC after the header reject the file instead of misreading it.
+		tfh.magic[2] = TREEFILE_VERSION_APPEND;
+		tfh.flags = TREEFLAG_TOCATEND | TREEFLAG_NODESIZES;
+		tfh.nodeCount = nnode;
+		tfh.dataOfs = ofh.dataOfs;
+		tfh.dataLength = pos;
+		ok = (::fwrite(toc.data(), sizeof(TreeNode), nnode, f) == nnode &&
+			::fwrite(zsize.data(), sizeof(DWORD), nnode, f) == nnode &&
+			fflush(f) == 0 &&
+			_fseeki64(f, 0, SEEK_SET) == 0 && tfh.fwrite(f) == 1);
+	}
+	if (fclose(f))
+		ok = false;
+
+	m_stats.nodeCount = nnode;
+	m_stats.garbageBytes = (m_stats.cacheTiles ? pos : ofh.dataLength) - live;
+	m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return ok;
+}
@@ -0,0 +1,91 @@
+#ifndef TREEWRITER_H
+#define TREEWRITER_H
+
+#include "ZTreeMgr.h"
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+// =======================================================================
+// TreeWriter class: pack the cache tiles of a layer, optionally merged with
+// the nodes of an existing archive, into a compressed tree file that can be
+// read by ZTreeMgr.
+// Cache tiles are compressed in parallel and written sequentially in TOC
+// order. Nodes taken from the existing archive are copied without
+// recompressing them. Cache tiles replace archive nodes of the same tile.
+// Alternatively, new and changed cache tiles can be appended to an existing
+// archive in place. The payloads they replace remain in the file as unused
+// data until the archive is rebuilt with Write.
+
+class TreeWriter {
+public:
+	struct Stats {
+		DWORD nodeCount;       // number of nodes in the tree, including empty intermediate nodes
+		DWORD cacheTiles;      // number of tiles compressed from the cache
+		DWORD archiveTiles;    // number of tiles copied from the merge archive
+		__int64 inflatedBytes; // total uncompressed tile data
+		__int64 deflatedBytes; // total compressed tile data written
+		__int64 garbageBytes;  // unreferenced data left in the archive (Append only)
+		double seconds;        // wall time of the build
+	};
+	typedef std::function<void(DWORD done, DWORD total)> ProgressFunc;
+
+	TreeWriter(const char *root, ZTreeMgr::Layer layer);
+
+	void setMergeSource(const ZTreeMgr *mgr) { m_merge = mgr; }
+	// include the nodes of an existing archive (0: cache tiles only)
+
+	void setCompressionLevel(int level) { m_zlevel = level; }
+	void setProgressCallback(ProgressFunc func) { m_progress = func; }
+
+	bool Write(const char *fname);
+	// build the tree and write it to fname. Returns false on error, in which
+	// case the output file is removed.
+
+	bool Append(const ZTreeMgr *mgr);
+	// append new and changed cache tiles to the layer archive currently
+	// opened by mgr, followed by a new TOC. The header is updated last, so
+	// an interrupted update leaves the archive in its previous state.
+
+	const Stats &stats() const { return m_stats; }
+
+	static const char *TileExt(ZTreeMgr::Layer layer);
+	// file extension of cache tiles of the given layer
+
+protected:
+	struct Source {
+		bool cached;       // tile is read from the cache directory (otherwise from the merge archive)
+		DWORD archiveIdx;  // node index in the merge archive ((DWORD)-1: not in archive)
+	};
+	struct Node {
+		int lvl, ilat, ilng;
+		const Source *src; // 0 for intermediate nodes without data
+		DWORD child[4];
+	};
+
+	void ScanCache();
+	void ScanArchive();
+	void BuildNodeList(TreeFileHeader &tfh);
+	DWORD AddSubtree(int lvl, int ilat, int ilng);
+	bool ReadTile(const Node &node, std::vector<BYTE> &zdata, DWORD &esize) const;
+	bool ReadCacheFile(const Node &node, std::vector<BYTE> &data) const;
+	bool Compress(const std::vector<BYTE> &data, std::vector<BYTE> &zdata) const;
+	bool MatchesArchive(DWORD idx, const std::vector<BYTE> &data) const;
+	std::string TilePath(int lvl, int ilat, int ilng) const;
+
+private:
+	std::string m_root;
+	ZTreeMgr::Layer m_layer;
+	const ZTreeMgr *m_merge;
+	int m_zlevel;
+	ProgressFunc m_progress;
+	Stats m_stats;
+
+	std::unordered_map<unsigned __int64, Source> m_sources; // all tiles with data
+	std::unordered_set<unsigned __int64> m_present;          // all tree nodes at lvl >= 4, including intermediates
+	std::vector<Node> m_nodes;                               // nodes in TOC order
+};
+
+#endif // !TREEWRITER_H